@@ -0,0 +1,643 @@
+/*
+ * Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+ * Copyright (C) 2011-2026 Red Hat, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+using Gee;
+
+namespace Skk {
+    // File layout, all integers are 32-bit little endian:
+    //
+    //   "SKKBLK01"
+    //   number of entries
+    //   number of okuri-ari blocks
+    //   number of okuri-nasi blocks
+    //   offset of the block index
+    //   blocks, each a raw deflate stream of "midasi /.../\n" lines
+    //   block index, for each block:
+    //     offset, compressed length, length, key length, first key
+    //
+    // Entries are stored in UTF-8 and sorted by strcmp () in each of
+    // the okuri-ari and okuri-nasi sections, the okuri-ari blocks
+    // coming first.
+    class BlockDictIndexEntry {
+        public uint32 offset;
+        public uint32 compressed_length;
+        public uint32 length;
+        public string first_key;
+    }
+
+    // A decompressed block; data is nul-terminated.
+    class BlockDictBlock {
+        public int index;
+        public uint8[] data;
+    }
+
+    class BlockDictImage : Object {
+        internal const string MAGIC = "SKKBLK01";
+        internal const int HEADER_SIZE = 24;
+        const int CACHE_SIZE = 4;
+
+        internal MappedMemory mem;
+        internal uint entries;
+        internal BlockDictIndexEntry[] blocks;
+        internal int n_okuri_ari_blocks;
+
+        // Most recently used first.
+        BlockDictBlock?[] cache = new BlockDictBlock?[CACHE_SIZE];
+
+        internal static uint32 read_uint32 (uint8 *p) {
+            return ((uint32) p[3] << 24) | ((uint32) p[2] << 16) |
+                ((uint32) p[1] << 8) | (uint32) p[0];
+        }
+
+        internal BlockDictImage (MappedMemory mem) throws SkkDictError {
+            this.mem = mem;
+
+            uint8 *p = (uint8 *) mem.memory;
+            if (mem.length < HEADER_SIZE ||
+                Memory.cmp (p, MAGIC, MAGIC.length) != 0) {
+                throw new SkkDictError.MALFORMED_INPUT (
+                    "not a block dictionary");
+            }
+            entries = read_uint32 (p + 8);
+            var n_okuri_ari = read_uint32 (p + 12);
+            var n_okuri_nasi = read_uint32 (p + 16);
+            var index_offset = read_uint32 (p + 20);
+            if (index_offset > mem.length ||
+                n_okuri_ari + n_okuri_nasi > (mem.length - index_offset) / 16) {
+                throw new SkkDictError.MALFORMED_INPUT (
+                    "corrupted block index");
+            }
+
+            n_okuri_ari_blocks = (int) n_okuri_ari;
+            blocks = new BlockDictIndexEntry[n_okuri_ari + n_okuri_nasi];
+            size_t offset = index_offset;
+            for (var i = 0; i < blocks.length; i++) {
+                if (offset + 16 > mem.length) {
+                    throw new SkkDictError.MALFORMED_INPUT (
+                        "truncated block index");
+                }
+                var entry = new BlockDictIndexEntry ();
+                entry.offset = read_uint32 (p + offset);
+                entry.compressed_length = read_uint32 (p + offset + 4);
+                entry.length = read_uint32 (p + offset + 8);
+                var key_length = read_uint32 (p + offset + 12);
+                offset += 16;
+                if (key_length > mem.length - offset ||
+                    entry.offset < HEADER_SIZE ||
+                    entry.offset > index_offset ||
+                    entry.compressed_length > index_offset - entry.offset ||
+                    entry.length > int.MAX - 1) {
+                    throw new SkkDictError.MALFORMED_INPUT (
+                        "corrupted block index");
+                }
+                var key = new uint8[key_length + 1];
+                Memory.copy (key, p + offset, key_length);
+                entry.first_key = (string) key;
+                offset += key_length;
+                blocks[i] = entry;
+            }
+        }
+
+        // Return the last block in [start, end) whose first key is
+        // not greater than key, or start if there is none.
+        internal int find_block (string key, int start, int end) {
+            int low = start, high = end;
+            while (high - low > 1) {
+                var middle = low + (high - low) / 2;
+                if (strcmp (blocks[middle].first_key, key) <= 0) {
+                    low = middle;
+                } else {
+                    high = middle;
+                }
+            }
+            return low;
+        }
+
+        internal BlockDictBlock get_block (int index) throws GLib.Error {
+            lock (cache) {
+                for (var i = 0; i < cache.length; i++) {
+                    var block = cache[i];
+                    if (block != null && block.index == index) {
+                        for (var j = i; j > 0; j--) {
+                            cache[j] = cache[j - 1];
+                        }
+                        cache[0] = block;
+                        return block;
+                    }
+                }
+            }
+
+            // decompress outside of the lock, so lookups of other
+            // blocks are not serialized
+            var block = new BlockDictBlock ();
+            block.index = index;
+            block.data = inflate (blocks[index]);
+
+            lock (cache) {
+                for (var j = cache.length - 1; j > 0; j--) {
+                    cache[j] = cache[j - 1];
+                }
+                cache[0] = block;
+            }
+            return block;
+        }
+
+        uint8[] inflate (BlockDictIndexEntry entry) throws GLib.Error {
+            unowned uint8[] inbuf = (uint8[]) ((uint8 *) mem.memory +
+                                               entry.offset);
+            inbuf.length = (int) entry.compressed_length;
+            // zero-filled, so the data is nul-terminated
+            var outbuf = new uint8[entry.length + 1];
+            var decompressor = new ZlibDecompressor (
+                ZlibCompressorFormat.RAW);
+            size_t total_bytes_read = 0, total_bytes_written = 0;
+            while (true) {
+                size_t bytes_read, bytes_written;
+                var result = decompressor.convert (
+                    inbuf[total_bytes_read:inbuf.length],
+                    outbuf[total_bytes_written:entry.length],
+                    ConverterFlags.INPUT_AT_END,
+                    out bytes_read,
+                    out bytes_written);
+                total_bytes_read += bytes_read;
+                total_bytes_written += bytes_written;
+                if (result == ConverterResult.FINISHED) {
+                    break;
+                }
+                if (bytes_read == 0 && bytes_written == 0) {
+                    throw new SkkDictError.MALFORMED_INPUT (
+                        "truncated block");
+                }
+            }
+            if (total_bytes_written != entry.length) {
+                throw new SkkDictError.MALFORMED_INPUT (
+                    "block length mismatch");
+            }
+            outbuf.length--;
+            return outbuf;
+        }
+
+        internal size_t get_heap_size () {
+            size_t size = MemoryUsageUtils.instance_size (get_type ()) +
+                blocks.length * sizeof (void *);
+            foreach (var entry in blocks) {
+                size += sizeof (BlockDictIndexEntry) +
+                    MemoryUsageUtils.string_size (entry.first_key);
+            }
+            lock (cache) {
+                foreach (var block in cache) {
+                    if (block != null) {
+                        size += sizeof (BlockDictBlock) + block.data.length + 1;
+                    }
+                }
+            }
+            return size;
+        }
+    }
+
+    /**
+     * Read-only dictionary stored as compressed blocks.
+     *
+     * The entries are split into blocks which are compressed
+     * independently, and only the block index is kept in memory.  A
+     * lookup decompresses the block which may contain the midasi, and
+     * the last few decompressed blocks are cached.  Use {@link
+     * BlockDict.compress} to convert a file dictionary.
+     *
+     * @since 1.2.0
+     */
+    public class BlockDict : Dict {
+        /**
+         * {@inheritDoc}
+         *
+         * This is safe to call while lookups are running, since the
+         * previous mapping is kept until the last lookup using it
+         * returns.
+         */
+        public override void reload () throws GLib.Error {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
+#if VALA_0_16
+            string attributes = FileAttribute.ETAG_VALUE;
+#else
+            string attributes = FILE_ATTRIBUTE_ETAG_VALUE;
+#endif
+            FileInfo info = file.query_info (attributes,
+                                             FileQueryInfoFlags.NONE);
+            if (info.get_etag () != etag) {
+                try {
+                    var image = new BlockDictImage (mmap.remap ());
+                    lock (current_image) {
+                        current_image = image;
+                    }
+                    etag = info.get_etag ();
+                } catch (SkkDictError e) {
+                    warning ("error loading block dictionary %s %s",
+                             file.get_path (), e.message);
+                }
+            }
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Dict.reload", "%s", get_type ().name ());
+#endif
+        }
+
+        BlockDictImage? acquire_image () {
+            BlockDictImage? image;
+            lock (current_image) {
+                image = current_image;
+            }
+            return image;
+        }
+
+        // Compare the key of the line starting at start with key,
+        // the same way as strcmp ().
+        static int compare_key (uint8[] data, int start, int key_end,
+                                string key)
+        {
+            var length = key_end - start;
+            var r = Memory.cmp ((uint8 *) data + start, key,
+                                int.min (length, key.length));
+            if (r != 0) {
+                return r;
+            }
+            return length - key.length;
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override Candidate[] lookup (string midasi, bool okuri = false) {
+            var image = acquire_image ();
+            if (image == null)
+                return new Candidate[0];
+
+            int start, end;
+            if (okuri) {
+                start = 0;
+                end = image.n_okuri_ari_blocks;
+            } else {
+                start = image.n_okuri_ari_blocks;
+                end = image.blocks.length;
+            }
+            if (start == end) {
+                return new Candidate[0];
+            }
+
+            BlockDictBlock block;
+            try {
+                block = image.get_block (image.find_block (midasi,
+                                                           start, end));
+            } catch (GLib.Error e) {
+                warning ("can't read block dictionary %s: %s",
+                         file.get_path (), e.message);
+                return new Candidate[0];
+            }
+
+            unowned uint8[] data = block.data;
+            int offset = 0;
+            while (offset < data.length) {
+                unowned string line = (string) ((uint8 *) data + offset);
+                var line_end = line.index_of_char ('\n');
+                var space = line.index_of_char (' ');
+                if (line_end < 0) {
+                    line_end = data.length - offset;
+                }
+                if (space < 1 || space > line_end) {
+                    warning ("corrupted dictionary entry in %s",
+                             file.get_path ());
+                    break;
+                }
+                var r = compare_key (data, offset, offset + space, midasi);
+                if (r == 0) {
+                    return split_candidates (
+                        midasi, okuri,
+                        line.substring (space, line_end - space));
+                }
+                if (r > 0) {
+                    break;
+                }
+                offset += line_end + 1;
+            }
+            return new Candidate[0];
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override string[] complete (string midasi) {
+            return complete_prefix (midasi);
+        }
+
+        // Add the keys of the entries between the blocks start and
+        // end which start with midasi, in ascending order, up to
+        // limit.
+        void collect_completions (BlockDictImage image,
+                                  string midasi,
+                                  int start,
+                                  int end,
+                                  int limit,
+                                  ArrayList<string> completion)
+        {
+            // completions are consecutive, starting in the block
+            // which may contain midasi
+            var index = image.find_block (midasi, start, end);
+            for (; index < end; index++) {
+                BlockDictBlock block;
+                try {
+                    block = image.get_block (index);
+                } catch (GLib.Error e) {
+                    warning ("can't read block dictionary %s: %s",
+                             file.get_path (), e.message);
+                    return;
+                }
+
+                unowned uint8[] data = block.data;
+                int offset = 0;
+                while (offset < data.length) {
+                    unowned string line = (string) ((uint8 *) data + offset);
+                    var line_end = line.index_of_char ('\n');
+                    var space = line.index_of_char (' ');
+                    if (line_end < 0) {
+                        line_end = data.length - offset;
+                    }
+                    if (space < 1 || space > line_end) {
+                        warning ("corrupted dictionary entry in %s",
+                                 file.get_path ());
+                        return;
+                    }
+                    if (space >= midasi.length && line.has_prefix (midasi)) {
+                        // don't add midasi word itself
+                        if (space != midasi.length) {
+                            completion.add (line.substring (0, space));
+                            if (completion.size == limit) {
+                                return;
+                            }
+                        }
+                    } else if (compare_key (data, offset, offset + space,
+                                            midasi) > 0) {
+                        return;
+                    }
+                    offset += line_end + 1;
+                }
+            }
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override string[] complete_prefix (string midasi,
+                                                  bool okuri = false,
+                                                  int limit = -1)
+        {
+            var completion = new ArrayList<string> ();
+            var image = acquire_image ();
+            if (image == null || limit == 0)
+                return completion.to_array ();
+
+            if (!okuri) {
+                collect_completions (image, midasi,
+                                     image.n_okuri_ari_blocks,
+                                     image.blocks.length,
+                                     limit,
+                                     completion);
+                return completion.to_array ();
+            }
+
+            // okuri-ari entries are sorted in ascending order here,
+            // while they are in descending order in file
+            // dictionaries; collect all of them and return the
+            // largest first
+            collect_completions (image, midasi,
+                                 0, image.n_okuri_ari_blocks,
+                                 -1,
+                                 completion);
+            var length = completion.size;
+            if (limit > 0 && limit < length) {
+                length = limit;
+            }
+            var result = new string[length];
+            for (var i = 0; i < length; i++) {
+                result[i] = completion[completion.size - 1 - i];
+            }
+            return result;
+        }
+
+        internal override File? get_backing_file () {
+            return file;
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override MemoryUsage get_memory_usage () {
+            var usage = base.get_memory_usage ();
+            var image = acquire_image ();
+            if (image != null) {
+                usage.heap_bytes += image.get_heap_size ();
+                usage.mapped_bytes = image.mem.length;
+                usage.entries = image.entries;
+            }
+            return usage;
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override bool read_only {
+            get {
+                return true;
+            }
+        }
+
+        File file;
+        MemoryMappedFile mmap;
+        string etag;
+        BlockDictImage? current_image = null;
+
+        /**
+         * Create a new BlockDict.
+         *
+         * @param path a path to the file created with {@link compress}
+         *
+         * @return a new BlockDict
+         * @throws GLib.Error if opening the file is failed
+         */
+        public BlockDict (string path) throws GLib.Error {
+            this.file = File.new_for_path (path);
+            this.mmap = new MemoryMappedFile (file);
+            this.etag = "";
+            reload ();
+        }
+
+        class Entry {
+            public string midasi;
+            public string line;
+        }
+
+        static void append_uint32 (ByteArray array, uint32 value) {
+            uint8[] bytes = {
+                (uint8) value,
+                (uint8) (value >> 8),
+                (uint8) (value >> 16),
+                (uint8) (value >> 24)
+            };
+            array.append (bytes);
+        }
+
+        static void put_uint32 (ByteArray array, uint offset, uint32 value) {
+            array.data[offset] = (uint8) value;
+            array.data[offset + 1] = (uint8) (value >> 8);
+            array.data[offset + 2] = (uint8) (value >> 16);
+            array.data[offset + 3] = (uint8) (value >> 24);
+        }
+
+        static Bytes deflate (uint8[] data) throws GLib.Error {
+            var output = new MemoryOutputStream.resizable ();
+            var stream = new ConverterOutputStream (
+                output,
+                new ZlibCompressor (ZlibCompressorFormat.RAW, 9));
+            size_t bytes_written;
+            stream.write_all (data, out bytes_written);
+            stream.close ();
+            return output.steal_as_bytes ();
+        }
+
+        // Append the blocks of a section and return their number.
+        static uint32 write_blocks (ByteArray array,
+                                    ByteArray index,
+                                    Gee.List<Entry> entries,
+                                    uint block_size) throws GLib.Error
+        {
+            uint32 count = 0;
+            var builder = new StringBuilder ();
+            string? first_key = null;
+            for (var i = 0; i <= entries.size; i++) {
+                if (i < entries.size) {
+                    var entry = entries[i];
+                    if (first_key == null) {
+                        first_key = entry.midasi;
+                    }
+                    builder.append (entry.line);
+                    builder.append_c ('\n');
+                }
+                if (builder.len > 0 &&
+                    (builder.len >= block_size || i == entries.size)) {
+                    var compressed = deflate (builder.str.data);
+                    append_uint32 (index, array.len);
+                    append_uint32 (index, compressed.length);
+                    append_uint32 (index, (uint32) builder.len);
+                    append_uint32 (index, first_key.length);
+                    index.append (first_key.data);
+                    array.append (compressed.get_data ());
+                    builder.truncate ();
+                    first_key = null;
+                    count++;
+                }
+            }
+            return count;
+        }
+
+        /**
+         * Convert a file dictionary to the format read by BlockDict.
+         *
+         * @param input_path a path to a file dictionary
+         * @param output_path a path to the file to create
+         * @param encoding encoding of the input file, unless
+         * specified in its first line (default EUC-JP)
+         * @param block_size approximate number of bytes in a block
+         * before compression
+         *
+         * @throws GLib.Error if reading or writing a file failed, or
+         * the input is not a file dictionary
+         * @since 1.2.0
+         */
+        public static void compress (string input_path,
+                                     string output_path,
+                                     string encoding = "EUC-JP",
+                                     uint block_size = 8192)
+            throws GLib.Error
+        {
+            string contents;
+            FileUtils.get_contents (input_path, out contents);
+
+            var first_line_end = contents.index_of_char ('\n');
+            var coding = EncodingConverter.extract_coding_system (
+                first_line_end < 0 ?
+                contents : contents.substring (0, first_line_end));
+            EncodingConverter converter;
+            if (coding != null) {
+                converter = new EncodingConverter.from_coding_system (coding);
+            } else {
+                converter = new EncodingConverter (encoding);
+            }
+            contents = converter.decode (contents);
+
+            var okuri_ari = new ArrayList<Entry> ();
+            var okuri_nasi = new ArrayList<Entry> ();
+            Gee.List<Entry>? section = null;
+            foreach (var line in contents.split ("\n")) {
+                if (line.has_prefix (";;")) {
+                    if (line.has_prefix (";; okuri-ari entries.")) {
+                        section = okuri_ari;
+                    } else if (line.has_prefix (";; okuri-nasi entries.")) {
+                        section = okuri_nasi;
+                    }
+                    continue;
+                }
+                if (section == null || line.strip () == "") {
+                    continue;
+                }
+                var index = line.index_of_char (' ');
+                if (index < 1) {
+                    throw new SkkDictError.MALFORMED_INPUT (
+                        "corrupted dictionary entry: %s", line);
+                }
+                var entry = new Entry ();
+                entry.midasi = line.substring (0, index);
+                entry.line = line;
+                section.add (entry);
+            }
+            if (section != okuri_nasi) {
+                throw new SkkDictError.MALFORMED_INPUT (
+                    "no okuri-nasi boundary");
+            }
+            okuri_ari.sort ((a, b) => strcmp (a.midasi, b.midasi));
+            okuri_nasi.sort ((a, b) => strcmp (a.midasi, b.midasi));
+
+            var array = new ByteArray ();
+            array.append (BlockDictImage.MAGIC.data);
+            append_uint32 (array, okuri_ari.size + okuri_nasi.size);
+            // block counts and index offset are filled in below
+            append_uint32 (array, 0);
+            append_uint32 (array, 0);
+            append_uint32 (array, 0);
+
+            var index = new ByteArray ();
+            var n_okuri_ari = write_blocks (array, index, okuri_ari,
+                                            block_size);
+            var n_okuri_nasi = write_blocks (array, index, okuri_nasi,
+                                             block_size);
+            put_uint32 (array, 12, n_okuri_ari);
+            put_uint32 (array, 16, n_okuri_nasi);
+            put_uint32 (array, 20, array.len);
+            array.append (index.data);
+
+            FileUtils.set_data (output_path, array.data);
+        }
+    }
+}
@@ -151,6 +151,12 @@ namespace Skk {
          * @param candidate selected candidate
          */
         public signal void selected (Candidate candidate);
+
+        // Start replacing the candidates.  Unlike clear (), signals
+        // may be held back until add_candidates_end ().
+        internal virtual void add_candidates_start () {
+            clear ();
+        }
     }
 
     class SimpleCandidateList : CandidateList {
@@ -176,12 +182,69 @@ namespace Skk {
             }
         }
 
-        Set<string> seen = new HashSet<string> ();
+        // Open-addressing set of the outputs added since the last
+        // clear, holding indices into _candidates.  The slots are
+        // kept across lookups; a slot is empty unless it is marked
+        // with the current generation.
+        const int MIN_SEEN_CAPACITY = 64;
+        int[] seen_indices = new int[MIN_SEEN_CAPACITY];
+        uint[] seen_hashes = new uint[MIN_SEEN_CAPACITY];
+        uint[] seen_generations = new uint[MIN_SEEN_CAPACITY];
+        uint seen_generation = 1;
+
+        void reset_seen () {
+            if (++seen_generation == 0) {
+                for (var i = 0; i < seen_generations.length; i++) {
+                    seen_generations[i] = 0;
+                }
+                seen_generation = 1;
+            }
+        }
+
+        // Return false if a candidate with the same output was
+        // already added, otherwise record it at the end of
+        // _candidates.
+        bool add_seen (Candidate candidate, uint hash) {
+            var mask = seen_indices.length - 1;
+            for (var i = (int) (hash & (uint) mask); ; i = (i + 1) & mask) {
+                if (seen_generations[i] != seen_generation) {
+                    seen_generations[i] = seen_generation;
+                    seen_hashes[i] = hash;
+                    seen_indices[i] = _candidates.size;
+                    return true;
+                }
+                if (seen_hashes[i] == hash &&
+                    _candidates[seen_indices[i]].output == candidate.output) {
+                    return false;
+                }
+            }
+        }
+
+        // Keep the load factor at most 1/2.
+        void reserve_seen (int size) {
+            var capacity = seen_indices.length;
+            if (size * 2 <= capacity) {
+                return;
+            }
+            while (size * 2 > capacity) {
+                capacity *= 2;
+            }
+            seen_indices = new int[capacity];
+            seen_hashes = new uint[capacity];
+            seen_generations = new uint[capacity];
+            seen_generation = 1;
+            var candidates = _candidates;
+            _candidates = new ArrayList<Candidate> ();
+            foreach (var c in candidates) {
+                add_seen (c, c.get_output_hash ());
+                _candidates.add (c);
+            }
+        }
 
         internal override void clear () {
             bool is_populated = false;
             bool is_cursor_changed = false;
-            seen.clear ();
+            reset_seen ();
             if (_candidates.size > 0) {
                 _candidates.clear ();
                 is_populated = true;
@@ -200,11 +263,17 @@ namespace Skk {
             }
         }
 
+        internal override void add_candidates_start () {
+            reset_seen ();
+            _candidates.clear ();
+            _cursor_pos = -1;
+        }
+
         internal override void add_candidates (Candidate[] array) {
+            reserve_seen (_candidates.size + array.length);
             foreach (var c in array) {
-                if (!(c.output in seen)) {
+                if (add_seen (c, c.get_output_hash ())) {
                     _candidates.add (c);
-                    seen.add (c.output);
                 }
             }
         }
@@ -375,6 +444,10 @@ namespace Skk {
             candidates.add_candidates_end ();
         }
 
+        internal override void add_candidates_start () {
+            candidates.add_candidates_start ();
+        }
+
         public override bool select_at (uint index_in_page) {
             return candidates.select_at (index_in_page);
         }
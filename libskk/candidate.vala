@@ -18,6 +18,16 @@
 using Gee;
 
 namespace Skk {
+    // A midasi shared by the candidates of a lookup, instead of a
+    // copy in each of them.  Released with the last candidate.
+    class SharedString {
+        public string str;
+
+        public SharedString (string str) {
+            this.str = str;
+        }
+    }
+
     /**
      * Object representing a candidate in dictionaries.
      */
@@ -25,7 +35,15 @@ namespace Skk {
         /**
          * Midasi word which generated this candidate.
          */
-        public string midasi { get; private set; }
+        public string midasi {
+            get {
+                return _midasi.str;
+            }
+            private set {
+                _midasi = new SharedString (value);
+            }
+        }
+        SharedString _midasi;
 
         /**
          * Flag to indicate whether this candidate is generated as a
@@ -36,7 +54,19 @@ namespace Skk {
         /**
          * Base string value of the candidate.
          */
-        public string text { get; set; }
+        public string text {
+            get {
+                return _text;
+            }
+            set {
+                // keep the output which was implicitly the old text
+                if (_output == null && _text != null && _text != value) {
+                    _output = _text;
+                }
+                _text = value;
+            }
+        }
+        string _text;
 
         /**
          * Optional annotation text associated with the candidate.
@@ -49,7 +79,41 @@ namespace Skk {
          * This is particularly useful to display a candidate of
          * numeric conversion.
          */
-        public string output { get; set; }
+        public string output {
+            get {
+                if (_output != null) {
+                    return _output;
+                }
+                return _text;
+            }
+            set {
+                if (value != output) {
+                    _output_hash = 0;
+                }
+                // only stored if it differs from text
+                _output = value == _text ? null : value;
+            }
+        }
+        string? _output;
+
+        // str_hash () of output, 0 if not computed yet.
+        uint _output_hash;
+
+        internal uint get_output_hash () {
+            if (_output_hash == 0) {
+                _output_hash = str_hash (output);
+            }
+            return _output_hash;
+        }
+
+        // Heap bytes owned by the candidate; midasi may be shared and
+        // is not counted.
+        internal size_t get_heap_size () {
+            return MemoryUsageUtils.instance_size (typeof (Candidate)) +
+                MemoryUsageUtils.string_size (_text) +
+                MemoryUsageUtils.string_size (_output) +
+                MemoryUsageUtils.string_size (annotation);
+        }
 
         /**
          * Convert the candidate to string.
@@ -86,5 +150,18 @@ namespace Skk {
             this.annotation = annotation;
             this.output = output == null ? text : output;
         }
+
+        // Used by the dictionaries to share midasi between the
+        // candidates of an entry.
+        internal Candidate.with_shared_midasi (SharedString midasi,
+                                               bool okuri,
+                                               string text,
+                                               string? annotation = null)
+        {
+            _midasi = midasi;
+            this.okuri = okuri;
+            this.text = text;
+            this.annotation = annotation;
+        }
     }
 }
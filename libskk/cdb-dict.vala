@@ -30,8 +30,15 @@ namespace Skk {
 
         /**
          * {@inheritDoc}
+         *
+         * This is safe to call while lookups are running, since the
+         * previous mapping is kept until the last lookup using it
+         * returns.
          */
         public override void reload () throws GLib.Error {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
 #if VALA_0_16
             string attributes = FileAttribute.ETAG_VALUE;
 #else
@@ -48,6 +55,9 @@ namespace Skk {
                              file.get_path (), e.message);
                 }
             }
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Dict.reload", "%s", get_type ().name ());
+#endif
         }
 
         static uint32 read_uint32 (uint8 *p) {
@@ -61,7 +71,8 @@ namespace Skk {
          * {@inheritDoc}
          */
         public override Candidate[] lookup (string midasi, bool okuri = false) {
-            if (mmap.memory == null)
+            var mem = mmap.acquire ();
+            if (mem == null)
                 return new Candidate[0];
 
             string _midasi;
@@ -73,12 +84,12 @@ namespace Skk {
             }
 
             uint32 h = hash (_midasi.to_utf8 ());
-            uint8 *p = (uint8 *) mmap.memory + (h % 256) * 8;
+            uint8 *p = (uint8 *) mem.memory + (h % 256) * 8;
             uint32 hash_offset = read_uint32 (p);
             uint32 hash_length = read_uint32 (p + 4);
 
             uint32 start = (h >> 8) % hash_length;
-            p = (uint8 *) mmap.memory + hash_offset;
+            p = (uint8 *) mem.memory + hash_offset;
             for (var i = 0; i < hash_length; i++) {
                 uint8 *q = p + 8 * ((i + start) % hash_length);
                 uint32 _h = read_uint32 (q);
@@ -86,7 +97,7 @@ namespace Skk {
                 if (record_offset == 0)
                     break;
                 if (_h == h) {
-                    uint8 *r = (uint8 *) mmap.memory + record_offset;
+                    uint8 *r = (uint8 *) mem.memory + record_offset;
                     uint32 key_length = read_uint32 (r);
                     uint32 data_length = read_uint32 (r + 4);
                     if (Memory.cmp (r + 8, _midasi, key_length) == 0) {
@@ -118,6 +129,136 @@ namespace Skk {
             return new string[0];
         }
 
+        // Collect the candidates of all records for ReverseIndex.
+        // Records lie between the header and the first hash table.
+        static uint32[] scan_candidates (MappedMemory mem) {
+            uint32[] pairs = {};
+            uint8 *p = (uint8 *) mem.memory;
+            if (mem.length < 2048) {
+                return pairs;
+            }
+            uint32 end = (uint32) mem.length;
+            for (var i = 0; i < 256; i++) {
+                end = uint32.min (end, read_uint32 (p + i * 8));
+            }
+            uint32 offset = 2048;
+            while (offset + 8 <= end) {
+                uint32 key_length = read_uint32 (p + offset);
+                uint32 data_length = read_uint32 (p + offset + 4);
+                uint32 data_offset = offset + 8 + key_length;
+                if (data_offset < offset || data_offset > end ||
+                    data_length > end - data_offset) {
+                    break;
+                }
+                ReverseIndex.add_candidates (ref pairs, p,
+                                             data_offset,
+                                             data_offset + data_length,
+                                             offset);
+                offset = data_offset + data_length;
+            }
+            return pairs;
+        }
+
+        // Build the reverse index of the current mapping on first use.
+        ReverseIndex get_reverse_index (MappedMemory mem) {
+            lock (reverse_index) {
+                if (reverse_index == null || reverse_index_mem != mem) {
+                    var path = file.get_path ();
+                    var version = "%s\n%s".printf (etag,
+                                                  mem.length.to_string ());
+                    reverse_index = ReverseIndex.load (path, version);
+                    if (reverse_index == null) {
+                        reverse_index = ReverseIndex.build (
+                            path, version, (uint8 *) mem.memory, mem.length,
+                            scan_candidates (mem));
+                    }
+                    reverse_index_mem = mem;
+                }
+                return reverse_index;
+            }
+        }
+
+        // CDB does not separate okuri-ari entries; their midasi end
+        // with the first letter of the okurigana in romaji.
+        static bool is_okuri_ari (string midasi) {
+            var length = midasi.length;
+            return length > 1 &&
+                'a' <= midasi[length - 1] && midasi[length - 1] <= 'z' &&
+                (uint8) midasi[length - 2] >= 0x80;
+        }
+
+        /**
+         * {@inheritDoc}
+         *
+         * The first call builds an index of the candidates, which is
+         * cached in the user cache directory.
+         */
+        public override Candidate[] reverse_lookup (string text) {
+            Candidate[] result = {};
+            var mem = mmap.acquire ();
+            if (mem == null)
+                return result;
+
+            string _text;
+            try {
+                _text = converter.encode (text);
+            } catch (GLib.Error e) {
+                warning ("can't encode %s: %s", text, e.message);
+                return result;
+            }
+
+            var index = get_reverse_index (mem);
+            foreach (var offset in index.lookup ((uint8 *) mem.memory,
+                                                 mem.length,
+                                                 _text)) {
+                uint8 *r = (uint8 *) mem.memory + offset;
+                uint32 key_length = read_uint32 (r);
+                uint32 data_length = read_uint32 (r + 4);
+                char[] key = new char[key_length + 1];
+                Memory.copy (key, r + 8, key_length);
+                key.length--;
+                char[] data = new char[data_length + 1];
+                Memory.copy (data, r + 8 + key_length, data_length);
+                data.length--;
+                string midasi, _data;
+                try {
+                    midasi = converter.decode ((string) key);
+                    _data = converter.decode ((string) data);
+                } catch (GLib.Error e) {
+                    warning ("can't decode record at %u: %s",
+                             offset, e.message);
+                    continue;
+                }
+                ReverseIndex.filter_candidates (
+                    ref result,
+                    split_candidates (midasi, is_okuri_ari (midasi), _data),
+                    text);
+            }
+            return result;
+        }
+
+        internal override File? get_backing_file () {
+            return file;
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override MemoryUsage get_memory_usage () {
+            var usage = base.get_memory_usage ();
+            var mem = mmap.acquire ();
+            if (mem != null) {
+                usage.mapped_bytes = mem.length;
+                // each of the 256 hash tables has twice as many
+                // slots as records
+                uint8 *p = (uint8 *) mem.memory;
+                for (var i = 0; i < 256; i++) {
+                    usage.entries += read_uint32 (p + i * 8 + 4) / 2;
+                }
+            }
+            return usage;
+        }
+
         /**
          * {@inheritDoc}
          */
@@ -131,6 +272,8 @@ namespace Skk {
         MemoryMappedFile mmap;
         string etag;
         EncodingConverter converter;
+        ReverseIndex? reverse_index = null;
+        MappedMemory? reverse_index_mem = null;
 
         /**
          * Create a new CdbDict.
@@ -4,30 +4,261 @@ namespace Skk {
     public abstract class CompletionSource : Object {
         public abstract string[] get_completions(string midasi);
         public int priority { get; set; }
+
+        // Same as get_completions(), without any ordering guarantee.
+        internal virtual string[] get_unsorted_completions(string midasi) {
+            return get_completions(midasi);
+        }
+
+        /**
+         * Whether the completions for a prefix are always a subset of
+         * the completions for any shorter prefix.  If all sources are
+         * narrowable, {@link CompletionService} filters the previous
+         * results instead of querying the sources again when the
+         * prefix grows.
+         *
+         * @since 1.2.0
+         */
+        public virtual bool narrowable {
+            get {
+                return false;
+            }
+        }
+
+        /**
+         * Whether answering a query may block, e.g. on network I/O.
+         * {@link CompletionService.get_completions_async} only waits
+         * for remote sources and queries the others synchronously.
+         *
+         * @since 1.2.0
+         */
+        public virtual bool is_remote {
+            get {
+                return false;
+            }
+        }
+
+        /**
+         * Asynchronously return the completions of a prefix.
+         *
+         * The default implementation calls {@link get_completions}.
+         *
+         * @param midasi a prefix
+         * @param cancellable a cancellable
+         *
+         * @return completions
+         * @throws GLib.IOError.CANCELLED if cancelled
+         * @since 1.2.0
+         */
+        public virtual async string[] get_completions_async(string midasi, Cancellable? cancellable = null) throws GLib.Error {
+            if (cancellable != null) {
+                cancellable.set_error_if_cancelled();
+            }
+            return get_completions(midasi);
+        }
+    }
+
+    // A query of a remote dictionary, run on the worker thread of
+    // DictCompletionSource.
+    class CompletionTask {
+        public DictCompletionSource source;
+        public string midasi;
+        public Cancellable? cancellable;
+        public string[] completions = {};
+        // Resumes the caller; only touched on the main thread.
+        public SourceFunc? callback;
+
+        public CompletionTask(DictCompletionSource source, string midasi,
+                              Cancellable? cancellable) {
+            this.source = source;
+            this.midasi = midasi;
+            this.cancellable = cancellable;
+        }
+
+        // Called on the main thread, when the query is done or the
+        // caller cancelled; whichever comes first resumes the caller.
+        public void finish() {
+            if (callback != null) {
+                SourceFunc resume = (owned) callback;
+                callback = null;
+                resume();
+            }
+        }
     }
 
     public class DictCompletionSource : CompletionSource {
         private Dict dict;
 
+        // A single worker, so queries of remote dictionaries are
+        // serialized and queued ones can be dropped when cancelled.
+        static ThreadPool<CompletionTask>? pool = null;
+
         public DictCompletionSource(Dict dict, int priority) {
             this.dict = dict;
             this.priority = priority;
         }
 
+        string[] complete(string midasi) {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now();
+#endif
+            var completions = dict.complete(midasi);
+#if ENABLE_TRACING
+            Trace.mark(trace_begin, "Dict.complete",
+                       "%s midasi=%d completions=%d",
+                       dict.get_type().name(), (int) midasi.char_count(),
+                       completions.length);
+#endif
+            return completions;
+        }
+
         public override string[] get_completions(string midasi) {
+            var keys = new HashMap<string,string>();
             ArrayList<string> completions = new ArrayList<string>();
-            string[] dict_completions = dict.complete(midasi);
+            string[] dict_completions = complete(midasi);
             if (dict_completions != null && dict_completions.length > 0) {
+                foreach (var completion in dict_completions) {
+                    keys.set(completion, completion.collate_key());
+                }
                 completions.add_all_array(dict_completions);
-                completions.sort((a, b) => a.collate(b));
+                completions.sort((a, b) => strcmp(keys.get(a), keys.get(b)));
             }
             return completions.to_array();
         }
+
+        internal override string[] get_unsorted_completions(string midasi) {
+            // CompletionService sorts the merged results itself.
+            return complete(midasi);
+        }
+
+        public override bool narrowable {
+            get {
+                return true;
+            }
+        }
+
+        public override bool is_remote {
+            get {
+                return dict is SkkServ;
+            }
+        }
+
+        public override async string[] get_completions_async(string midasi, Cancellable? cancellable = null) throws GLib.Error {
+            if (cancellable != null) {
+                cancellable.set_error_if_cancelled();
+            }
+            if (!is_remote) {
+                return get_completions(midasi);
+            }
+
+            // Run the blocking query on the worker.  If cancelled,
+            // return right away; a query already sent to the server
+            // still runs to the end, but its result is dropped.
+            var task = new CompletionTask(this, midasi, cancellable);
+            task.callback = get_completions_async.callback;
+            if (!push(task)) {
+                return get_completions(midasi);
+            }
+            ulong cancelled_id = 0;
+            if (cancellable != null) {
+                cancelled_id = cancellable.connect(() => {
+                        Idle.add(() => {
+                                task.finish();
+                                return false;
+                            });
+                    });
+            }
+            yield;
+
+            if (cancellable != null) {
+                cancellable.disconnect(cancelled_id);
+                cancellable.set_error_if_cancelled();
+            }
+            return task.completions;
+        }
+
+        static void run_in_worker(owned CompletionTask task) {
+            if (task.cancellable == null || !task.cancellable.is_cancelled()) {
+                task.completions = task.source.complete(task.midasi);
+            }
+            Idle.add(() => {
+                    task.finish();
+                    return false;
+                });
+        }
+
+        // Queue the task on the worker.  Returns false if the worker
+        // can't be started.
+        static bool push(CompletionTask task) {
+            lock (pool) {
+                try {
+                    if (pool == null) {
+                        pool = new ThreadPool<CompletionTask>.with_owned_data(
+                            run_in_worker, 1, false);
+                    }
+                    pool.add(task);
+                } catch (ThreadError e) {
+                    warning("can't queue completion: %s", e.message);
+                    return false;
+                }
+                return true;
+            }
+        }
+    }
+
+    class CompletionItem {
+        public string text;
+        // Set if the source leaves the ordering to the service.
+        public string? collate_key;
+        public int priority;
+        public int source_index;
+        public int position;
+        public LearningUsage usage;
+
+        public CompletionItem(string text, int priority,
+                              int source_index, int position,
+                              bool collate) {
+            this.text = text;
+            this.collate_key = collate ? text.collate_key() : null;
+            this.priority = priority;
+            this.source_index = source_index;
+            this.position = position;
+        }
     }
 
+    /**
+     * Callback receiving the completions merged so far.
+     *
+     * @param completions completions
+     * @since 1.2.0
+     */
+    public delegate void CompletionsUpdatedFunc(string[] completions);
+
     public class CompletionService {
         private Gee.List<CompletionSource> sources = new Gee.ArrayList<CompletionSource>();
 
+        // Results of the last query, ranked.
+        private string? cached_prefix = null;
+        private Gee.List<CompletionItem> cached_items = new ArrayList<CompletionItem>();
+
+        /**
+         * Learning store used to rank completions by usage.
+         *
+         * @since 1.2.0
+         */
+        public LearningStore? learning {
+            get {
+                return _learning;
+            }
+            set {
+                if (_learning != value) {
+                    _learning = value;
+                    invalidate();
+                }
+            }
+        }
+        private LearningStore? _learning = null;
+
         public CompletionService() {}
 
         public void add_source(Object source_object, int priority) {
@@ -44,22 +275,242 @@ namespace Skk {
 
             sources.add(completion_source);
             sources.sort((a, b) => b.priority - a.priority);
+            invalidate();
+        }
+
+        /**
+         * Drop the cached results, so the next query asks the sources
+         * again.  Call this after the contents of a source changed.
+         *
+         * @since 1.2.0
+         */
+        public void invalidate() {
+            cached_prefix = null;
+            cached_items.clear();
         }
 
         public string[] get_completions(string midasi) {
-            var completions = new ArrayList<string>();
-            var completion_set = new HashSet<string>();
+            return get_top_completions(midasi, -1);
+        }
 
-            foreach (var source in sources) {
-                var source_completions = source.get_completions(midasi);
-                foreach (var completion in source_completions) {
-                    if (completion_set.add(completion)) {
-                        completions.add(completion);
+        /**
+         * Return the best completions of a prefix.
+         *
+         * Completions are ranked by source priority, then by usage
+         * recorded in {@link learning}, then in the order given by
+         * the source, or in collation order for dictionaries.
+         *
+         * @param midasi a prefix
+         * @param limit maximum number of completions, -1 for all
+         *
+         * @return completions
+         * @since 1.2.0
+         */
+        public string[] get_top_completions(string midasi, int limit = -1) {
+            if (!can_narrow(midasi)) {
+                query(midasi);
+            }
+            return filter_items(cached_items, midasi, midasi != cached_prefix, limit);
+        }
+
+        /**
+         * Whether any of the sources is remote.
+         *
+         * @since 1.2.0
+         */
+        public bool has_remote_sources {
+            get {
+                foreach (var source in sources) {
+                    if (source.is_remote) {
+                        return true;
                     }
                 }
+                return false;
+            }
+        }
+
+        /**
+         * Asynchronously return the best completions of a prefix.
+         *
+         * Local sources are queried before this method first yields,
+         * and //updated// is called with their results right away.
+         * Results of remote sources are merged in as they arrive, and
+         * //updated// is called again each time.  If the results of
+         * the previous query are narrowed down instead, //updated// is
+         * called once with them.
+         *
+         * @param midasi a prefix
+         * @param limit maximum number of completions, -1 for all
+         * @param cancellable a cancellable
+         * @param updated a callback receiving intermediate results
+         *
+         * @return completions
+         * @throws GLib.IOError.CANCELLED if cancelled
+         * @since 1.2.0
+         */
+        public async string[] get_completions_async(string midasi, int limit = -1, Cancellable? cancellable = null, CompletionsUpdatedFunc? updated = null) throws GLib.Error {
+            if (cancellable != null) {
+                cancellable.set_error_if_cancelled();
+            }
+            if (can_narrow(midasi)) {
+                var completions = filter_items(cached_items, midasi, midasi != cached_prefix, limit);
+                if (updated != null) {
+                    updated(completions);
+                }
+                return completions;
             }
 
+            var items = new HashMap<string,CompletionItem>();
+            var ranked = new ArrayList<CompletionItem>();
+            var pending = 0;
+            SourceFunc resume = get_completions_async.callback;
+
+            for (var i = 0; i < sources.size; i++) {
+                var source = sources[i];
+                var source_index = i;
+                if (!source.is_remote) {
+                    add_items(items, ranked, source,
+                              source.get_unsorted_completions(midasi),
+                              source_index);
+                    continue;
+                }
+                pending++;
+                source.get_completions_async.begin(midasi, cancellable, (obj, res) => {
+                        try {
+                            var completions = source.get_completions_async.end(res);
+                            add_items(items, ranked, source, completions, source_index);
+                            ranked.sort(compare_items);
+                            if (updated != null &&
+                                (cancellable == null || !cancellable.is_cancelled())) {
+                                updated(filter_items(ranked, midasi, false, limit));
+                            }
+                        } catch (IOError.CANCELLED e) {
+                        } catch (GLib.Error e) {
+                            warning("completion failed: %s", e.message);
+                        }
+                        if (--pending == 0) {
+                            resume();
+                        }
+                    });
+            }
+
+            ranked.sort(compare_items);
+            if (updated != null) {
+                updated(filter_items(ranked, midasi, false, limit));
+            }
+            if (pending > 0) {
+                yield;
+            }
+
+            if (cancellable != null) {
+                cancellable.set_error_if_cancelled();
+            }
+            cached_items = ranked;
+            cached_prefix = midasi;
+            return filter_items(ranked, midasi, false, limit);
+        }
+
+        static string[] filter_items(Gee.List<CompletionItem> items, string midasi, bool narrowing, int limit) {
+            var completions = new ArrayList<string>();
+            foreach (var item in items) {
+                if (limit >= 0 && completions.size >= limit) {
+                    break;
+                }
+                if (!narrowing ||
+                    (item.text.has_prefix(midasi) && item.text != midasi)) {
+                    completions.add(item.text);
+                }
+            }
             return completions.to_array();
         }
+
+        bool can_narrow(string midasi) {
+            if (cached_prefix == null || !midasi.has_prefix(cached_prefix)) {
+                return false;
+            }
+            if (midasi == cached_prefix) {
+                return true;
+            }
+            foreach (var source in sources) {
+                if (!source.narrowable) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void query(string midasi) {
+            var items = new HashMap<string,CompletionItem>();
+            var ranked = new ArrayList<CompletionItem>();
+            for (var i = 0; i < sources.size; i++) {
+                add_items(items, ranked, sources[i],
+                          sources[i].get_unsorted_completions(midasi), i);
+            }
+            ranked.sort(compare_items);
+            cached_items = ranked;
+            cached_prefix = midasi;
+        }
+
+        // Sources are sorted by priority, so the first one providing
+        // a word determines its rank.  Remote sources may answer out
+        // of order, hence the explicit priority comparison.
+        void add_items(Map<string,CompletionItem> items,
+                       Gee.List<CompletionItem> ranked,
+                       CompletionSource source,
+                       string[]? completions,
+                       int source_index) {
+            if (completions == null) {
+                return;
+            }
+            var collate = source is DictCompletionSource;
+            for (var j = 0; j < completions.length; j++) {
+                var completion = completions[j];
+                var item = items.get(completion);
+                if (item != null && item.source_index <= source_index) {
+                    continue;
+                }
+                if (item != null) {
+                    ranked.remove(item);
+                }
+                item = new CompletionItem(completion, source.priority,
+                                          source_index, j, collate);
+                if (learning != null) {
+                    item.usage = learning.get_usage(completion, false);
+                }
+                items.set(completion, item);
+                ranked.add(item);
+            }
+        }
+
+        int compare_items(CompletionItem a, CompletionItem b) {
+            if (a.priority != b.priority) {
+                return b.priority - a.priority;
+            }
+            if (learning != null) {
+                var result = learning.compare_usage(a.usage, b.usage);
+                if (result != 0) {
+                    return result;
+                }
+            }
+            if (a.source_index != b.source_index) {
+                return a.source_index - b.source_index;
+            }
+            if (a.collate_key != null) {
+                return strcmp(a.collate_key, b.collate_key);
+            }
+            return a.position - b.position;
+        }
+
+        internal MemoryUsage get_memory_usage() {
+            var usage = MemoryUsage();
+            usage.heap_bytes += MemoryUsageUtils.string_size(cached_prefix);
+            foreach (var item in cached_items) {
+                usage.heap_bytes += sizeof(CompletionItem);
+                usage.heap_bytes += MemoryUsageUtils.string_size(item.text);
+                usage.heap_bytes += MemoryUsageUtils.string_size(item.collate_key);
+                usage.entries++;
+            }
+            return usage;
+        }
     }
 }
@@ -28,6 +28,7 @@ namespace Skk {
         typeof (Util).class_ref ();
         typeof (Rule).class_ref ();
         typeof (EncodingConverter).class_ref ();
+        typeof (KeyEventUtils).class_ref ();
     }
 
     /**
@@ -84,9 +85,9 @@ namespace Skk {
                 return _dictionaries.to_array ();
             }
             set {
-                _dictionaries.clear ();
+                clear_dictionaries ();
                 foreach (var dict in value) {
-                    _dictionaries.add (dict);
+                    add_dictionary (dict);
                 }
             }
         }
@@ -99,6 +100,7 @@ namespace Skk {
          */
         public void add_dictionary (Dict dict) {
             _dictionaries.add (dict);
+            dict.reloaded.connect (dictionary_reloaded_cb);
         }
 
         /**
@@ -108,7 +110,145 @@ namespace Skk {
          * @since 0.0.8
          */
         public void remove_dictionary (Dict dict) {
-            _dictionaries.remove (dict);
+            if (_dictionaries.remove (dict)) {
+                dict.reloaded.disconnect (dictionary_reloaded_cb);
+            }
+        }
+
+        void clear_dictionaries () {
+            foreach (var dict in _dictionaries) {
+                dict.reloaded.disconnect (dictionary_reloaded_cb);
+            }
+            _dictionaries.clear ();
+        }
+
+        // Completions are cached by the states' CompletionService and
+        // would otherwise show the old contents until the prefix
+        // changes.
+        void dictionary_reloaded_cb () {
+            foreach (var state in state_stack) {
+                state.invalidate_completion ();
+            }
+        }
+
+        LearningStore? _learning = null;
+        /**
+         * Learning store used to rank candidates.
+         *
+         * When set, every selected candidate is recorded in the store
+         * and candidates selected before are shown first, ordered by
+         * the store's policy.  The store is saved along with the
+         * dictionaries, when a selection changes one of them or
+         * {@link save_dictionaries} is called.
+         *
+         * @since 1.2.0
+         */
+        public LearningStore? learning {
+            get {
+                return _learning;
+            }
+            set {
+                _learning = value;
+                foreach (var state in state_stack) {
+                    state.learning = _learning;
+                }
+            }
+        }
+
+        bool _parallel_lookup = false;
+        /**
+         * Whether to query dictionaries concurrently.
+         *
+         * If true, file, CDB and skkserv dictionaries are queried on
+         * worker threads, while the others are queried as usual.
+         * Candidates are still merged in the order of dictionaries.
+         *
+         * @since 1.2.0
+         */
+        public bool parallel_lookup {
+            get {
+                return _parallel_lookup;
+            }
+            set {
+                _parallel_lookup = value;
+                foreach (var state in state_stack) {
+                    state.parallel_lookup = _parallel_lookup;
+                }
+            }
+        }
+
+        uint _lookup_timeout = 0;
+        /**
+         * Time in milliseconds to wait for each dictionary when
+         * {@link parallel_lookup} is enabled, 0 to wait until all of
+         * them answer.  Candidates from dictionaries which miss the
+         * deadline are not shown.
+         *
+         * @since 1.2.0
+         */
+        public uint lookup_timeout {
+            get {
+                return _lookup_timeout;
+            }
+            set {
+                _lookup_timeout = value;
+                foreach (var state in state_stack) {
+                    state.lookup_timeout = _lookup_timeout;
+                }
+            }
+        }
+
+        bool _prefetch = false;
+        /**
+         * Whether to look up the reading in background while it is
+         * being typed.
+         *
+         * File, CDB and skkserv dictionaries are queried on worker
+         * threads each time the reading changes, so the candidates
+         * are ready when conversion starts.  A prefetch is dropped
+         * as soon as the reading changes again.
+         *
+         * @since 1.2.0
+         */
+        public bool prefetch {
+            get {
+                return _prefetch;
+            }
+            set {
+                _prefetch = value;
+                foreach (var state in state_stack) {
+                    state.prefetch_enabled = _prefetch;
+                    if (!_prefetch) {
+                        state.cancel_prefetch ();
+                    }
+                }
+            }
+        }
+
+        LookupStats lookup_stats = new LookupStats ();
+
+        /**
+         * Number of conversions which used the results of a
+         * prefetched lookup.
+         *
+         * @since 1.2.0
+         */
+        public uint prefetch_hits {
+            get {
+                return lookup_stats.prefetch_hits;
+            }
+        }
+
+        /**
+         * Number of conversions started while {@link prefetch} is
+         * enabled which did not use any prefetched lookup.
+         *
+         * @since 1.2.0
+         */
+        public uint prefetch_misses {
+            get {
+                return lookup_stats.prefetch_misses;
+            }
         }
 
         CandidateList _candidates;
@@ -122,8 +262,7 @@ namespace Skk {
         }
 
         LinkedList<State> state_stack = new LinkedList<State> ();
-        Gee.Map<Type, StateHandler> handlers =
-            new HashMap<Type, StateHandler> ();
+        StateHandler[] handlers = new StateHandler[StateHandlerType.LAST];
 
         /**
          * Current input mode.
@@ -217,17 +356,13 @@ namespace Skk {
             foreach (var dict in dictionaries) {
                 add_dictionary (dict);
             }
-            handlers.set (typeof (NoneStateHandler),
-                          new NoneStateHandler ());
-            handlers.set (typeof (StartStateHandler),
-                          new StartStateHandler ());
-            handlers.set (typeof (SelectStateHandler),
-                          new SelectStateHandler ());
-            handlers.set (typeof (AbbrevStateHandler),
-                          new AbbrevStateHandler ());
-            handlers.set (typeof (KutenStateHandler),
-                          new KutenStateHandler ());
+            handlers[StateHandlerType.NONE] = new NoneStateHandler ();
+            handlers[StateHandlerType.START] = new StartStateHandler ();
+            handlers[StateHandlerType.SELECT] = new SelectStateHandler ();
+            handlers[StateHandlerType.ABBREV] = new AbbrevStateHandler ();
+            handlers[StateHandlerType.KUTEN] = new KutenStateHandler ();
             var state = new State (_dictionaries);
+            state.lookup_stats = lookup_stats;
             _candidates = new ProxyCandidateList (state.candidates);
             push_state (state);
             _candidates.notify["cursor-pos"].connect (() => {
@@ -248,7 +383,7 @@ namespace Skk {
         }
 
         ~Context () {
-            _dictionaries.clear ();
+            clear_dictionaries ();
         }
 
         void notify_input_mode_cb (Object s, ParamSpec? p) {
@@ -280,6 +415,7 @@ namespace Skk {
                 delete_surrounding_text_cb);
             state.request_selection_text.connect (
                 request_selection_text_cb);
+            state.completions_updated.connect (completions_updated_cb);
         }
 
         void disconnect_state_signals (State state) {
@@ -293,8 +429,22 @@ namespace Skk {
                 delete_surrounding_text_cb);
             state.request_selection_text.disconnect (
                 request_selection_text_cb);
+            state.completions_updated.disconnect (completions_updated_cb);
+        }
+
+        void completions_updated_cb (string[] completions) {
+            completions_updated (completions);
         }
 
+        /**
+         * Signal emitted when completions are updated, e.g. when a
+         * remote completion source has answered.
+         *
+         * @param completions the completions merged so far
+         * @since 1.2.0
+         */
+        public signal void completions_updated (string[] completions);
+
         /**
          * Signal emitted when the context requires surrounding-text.
          *
@@ -334,14 +484,25 @@ namespace Skk {
                 state.selection.assign(text);
         }
 
+        // Return true if a dictionary has changed.  The learning
+        // store is only saved along with the dictionaries, so that
+        // committing the first candidate again writes nothing.
         bool select_candidate_in_dictionaries (Candidate candidate) {
             bool changed = false;
+            if (_learning != null) {
+                _learning.record (candidate);
+            }
             foreach (var dict in dictionaries) {
                 if (!dict.read_only &&
                     dict.select_candidate (candidate)) {
                     changed = true;
                 }
             }
+            if (changed) {
+                foreach (var state in state_stack) {
+                    state.invalidate_completion ();
+                }
+            }
             return changed;
         }
 
@@ -354,6 +515,7 @@ namespace Skk {
                 disconnect_state_signals (state_stack.peek_head ());
             }
             state_stack.offer_head (state);
+            invalidate_preedit ();
             connect_state_signals (state);
             var pcandidates = (ProxyCandidateList) _candidates;
             if (pcandidates.candidates != state.candidates) {
@@ -364,6 +526,7 @@ namespace Skk {
         void pop_state () {
             assert (!state_stack.is_empty);
             disconnect_state_signals (state_stack.poll_head ());
+            invalidate_preedit ();
             if (!state_stack.is_empty) {
                 var state = state_stack.peek_head ();
                 connect_state_signals (state);
@@ -376,6 +539,11 @@ namespace Skk {
 
         void start_dict_edit (string yomi) {
             var state = new State (_dictionaries);
+            state.learning = _learning;
+            state.parallel_lookup = _parallel_lookup;
+            state.lookup_timeout = _lookup_timeout;
+            state.prefetch_enabled = _prefetch;
+            state.lookup_stats = lookup_stats;
             state.typing_rule = typing_rule;
             state.yomi = yomi;
             push_state (state);
@@ -449,29 +617,44 @@ namespace Skk {
          * @return `true` if any of key events are handled, `false` otherwise
          */
         public bool process_key_events (string keyseq) {
-            Gee.List<string> keys = new ArrayList<string> ();
-            var builder = new StringBuilder ();
+            // Split keyseq into tokens first, so a syntax error
+            // rejects the whole sequence.  The delimiters are all
+            // ASCII, so scanning bytes is safe with UTF-8.
+            string[] keys = {};
+            StringBuilder? builder = null;
             bool complex = false;
-            bool escaped = false;
-            int index = 0;
-            unichar uc;
-            while (keyseq.get_next_char (ref index, out uc)) {
-                if (escaped) {
-                    builder.append_unichar (uc);
-                    escaped = false;
+            int start = -1;
+            int length = keyseq.length;
+            for (int index = 0; index < length; index++) {
+                char c = keyseq[index];
+                if (c == '\\') {
+                    // unescaping needs a copy of the token
+                    if (builder == null) {
+                        builder = new StringBuilder ();
+                    }
+                    if (start >= 0) {
+                        builder.append_len ((string) ((char *) keyseq + start),
+                                            index - start);
+                    }
+                    // a trailing backslash is ignored
+                    if (index + 1 == length) {
+                        start = -1;
+                        break;
+                    }
+                    builder.append_c (keyseq[++index]);
+                    start = index + 1;
                     continue;
                 }
-                switch (uc) {
-                case '\\':
-                    escaped = true;
-                    break;
+                switch (c) {
                 case '(':
                     if (complex) {
                         warning ("bare '(' is not allowed in complex keyseq");
                         return false;
                     }
                     complex = true;
-                    builder.append_unichar (uc);
+                    if (start < 0) {
+                        start = index;
+                    }
                     break;
                 case ')':
                     if (!complex) {
@@ -479,21 +662,18 @@ namespace Skk {
                         return false;
                     }
                     complex = false;
-                    builder.append_unichar (uc);
-                    keys.add (builder.str);
-                    builder.erase ();
+                    keys += take_token (keyseq, ref start, index + 1, builder);
                     break;
                 case ' ':
-                    if (complex) {
-                        builder.append_unichar (uc);
-                    }
-                    else if (builder.len > 0) {
-                        keys.add (builder.str);
-                        builder.erase ();
+                    if (!complex &&
+                        (start >= 0 || (builder != null && builder.len > 0))) {
+                        keys += take_token (keyseq, ref start, index, builder);
                     }
                     break;
                 default:
-                    builder.append_unichar (uc);
+                    if (start < 0) {
+                        start = index;
+                    }
                     break;
                 }
             }
@@ -501,12 +681,16 @@ namespace Skk {
                 warning ("premature end of key events");
                 return false;
             }
-            if (builder.len > 0) {
-                keys.add (builder.str);
+            if (start >= 0 || (builder != null && builder.len > 0)) {
+                keys += take_token (keyseq, ref start, length, builder);
             }
 
+            // SimpleKeyEventFilter leaves most events alone, so they
+            // need not be copied from the cache
+            bool shared = key_event_filter is SimpleKeyEventFilter;
             bool retval = false;
-            foreach (var key in keys) {
+            foreach (unowned string token in keys) {
+                unowned string key = token;
                 if (key == "SPC")
                     key = " ";
                 else if (key == "TAB")
@@ -518,7 +702,7 @@ namespace Skk {
 
                 KeyEvent ev;
                 try {
-                    ev = new KeyEvent.from_string (key);
+                    ev = KeyEvent.from_string_cached (key, shared);
                 } catch (KeyEventFormatError e) {
                     warning ("can't get key event from string %s: %s",
                              key, e.message);
@@ -530,6 +714,28 @@ namespace Skk {
             return retval;
         }
 
+        // Return the token ending at end, which starts at start or
+        // continues what is in builder.
+        static string take_token (string keyseq,
+                                  ref int start,
+                                  int end,
+                                  StringBuilder? builder)
+        {
+            string token;
+            if (builder != null && builder.len > 0) {
+                if (start >= 0 && end > start) {
+                    builder.append_len ((string) ((char *) keyseq + start),
+                                        end - start);
+                }
+                token = builder.str;
+                builder.erase ();
+            } else {
+                token = keyseq.substring (start, end - start);
+            }
+            start = -1;
+            return token;
+        }
+
         /**
          * Pass one key event to the context.
          *
@@ -547,19 +753,38 @@ namespace Skk {
                 return ((key.modifiers & ModifierType.RELEASE_MASK) == 0 &&
                         dict_edit_level () == 0);
             }
-            return process_key_event_internal (_key);
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
+            var handled = process_key_event_internal (_key);
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Context.process_key_event",
+                        "key=%s handled=%d", _key.to_string (), (int) handled);
+#endif
+            return handled;
         }
 
         bool process_key_event_internal (KeyEvent key) {
-            KeyEvent _key = key.copy ();
+            // handlers may replace the event but never modify it
+            KeyEvent _key = key;
             var state = state_stack.peek_head ();
+            // a pending completion request is stale once the user
+            // types something else
+            var completing = state.lookup_command (key) == KeymapCommand.COMPLETE;
+            if (!completing) {
+                state.cancel_completion ();
+            }
             while (true) {
                 var handler_type = state.handler_type;
-                var handler = handlers.get (handler_type);
+                var handler = handlers[handler_type];
                 var event_was_handled = handler.process_key_event (state, ref _key);
-                // FIXME should do this only when preedit is really changed
+                // cheap unless the state has changed
                 update_preedit ();
                 if (event_was_handled) {
+                    if (!completing) {
+                        state.update_completion_prefix ();
+                    }
+                    state.prefetch ();
                     return true;
                 }
                 // state.handler_type may change if handler cannot
@@ -595,6 +820,7 @@ namespace Skk {
             // clear output and preedit
             clear_output ();
             preedit = "";
+            invalidate_preedit ();
         }
 
         /**
@@ -610,10 +836,13 @@ namespace Skk {
         string retrieve_output (bool clear) {
             // get the output from the top level state
             var state = state_stack.last ();
-            var handler = handlers.get (state.handler_type);
+            var handler = handlers[state.handler_type];
             var output = handler.get_output (state);
             if (clear) {
                 state.output.erase ();
+                // the output of the top level state is part of the
+                // preedit during dict edit
+                preedit_prefix = null;
             }
             return output;
         }
@@ -653,13 +882,27 @@ namespace Skk {
         [CCode(notify = false)]
         public string preedit { get; private set; default = ""; }
 
-        void update_preedit () {
+        // Preedit of the states below the current one, rebuilt only
+        // when the state stack or their output changes.
+        string? preedit_prefix = null;
+        uint preedit_prefix_nchars = 0;
+
+        // What the current state's preedit was last built from.
+        PreeditStamp preedit_stamp;
+        bool preedit_stamp_valid = false;
+
+        void invalidate_preedit () {
+            preedit_prefix = null;
+            preedit_stamp_valid = false;
+        }
+
+        void build_preedit_prefix () {
             var builder = new StringBuilder ();
             var iter = state_stack.bidir_list_iterator ();
             iter.last ();
             while (iter.has_previous ()) {
                 var state = iter.get ();
-                var handler = handlers.get (state.handler_type);
+                var handler = handlers[state.handler_type];
                 // if state is not top level, need to prepend output to preedit
                 if (iter.has_next ())
                     builder.append (handler.get_output (state));
@@ -669,26 +912,51 @@ namespace Skk {
                 builder.append (state.yomi);
                 builder.append ("【");
             }
+            preedit_prefix = builder.str;
+            preedit_prefix_nchars = preedit_prefix.char_count ();
+        }
 
+        void update_preedit () {
             var state = state_stack.peek_head ();
-            var handler = handlers.get (state.handler_type);
-            if (dict_edit_level () > 0)
-                builder.append (handler.get_output (state));
-            uint start = (uint) builder.str.char_count ();
+            var stamp = state.get_preedit_stamp ();
+            if (preedit_stamp_valid && preedit_prefix != null &&
+                preedit_stamp.equal (stamp)) {
+                return;
+            }
+            preedit_stamp = stamp;
+            preedit_stamp_valid = true;
+
+            if (preedit_prefix == null) {
+                build_preedit_prefix ();
+            }
+
+            var builder = new StringBuilder (preedit_prefix);
+            uint start = preedit_prefix_nchars;
+            var handler = handlers[state.handler_type];
+            var level = dict_edit_level ();
+            if (level > 0) {
+                var output = handler.get_output (state);
+                builder.append (output);
+                start += output.char_count ();
+            }
             uint offset, nchars;
             builder.append (handler.get_preedit (state,
                                                  out offset,
                                                  out nchars));
             offset += start;
 
-            var level = dict_edit_level ();
             for (var i = 0; i < level; i++) {
                 builder.append ("】");
             }
 
             bool changed = false;
             if (preedit != builder.str) {
+                uint diff_offset, n_deleted;
+                string inserted;
+                diff_preedit (preedit, builder.str,
+                              out diff_offset, out n_deleted, out inserted);
                 preedit = builder.str;
+                preedit_updated (diff_offset, n_deleted, inserted);
                 changed = true;
             }
             if (preedit_underline_offset != offset ||
@@ -702,6 +970,57 @@ namespace Skk {
             }
         }
 
+        static void diff_preedit (string old_preedit,
+                                  string new_preedit,
+                                  out uint offset,
+                                  out uint n_deleted,
+                                  out string inserted)
+        {
+            int old_len = old_preedit.length;
+            int new_len = new_preedit.length;
+
+            // common prefix, backed up to a character boundary
+            int prefix = 0;
+            while (prefix < old_len && prefix < new_len &&
+                   old_preedit[prefix] == new_preedit[prefix]) {
+                prefix++;
+            }
+            while (prefix > 0 && prefix < new_len &&
+                   ((uchar) new_preedit[prefix] & 0xC0) == 0x80) {
+                prefix--;
+            }
+
+            // common suffix not overlapping the prefix
+            int suffix = 0;
+            while (suffix < old_len - prefix && suffix < new_len - prefix &&
+                   old_preedit[old_len - 1 - suffix] ==
+                   new_preedit[new_len - 1 - suffix]) {
+                suffix++;
+            }
+            while (suffix > 0 &&
+                   ((uchar) new_preedit[new_len - suffix] & 0xC0) == 0x80) {
+                suffix--;
+            }
+
+            offset = old_preedit[0:prefix].char_count ();
+            n_deleted = old_preedit[prefix:old_len - suffix].char_count ();
+            inserted = new_preedit[prefix:new_len - suffix];
+        }
+
+        /**
+         * Signal emitted when the preedit string changes, describing
+         * the change as a single replacement.  Front ends may use it
+         * instead of redrawing the whole preedit.
+         *
+         * @param offset character offset where the change starts
+         * @param n_deleted number of characters removed at offset
+         * @param inserted text inserted at offset
+         * @since 1.2.0
+         */
+        public signal void preedit_updated (uint offset,
+                                            uint n_deleted,
+                                            string inserted);
+
         uint preedit_underline_offset = 0;
         uint preedit_underline_nchars = 0;
 
@@ -726,6 +1045,103 @@ namespace Skk {
                     dict.save ();
                 }
             }
+            if (_learning != null) {
+                _learning.save ();
+            }
+        }
+
+        /**
+         * Return the approximate memory used by the context.
+         *
+         * Dictionaries are included, so a dictionary shared by
+         * several contexts is counted in each of them.
+         *
+         * @return a MemoryUsage
+         * @since 1.2.0
+         */
+        public MemoryUsage get_memory_usage () {
+            var usage = MemoryUsage ();
+            foreach (var component in collect_memory_usage ().get_values ()) {
+                usage.add (component);
+            }
+            return usage;
+        }
+
+        /**
+         * Return a report of {@link get_memory_usage}, one line per
+         * component.
+         *
+         * @return a string
+         * @since 1.2.0
+         */
+        public string get_memory_usage_report () {
+            var components = collect_memory_usage ();
+            var builder = new StringBuilder ();
+            var total = MemoryUsage ();
+            foreach (var name in components.get_keys ()) {
+                var usage = components.get (name);
+                append_memory_usage (builder, name, usage);
+                total.add (usage);
+            }
+            append_memory_usage (builder, "total", total);
+            return builder.str;
+        }
+
+        static void append_memory_usage (StringBuilder builder,
+                                         string name,
+                                         MemoryUsage usage)
+        {
+            builder.append_printf ("%-24s heap=%" + size_t.FORMAT +
+                                   " mapped=%" + size_t.FORMAT +
+                                   " entries=%u\n",
+                                   name,
+                                   usage.heap_bytes,
+                                   usage.mapped_bytes,
+                                   usage.entries);
+        }
+
+        Gee.Map<string,MemoryUsage?> collect_memory_usage () {
+            var components = new Gee.TreeMap<string,MemoryUsage?> ();
+
+            var rules = new HashSet<Rule> ();
+            var candidates = MemoryUsage ();
+            var completion = MemoryUsage ();
+            foreach (var state in state_stack) {
+                rules.add (state.typing_rule);
+                for (var i = 0; i < state.candidates.size; i++) {
+                    candidates.heap_bytes +=
+                        state.candidates.get (i).get_heap_size ();
+                    candidates.entries++;
+                }
+                if (state.normal_completion_service != null) {
+                    completion.add (
+                        state.normal_completion_service.get_memory_usage ());
+                }
+                if (state.abbrev_completion_service != null) {
+                    completion.add (
+                        state.abbrev_completion_service.get_memory_usage ());
+                }
+            }
+            components.set ("candidates", candidates);
+            components.set ("completion", completion);
+
+            for (var i = 0; i < _dictionaries.size; i++) {
+                var dict = _dictionaries.get (i);
+                components.set ("dict[%d] %s".printf (i,
+                                                      dict.get_type ().name ()),
+                                dict.get_memory_usage ());
+            }
+
+            foreach (var rule in rules) {
+                components.set ("rule %s".printf (rule.metadata.name),
+                                rule.get_memory_usage ());
+            }
+
+            if (_learning != null) {
+                components.set ("learning", _learning.get_memory_usage ());
+            }
+
+            return components;
         }
 
         /**
@@ -30,22 +30,56 @@ namespace Skk {
                                                 bool okuri,
                                                 string line)
         {
-            var strv = line.strip ().slice (1, -1).split ("/");
-            Candidate[] candidates = new Candidate[strv.length];
-            for (int i = 0; i < strv.length; i++) {
-                var text_annotation = strv[i].split (";", 2);
-                string text, annotation;
-                if (text_annotation.length == 2) {
-                    text = text_annotation[0];
-                    annotation = text_annotation[1];
+            // Scan "/text;annotation/.../" in place; only text and
+            // annotation of each candidate are copied.
+            int start = 0;
+            int end = line.length;
+            while (start < end && line[start].isspace ())
+                start++;
+            while (end > start && line[end - 1].isspace ())
+                end--;
+            // skip the leading and trailing "/"
+            start++;
+            end--;
+            if (end <= start) {
+                return new Candidate[0];
+            }
+
+            int count = 1;
+            for (int i = start; i < end; i++) {
+                if (line[i] == '/')
+                    count++;
+            }
+
+            Candidate[] candidates = new Candidate[count];
+            var shared_midasi = new SharedString (midasi);
+            int index = 0;
+            int field_start = start;
+            int semicolon = -1;
+            for (int i = start; i <= end; i++) {
+                if (i < end && line[i] != '/') {
+                    if (line[i] == ';' && semicolon < 0)
+                        semicolon = i;
+                    continue;
+                }
+                string text;
+                string? annotation;
+                if (semicolon >= 0) {
+                    text = line.substring (field_start,
+                                           semicolon - field_start);
+                    annotation = line.substring (semicolon + 1,
+                                                 i - semicolon - 1);
                 } else {
-                    text = strv[i];
+                    text = line.substring (field_start, i - field_start);
                     annotation = null;
                 }
-                candidates[i] = new Candidate (midasi,
-                                               okuri,
-                                               text,
-                                               annotation);
+                var candidate = new Candidate.with_shared_midasi (
+                    shared_midasi, okuri, text, annotation);
+                // hash here, as this may run on a lookup worker
+                candidate.get_output_hash ();
+                candidates[index++] = candidate;
+                field_start = i + 1;
+                semicolon = -1;
             }
             return candidates;
         }
@@ -130,6 +164,132 @@ namespace Skk {
         public virtual void save () throws GLib.Error {
             // FIXME: throw an error when the dictionary is read only
         }
+
+        FileChangeMonitor? file_monitor = null;
+
+        /**
+         * Whether to reload the dictionary automatically when its
+         * backing file is modified by another process.
+         *
+         * Change notifications are coalesced, so a burst of writes
+         * causes a single reload.  This has no effect on dictionaries
+         * not backed by a local file.
+         *
+         * @since 1.2.0
+         */
+        public bool auto_reload {
+            get {
+                return file_monitor != null;
+            }
+            set {
+                if (value == (file_monitor != null)) {
+                    return;
+                }
+                if (!value) {
+                    file_monitor.changed.disconnect (file_changed_cb);
+                    file_monitor = null;
+                    return;
+                }
+                var file = get_backing_file ();
+                if (file == null) {
+                    return;
+                }
+                try {
+                    file_monitor = new FileChangeMonitor (file);
+                    file_monitor.changed.connect (file_changed_cb);
+                } catch (GLib.Error e) {
+                    warning ("can't monitor %s: %s",
+                             file.get_path (), e.message);
+                }
+            }
+        }
+
+        /**
+         * Signal emitted after the dictionary is reloaded because its
+         * backing file was modified.
+         *
+         * @see auto_reload
+         * @since 1.2.0
+         */
+        public signal void reloaded ();
+
+        void file_changed_cb () {
+            try {
+                reload ();
+            } catch (GLib.Error e) {
+                warning ("error reloading dictionary: %s", e.message);
+                return;
+            }
+            reloaded ();
+        }
+
+        /**
+         * Return the file backing the dictionary, if any.
+         */
+        internal virtual File? get_backing_file () {
+            return null;
+        }
+
+        /**
+         * Return the approximate memory used by the dictionary.
+         *
+         * @return a MemoryUsage
+         * @since 1.2.0
+         */
+        public virtual MemoryUsage get_memory_usage () {
+            return MemoryUsage () {
+                heap_bytes = MemoryUsageUtils.instance_size (get_type ())
+            };
+        }
+
+        /**
+         * Find the entries which have a candidate.
+         *
+         * This is the reverse of {@link lookup}, e.g. to reconvert
+         * committed text.  The default implementation returns an
+         * empty array.
+         *
+         * @param text the text of a candidate
+         *
+         * @return an array of Candidate whose text is text, from
+         * both okuri-ari and okuri-nasi entries
+         * @since 1.2.0
+         */
+        public virtual Candidate[] reverse_lookup (string text) {
+            return new Candidate[0];
+        }
+
+        /**
+         * Return the midasi which start with a prefix.
+         *
+         * Unlike {@link complete}, this can search okuri-ari entries,
+         * and stops once limit midasi are found.  The default
+         * implementation filters the result of {@link complete} and
+         * returns nothing for okuri-ari entries.
+         *
+         * @param midasi a prefix
+         * @param okuri whether to search okuri-ari entries or
+         * okuri-nasi entries
+         * @param limit maximum number of midasi to return, or -1 for
+         * no limit
+         *
+         * @return an array of midasi in the order of the dictionary,
+         * not including midasi itself
+         * @since 1.2.0
+         */
+        public virtual string[] complete_prefix (string midasi,
+                                                 bool okuri = false,
+                                                 int limit = -1)
+        {
+            if (okuri || limit == 0) {
+                return new string[0];
+            }
+            var completion = complete (midasi);
+            if (limit > 0 && completion.length > limit) {
+                return completion[0:limit];
+            }
+            return completion;
+        }
     }
 
     /**
@@ -16,6 +16,26 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 namespace Skk {
+    /**
+     * Return the encoding declared by the coding cookie in a line,
+     * such as "-*- coding: euc-jp -*-" at the top of a dictionary.
+     *
+     * @param line a line of a dictionary, usually the first one
+     *
+     * @return an encoding name suitable for CharsetConverter, or
+     * `null` if line has no coding cookie or the coding system is
+     * not supported
+     * @since 1.2.0
+     */
+    public static string? get_encoding_from_coding_cookie (string line) {
+        typeof (EncodingConverter).class_ref ();
+        var coding = EncodingConverter.extract_coding_system (line);
+        if (coding == null) {
+            return null;
+        }
+        return EncodingConverter.get_encoding (coding);
+    }
+
     // XXX: we use Vala string to represent byte array, assuming that
     // it does not contain null element
     class EncodingConverter : Object {
@@ -51,6 +71,15 @@ namespace Skk {
             return null;
         }
 
+        internal static string? get_encoding (string coding) {
+            foreach (var entry in ENCODING_TO_CODING_SYSTEM_RULE) {
+                if (entry.value == coding) {
+                    return entry.key;
+                }
+            }
+            return null;
+        }
+
         internal string? get_coding_system () {
             foreach (var entry in ENCODING_TO_CODING_SYSTEM_RULE) {
                 if (entry.key == encoding) {
@@ -72,13 +101,11 @@ namespace Skk {
         }
 
         internal EncodingConverter.from_coding_system (string coding) throws GLib.Error {
-            foreach (var entry in ENCODING_TO_CODING_SYSTEM_RULE) {
-                if (entry.value == coding) {
-                    this (entry.key);
-                    return;
-                }
+            var encoding = get_encoding (coding);
+            if (encoding == null) {
+                assert_not_reached ();
             }
-            assert_not_reached ();
+            this (encoding);
         }
 
         string convert (CharsetConverter converter, string str) throws GLib.Error {
@@ -105,12 +132,18 @@ namespace Skk {
             return builder.str;
         }
 
+        // CharsetConverter keeps state, so serialize lookups running
+        // on worker threads (see State).
         internal string encode (string internal_str) throws GLib.Error {
-            return convert (encoder, internal_str);
+            lock (encoder) {
+                return convert (encoder, internal_str);
+            }
         }
 
         internal string decode (string external_str) throws GLib.Error {
-            return convert (decoder, external_str);
+            lock (decoder) {
+                return convert (decoder, external_str);
+            }
         }
     }
 }
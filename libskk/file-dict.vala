@@ -18,15 +18,30 @@
 using Gee;
 
 namespace Skk {
-    /**
-     * Read-only file based implementation of Dict.
-     */
-    public class FileDict : Dict {
+    // Immutable view of a loaded dictionary file.  Reloading builds a
+    // new image off to the side and publishes it in one step, so a
+    // lookup running concurrently keeps reading the old mapping
+    // until it finishes.
+    class FileDictImage : Object {
+        internal MappedMemory mem;
+        internal EncodingConverter converter;
+        internal long okuri_ari_offset;
+        internal long okuri_nasi_offset;
+        internal string etag = "";
+        ReverseIndex? reverse_index = null;
+
+        internal FileDictImage (MappedMemory mem,
+                                EncodingConverter converter)
+        {
+            this.mem = mem;
+            this.converter = converter;
+        }
+
         // Read a line near offset and move offset to the beginning of
         // the line.
-        string read_line (ref long offset) {
-            return_val_if_fail (offset < mmap.length, null);
-            char *p = ((char *)mmap.memory + offset);
+        internal string read_line (ref long offset) {
+            return_val_if_fail (offset < mem.length, null);
+            char *p = ((char *)mem.memory + offset);
             for (; offset > 0; offset--, p--) {
                 if (*p == '\n')
                     break;
@@ -39,7 +54,7 @@ namespace Skk {
 
             var builder = new StringBuilder ();
             long _offset = offset;
-            for (; _offset < mmap.length; _offset++, p++) {
+            for (; _offset < mem.length; _offset++, p++) {
                 if (*p == '\n')
                     break;
                 builder.append_c (*p);
@@ -47,73 +62,81 @@ namespace Skk {
             return builder.str;
         }
 
-        // can only called after read*_line
-        string? read_previous_line (ref long pos, string line) {
-            if (pos < 2) {
-                return null;
+        // Skip until the first occurrence of line.  This moves offset
+        // at the end of the line.
+        bool read_until (ref long offset, string line) {
+            return_val_if_fail (offset < mem.length, false);
+            var found = mem.find (offset, "\n" + line);
+            if (found < 0) {
+                return false;
             }
-            // place the cursor at the end of the previous line
-            pos -= 2;
-            return read_line (ref pos);
+            offset = found + line.length;
+            return true;
         }
 
-        // can only called after read*_line
-        string? read_next_line (ref long pos, string line) {
-            if (pos + line.length + 1 >= mmap.length) {
-                return null;
+        // Count the entry lines.  okuri_ari_offset points at the
+        // newline ending the okuri-ari boundary, so that newline and
+        // the one ending the okuri-nasi boundary are not entries.
+        internal uint count_entries () {
+            uint count = 0;
+            long offset = okuri_ari_offset;
+            while ((offset = mem.find (offset, "\n")) >= 0) {
+                count++;
+                offset++;
             }
-            // place the cursor at "\n" of the current line
-            pos += line.length + 1;
-            return read_line (ref pos);
+            return count > 2 ? count - 2 : 0;
         }
 
-        // Skip until the first occurrence of line.  This moves offset
-        // at the beginning of the next line.
-        bool read_until (ref long offset, string line) {
-            return_val_if_fail (offset < mmap.length, false);
-            while (offset + line.length < mmap.length) {
-                char *p = ((char *)mmap.memory + offset);
-                if (*p == '\n' &&
-                    Memory.cmp (p + 1, (void *)line, line.length) == 0) {
-                    offset += line.length;
-                    return true;
+        // Collect the candidates of all entries for ReverseIndex.
+        uint32[] scan_candidates () {
+            uint32[] pairs = {};
+            uint8 *p = (uint8 *) mem.memory;
+            long offset = okuri_ari_offset + 1;
+            while (offset < (long) mem.length) {
+                var end = mem.find (offset, "\n");
+                if (end < 0) {
+                    end = (long) mem.length;
                 }
-                offset++;
+                if (p[offset] != ';') {
+                    for (var i = offset; i < end; i++) {
+                        if (p[i] == ' ') {
+                            ReverseIndex.add_candidates (ref pairs, p,
+                                                         i + 1, end,
+                                                         (uint32) offset);
+                            break;
+                        }
+                    }
+                }
+                offset = end + 1;
             }
-            return false;
+            return pairs;
         }
 
-        void load () throws SkkDictError {
-            mmap.remap ();
-
-            long offset = 0;
-            var line = read_line (ref offset);
-            if (line == null) {
-                throw new SkkDictError.MALFORMED_INPUT (
-                    "can't read the first line");
-            }
-
-            var coding = EncodingConverter.extract_coding_system (line);
-            if (coding != null) {
-                try {
-                    var _converter = new EncodingConverter.from_coding_system (
-                        coding);
-                    if (_converter != null) {
-                        converter = _converter;
+        // Build the reverse index on first use.
+        internal ReverseIndex get_reverse_index (string path) {
+            lock (reverse_index) {
+                if (reverse_index == null) {
+                    var version = "%s\n%s".printf (etag,
+                                                  mem.length.to_string ());
+                    reverse_index = ReverseIndex.load (path, version);
+                    if (reverse_index == null) {
+                        reverse_index = ReverseIndex.build (
+                            path, version, (uint8 *) mem.memory, mem.length,
+                            scan_candidates ());
                     }
-                } catch (Error e) {
-                    warning ("can't create converter from coding system %s: %s",
-                             coding, e.message);
                 }
+                return reverse_index;
             }
+        }
 
-            offset = 0;
+        internal void scan_boundaries () throws SkkDictError {
+            long offset = 0;
             if (!read_until (ref offset, ";; okuri-ari entries.\n")) {
                 throw new SkkDictError.MALFORMED_INPUT (
                     "no okuri-ari boundary");
             }
             okuri_ari_offset = offset;
-            
+
             if (!read_until (ref offset, ";; okuri-nasi entries.\n")) {
                 throw new SkkDictError.MALFORMED_INPUT (
                     "no okuri-nasi boundary");
@@ -121,38 +144,60 @@ namespace Skk {
             okuri_nasi_offset = offset;
         }
 
-        /**
-         * {@inheritDoc}
-         */
-        public override void reload () throws GLib.Error {
-#if VALA_0_16
-            string attributes = FileAttribute.ETAG_VALUE;
-#else
-            string attributes = FILE_ATTRIBUTE_ETAG_VALUE;
-#endif
-            FileInfo info = file.query_info (attributes,
-                                             FileQueryInfoFlags.NONE);
-            if (info.get_etag () != etag) {
-                try {
-                    load ();
-                    etag = info.get_etag ();
-                } catch (SkkDictError e) {
-                    warning ("error loading file dictionary %s %s",
-                             file.get_path (), e.message);
+        // Offsets of the first entry in a section and of the end of
+        // its last entry.
+        internal void get_section (bool okuri,
+                                   out long start_offset,
+                                   out long end_offset)
+        {
+            if (okuri) {
+                start_offset = okuri_ari_offset + 1;
+                end_offset = okuri_nasi_offset + 1 -
+                    ";; okuri-nasi entries.\n".length;
+            } else {
+                start_offset = okuri_nasi_offset + 1;
+                end_offset = (long) mem.length;
+            }
+        }
+
+        // Find the first line between start_offset, which must be at
+        // the beginning of a line, and end_offset for which cmp
+        // (midasi of the line, midasi) * direction >= 0.
+        internal long search_first (string midasi,
+                                    long start_offset,
+                                    long end_offset,
+                                    CompareFunc<string> cmp,
+                                    int direction)
+        {
+            while (start_offset < end_offset) {
+                long offset = start_offset +
+                    (end_offset - start_offset) / 2;
+                // read_line () would move to the next line
+                if (((char *) mem.memory)[offset] == '\n') {
+                    offset--;
+                }
+                string line = read_line (ref offset);
+                int index = line.index_of (" ");
+                string key = index < 0 ? line : line[0:index];
+                if (cmp (key, midasi) * direction < 0) {
+                    start_offset = offset + line.length + 1;
+                } else {
+                    end_offset = offset;
                 }
             }
+            return start_offset;
         }
 
-        bool search_pos (string midasi,
-                         long start_offset,
-                         long end_offset,
-                         CompareFunc<string> cmp,
-                         out long pos,
-                         out string? line,
-                         int direction) {
+        internal bool search_pos (string midasi,
+                                  long start_offset,
+                                  long end_offset,
+                                  CompareFunc<string> cmp,
+                                  out long pos,
+                                  out string? line,
+                                  int direction) {
             long offset = start_offset + (end_offset - start_offset) / 2;
             while (start_offset <= end_offset) {
-                assert (offset < mmap.length);
+                assert (offset < mem.length);
 
                 string _line = read_line (ref offset);
                 int index = _line.index_of (" ");
@@ -179,25 +224,109 @@ namespace Skk {
             line = null;
             return false;
         }
+    }
+
+    /**
+     * Read-only file based implementation of Dict.
+     */
+    public class FileDict : Dict {
+        FileDictImage load (EncodingConverter converter) throws SkkDictError {
+            var mem = mmap.remap ();
+            var image = new FileDictImage (mem, converter);
+
+            long offset = 0;
+            var line = image.read_line (ref offset);
+            if (line == null) {
+                throw new SkkDictError.MALFORMED_INPUT (
+                    "can't read the first line");
+            }
+
+            var coding = EncodingConverter.extract_coding_system (line);
+            if (coding != null) {
+                try {
+                    var _converter = new EncodingConverter.from_coding_system (
+                        coding);
+                    if (_converter != null) {
+                        image.converter = _converter;
+                    }
+                } catch (Error e) {
+                    warning ("can't create converter from coding system %s: %s",
+                             coding, e.message);
+                }
+            }
+
+            image.scan_boundaries ();
+            return image;
+        }
+
+        FileDictImage? acquire_image () {
+            FileDictImage? image;
+            lock (current_image) {
+                image = current_image;
+            }
+            return image;
+        }
+
+        /**
+         * {@inheritDoc}
+         *
+         * This is safe to call while lookups are running: the new
+         * contents are mapped and scanned before they are published,
+         * and the old mapping is released after the last lookup using
+         * it returns.
+         */
+        public override void reload () throws GLib.Error {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
+#if VALA_0_16
+            string attributes = FileAttribute.ETAG_VALUE;
+#else
+            string attributes = FILE_ATTRIBUTE_ETAG_VALUE;
+#endif
+            FileInfo info = file.query_info (attributes,
+                                             FileQueryInfoFlags.NONE);
+            if (info.get_etag () != etag) {
+                // Each image owns its converter, since CharsetConverter
+                // keeps conversion state and must not be shared
+                // between a lookup and a concurrent reload.
+                var converter = new EncodingConverter (encoding);
+                try {
+                    var image = load (converter);
+                    image.etag = info.get_etag ();
+                    lock (current_image) {
+                        current_image = image;
+                    }
+                    etag = info.get_etag ();
+                } catch (SkkDictError e) {
+                    warning ("error loading file dictionary %s %s",
+                             file.get_path (), e.message);
+                }
+            }
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Dict.reload", "%s", get_type ().name ());
+#endif
+        }
 
         /**
          * {@inheritDoc}
          */
         public override Candidate[] lookup (string midasi, bool okuri = false) {
-            if (mmap.memory == null)
+            var image = acquire_image ();
+            if (image == null)
                 return new Candidate[0];
 
             long start_offset, end_offset;
             if (okuri) {
-                start_offset = okuri_ari_offset;
-                end_offset = okuri_nasi_offset;
+                start_offset = image.okuri_ari_offset;
+                end_offset = image.okuri_nasi_offset;
             } else {
-                start_offset = okuri_nasi_offset;
-                end_offset = (long) mmap.length - 1;
+                start_offset = image.okuri_nasi_offset;
+                end_offset = (long) image.mem.length - 1;
             }
             string _midasi;
             try {
-                _midasi = converter.encode (midasi);
+                _midasi = image.converter.encode (midasi);
             } catch (GLib.Error e) {
                 warning ("can't encode %s: %s", midasi, e.message);
                 return new Candidate[0];
@@ -205,18 +334,19 @@ namespace Skk {
 
             long pos;
             string line;
-            if (search_pos (_midasi,
-                            start_offset,
-                            end_offset,
-                            strcmp,
-                            out pos,
-                            out line,
-                            okuri ? -1 : 1)) {
+            if (image.search_pos (_midasi,
+                                  start_offset,
+                                  end_offset,
+                                  strcmp,
+                                  out pos,
+                                  out line,
+                                  okuri ? -1 : 1)) {
                 int index = line.index_of (" ");
                 string _line;
                 if (index > 0) {
                     try {
-                        _line = converter.decode (line[index:line.length]);
+                        _line = image.converter.decode (
+                            line[index:line.length]);
                     } catch (GLib.Error e) {
                         warning ("can't decode line %s: %s",
                                  line, e.message);
@@ -238,84 +368,131 @@ namespace Skk {
          * {@inheritDoc}
          */
         public override string[] complete (string midasi) {
-            if (mmap.memory == null)
-                return new string[0];
+            return complete_prefix (midasi);
+        }
 
+        /**
+         * {@inheritDoc}
+         */
+        public override string[] complete_prefix (string midasi,
+                                                  bool okuri = false,
+                                                  int limit = -1)
+        {
             var completion = new ArrayList<string> ();
-
-            long start_offset, end_offset;
-            start_offset = okuri_nasi_offset;
-            end_offset = (long) mmap.length - 1;
+            var image = acquire_image ();
+            if (image == null || limit == 0)
+                return completion.to_array ();
 
             string _midasi;
             try {
-                _midasi = converter.encode (midasi);
+                _midasi = image.converter.encode (midasi);
             } catch (GLib.Error e) {
-                warning ("can't decode %s: %s", midasi, e.message);
+                warning ("can't encode %s: %s", midasi, e.message);
                 return completion.to_array ();
             }
 
-            long pos;
-            string line;
-            if (search_pos (_midasi,
-                            start_offset,
-                            end_offset,
-                            strcmp_prefix,
-                            out pos,
-                            out line,
-                            1)) {
-                long _pos = pos;
-                string _line = line;
-
-                // search backward
-                do {
-                    int index = line.index_of (" ");
-                    if (index < 0) {
-                        warning ("corrupted dictionary entry: %s",
-                                 line);
-                    } else {
-                        var completed = line[0:index];
-                        // don't add midasi word itself
-                        if (completed != _midasi) {
-                            try {
-                                string decoded = converter.decode (completed);
-                                completion.insert (0, decoded);
-                            } catch (GLib.Error e) {
-                                warning ("can't decode line %s: %s",
-                                         line, e.message);
-                            }
-                        }
-                    }
-                } while ((line = read_previous_line (ref pos, line)) != null &&
-                         line.has_prefix (_midasi));
-
-                // search forward
-                pos = _pos;
-                line = _line;
-                while ((line = read_next_line (ref pos, line)) != null &&
-                       line.has_prefix (_midasi)) {
-                    int index = line.index_of (" ");
-                    if (index < 0) {
-                        warning ("corrupted dictionary entry: %s",
-                                 line);
-                    } else {
-                        var completed = line[0:index];
-                        // don't add midasi word itself
-                        if (completed != _midasi) {
-                            try {
-                                string decoded = converter.decode (completed);
-                                completion.add (decoded);
-                            } catch (GLib.Error e) {
-                                warning ("can't decode line %s: %s",
-                                         line, e.message);
-                            }
+            // completions are consecutive in either section, starting
+            // at the first entry not ordered before midasi
+            long start_offset, end_offset;
+            image.get_section (okuri, out start_offset, out end_offset);
+            long pos = image.search_first (_midasi,
+                                           start_offset,
+                                           end_offset,
+                                           strcmp_prefix,
+                                           okuri ? -1 : 1);
+            while (pos < end_offset &&
+                   (limit < 0 || completion.size < limit)) {
+                var line = image.read_line (ref pos);
+                if (!line.has_prefix (_midasi)) {
+                    break;
+                }
+                int index = line.index_of (" ");
+                if (index < 0) {
+                    warning ("corrupted dictionary entry: %s", line);
+                } else {
+                    var completed = line[0:index];
+                    // don't add midasi word itself
+                    if (completed != _midasi) {
+                        try {
+                            completion.add (
+                                image.converter.decode (completed));
+                        } catch (GLib.Error e) {
+                            warning ("can't decode line %s: %s",
+                                     line, e.message);
                         }
                     }
                 }
+                pos += line.length + 1;
             }
             return completion.to_array ();
         }
 
+        /**
+         * {@inheritDoc}
+         *
+         * The first call builds an index of the candidates, which is
+         * cached in the user cache directory.
+         */
+        public override Candidate[] reverse_lookup (string text) {
+            Candidate[] result = {};
+            var image = acquire_image ();
+            if (image == null)
+                return result;
+
+            string _text;
+            try {
+                _text = image.converter.encode (text);
+            } catch (GLib.Error e) {
+                warning ("can't encode %s: %s", text, e.message);
+                return result;
+            }
+
+            var index = image.get_reverse_index (file.get_path ());
+            foreach (var offset in index.lookup ((uint8 *) image.mem.memory,
+                                                 image.mem.length,
+                                                 _text)) {
+                long pos = offset;
+                string line;
+                try {
+                    line = image.converter.decode (image.read_line (ref pos));
+                } catch (GLib.Error e) {
+                    warning ("can't decode line at %ld: %s", pos, e.message);
+                    continue;
+                }
+                int index_of_space = line.index_of (" ");
+                if (index_of_space < 1) {
+                    continue;
+                }
+                ReverseIndex.filter_candidates (
+                    ref result,
+                    split_candidates (line[0:index_of_space],
+                                      pos < image.okuri_nasi_offset,
+                                      line[index_of_space:line.length]),
+                    text);
+            }
+            return result;
+        }
+
+        internal override File? get_backing_file () {
+            return file;
+        }
+
+        /**
+         * {@inheritDoc}
+         *
+         * Entries are counted by scanning the file, which takes time
+         * proportional to its size.
+         */
+        public override MemoryUsage get_memory_usage () {
+            var usage = base.get_memory_usage ();
+            var image = acquire_image ();
+            if (image != null) {
+                usage.mapped_bytes = image.mem.length;
+                usage.entries = image.count_entries ();
+            }
+            return usage;
+        }
+
         /**
          * {@inheritDoc}
          */
@@ -328,9 +505,8 @@ namespace Skk {
         File file;
         MemoryMappedFile mmap;
         string etag;
-        EncodingConverter converter;
-        long okuri_ari_offset;
-        long okuri_nasi_offset;
+        string encoding;
+        FileDictImage? current_image = null;
 
         /**
          * Create a new FileDict.
@@ -347,7 +523,7 @@ namespace Skk {
             this.file = File.new_for_path (path);
             this.mmap = new MemoryMappedFile (file);
             this.etag = "";
-            this.converter = new EncodingConverter (encoding);
+            this.encoding = encoding;
             reload ();
         }
     }
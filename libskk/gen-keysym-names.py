@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+# Copyright (C) 2011-2026 Red Hat, Inc.
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Generate the keysym name tables used by KeyEventUtils from
+# keysyms.vala.
+
+import re
+import sys
+
+CONST_RE = re.compile(r'^\s*public const uint @?(\w+) = (0x[0-9a-fA-F]+);')
+
+HEADER = '''\
+// Generated by gen-keysym-names.py from keysyms.vala.  Do not edit.
+
+namespace Skk {
+    [CCode (has_type_id = false)]
+    struct KeysymName {
+        string name;
+        uint keysym;
+    }
+
+'''
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write('Usage: %s KEYSYMS-VALA OUTPUT\n' % sys.argv[0])
+        sys.exit(1)
+
+    entries = []
+    with open(sys.argv[1], encoding='utf-8') as f:
+        for line in f:
+            match = CONST_RE.match(line)
+            if match:
+                entries.append((match.group(1), int(match.group(2), 16)))
+
+    # VoidSymbol is the "not found" value, not a real key.
+    entries = [entry for entry in entries if entry[0] != 'VoidSymbol']
+
+    # Names are compared with strcmp, i.e. by bytes.
+    by_name = sorted(entries, key=lambda entry: entry[0].encode('ascii'))
+
+    # Keep the first name defined for each keysym, as keysymdef.h
+    # lists the preferred name first.
+    by_keysym = {}
+    for name, keysym in entries:
+        by_keysym.setdefault(keysym, name)
+
+    with open(sys.argv[2], 'w', encoding='utf-8') as f:
+        f.write(HEADER)
+        f.write('    // Sorted by name.\n')
+        f.write('    const KeysymName[] KEYSYM_NAMES_BY_NAME = {\n')
+        for name, keysym in by_name:
+            f.write('        { "%s", 0x%x },\n' % (name, keysym))
+        f.write('    };\n\n')
+        f.write('    // Sorted by keysym, one name per keysym.\n')
+        f.write('    const KeysymName[] KEYSYM_NAMES_BY_KEYSYM = {\n')
+        for keysym in sorted(by_keysym):
+            f.write('        { "%s", 0x%x },\n' % (by_keysym[keysym], keysym))
+        f.write('    };\n')
+        f.write('}\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+# Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+# Copyright (C) 2011-2026 Red Hat, Inc.
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Compile the rom-kana maps of the bundled rules into tables, resolved
+# the same way as MapFile does at run time.  Katakana and hankaku
+# katakana the rules leave out are left null, so that RomKanaMapFile
+# fills them in with Util, as it does when parsing the files.
+
+import collections
+import hashlib
+import json
+import os
+import re
+import sys
+
+HEADER = '''\
+// Generated by gen-rom-kana-tables.py from the bundled rules.  Do not edit.
+
+namespace Skk {
+    // A rule file a table was compiled from.
+    [CCode (has_type_id = false)]
+    struct RomKanaSource {
+        string rule;
+        string name;
+        // SHA-256 of the file contents
+        string checksum;
+    }
+
+    // A rom-kana entry as written in the rule; katakana and
+    // hankaku_katakana are null when they are to be computed.
+    [CCode (has_type_id = false)]
+    struct RomKanaTableEntry {
+        string rom;
+        string carryover;
+        string hiragana;
+        string? katakana;
+        string? hankaku_katakana;
+    }
+
+'''
+
+
+class Error(Exception):
+    pass
+
+
+# json-glib accepts C and C++ style comments, which the bundled rules
+# use; blank them out, leaving string literals alone.
+def strip_comments(text):
+    result = []
+    index = 0
+    while index < len(text):
+        c = text[index]
+        if c == '"':
+            end = index + 1
+            while end < len(text) and text[end] != '"':
+                end += 2 if text[end] == '\\' else 1
+            result.append(text[index:end + 1])
+            index = end + 1
+        elif text.startswith('/*', index):
+            end = text.find('*/', index + 2)
+            if end < 0:
+                raise Error('unterminated comment')
+            index = end + 2
+        elif text.startswith('//', index):
+            end = text.find('\n', index)
+            index = end if end >= 0 else len(text)
+        else:
+            result.append(c)
+            index += 1
+    return ''.join(result)
+
+
+class Rule(object):
+    def __init__(self, name):
+        self.name = name
+        self.files = {}
+
+
+# Same as MapFile.load, for the "rom-kana" map only.
+def load(rules, rule, name, included, sources, rom_kana):
+    if rule not in rules or name not in rules[rule].files:
+        raise Error('no such file %s/rom-kana/%s.json' % (rule, name))
+    path = rules[rule].files[name]
+    with open(path, 'rb') as f:
+        contents = f.read()
+    sources.append((rule, name, hashlib.sha256(contents).hexdigest()))
+    try:
+        root = json.loads(strip_comments(contents.decode('utf-8')),
+                          object_pairs_hook=collections.OrderedDict)
+    except (ValueError, Error) as e:
+        raise Error('can\'t load %s: %s' % (path, e))
+    if not isinstance(root, dict):
+        raise Error('%s: root element must be an object' % path)
+
+    for parent in root.get('include', []):
+        if parent in included:
+            continue
+        if '/' in parent:
+            parent_rule, parent_name = parent.split('/', 1)
+        else:
+            parent_rule, parent_name = rule, parent
+        load(rules, parent_rule, parent_name, included, sources, rom_kana)
+        included.add(parent)
+
+    define = root.get('define', {})
+    for key, value in define.get('rom-kana', {}).items():
+        if value is None:
+            rom_kana.pop(key, None)
+        else:
+            rom_kana[key] = value
+
+
+# Same as RomKanaMapFile.parse_rule, except for the kana conversion.
+def compile_rule(rules, rule):
+    sources = []
+    rom_kana = {}
+    load(rules, rule, 'default', set(), sources, rom_kana)
+    entries = []
+    for rom in sorted(rom_kana):
+        value = rom_kana[rom]
+        if not isinstance(value, list):
+            raise Error('%s: "rom-kana" member must be either an array '
+                        'or null' % rule)
+        if not 2 <= len(value) <= 4:
+            raise Error('%s: "rom-kana" must have two to four elements'
+                        % rule)
+        value = value + [None] * (4 - len(value))
+        entries.append((rom,) + tuple(value))
+    return sources, entries
+
+
+def quote(s):
+    if s is None:
+        return 'null'
+    result = ['"']
+    for c in s:
+        if c in '"\\':
+            result.append('\\' + c)
+        elif ord(c) < 0x20 or ord(c) == 0x7f:
+            result.append('\\x%02x' % ord(c))
+        else:
+            result.append(c)
+    result.append('"')
+    return ''.join(result)
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.stderr.write('Usage: %s OUTPUT ROM-KANA-JSON...\n'
+                         % sys.argv[0])
+        sys.exit(1)
+
+    # rules/<rule>/rom-kana/<name>.json
+    rules = {}
+    for path in sys.argv[2:]:
+        rom_kana_dir, filename = os.path.split(path)
+        rule_name = os.path.basename(os.path.dirname(rom_kana_dir))
+        rule = rules.setdefault(rule_name, Rule(rule_name))
+        rule.files[os.path.splitext(filename)[0]] = path
+
+    try:
+        compiled = [(name, compile_rule(rules, name))
+                    for name in sorted(rules)
+                    if 'default' in rules[name].files]
+    except Error as e:
+        sys.stderr.write('%s: %s\n' % (sys.argv[0], e))
+        sys.exit(1)
+
+    with open(sys.argv[1], 'w', encoding='utf-8') as f:
+        f.write(HEADER)
+        for name, (sources, entries) in compiled:
+            suffix = re.sub(r'\W', '_', name).upper()
+            f.write('    const RomKanaSource[] ROM_KANA_SOURCES_%s = {\n'
+                    % suffix)
+            for source in sources:
+                f.write('        { %s },\n' % ', '.join(map(quote, source)))
+            f.write('    };\n\n')
+            f.write('    const RomKanaTableEntry[] ROM_KANA_ENTRIES_%s = {\n'
+                    % suffix)
+            for entry in entries:
+                f.write('        { %s },\n' % ', '.join(map(quote, entry)))
+            f.write('    };\n\n')
+        f.write('    // Build the rom-kana tree of the bundled rule, unless\n')
+        f.write('    // it has been overridden in the data path.\n')
+        f.write('    internal RomKanaNode? '
+                'build_builtin_rom_kana (RuleMetadata metadata) {\n')
+        f.write('        switch (metadata.name) {\n')
+        for name, _ in compiled:
+            suffix = re.sub(r'\W', '_', name).upper()
+            f.write('        case %s:\n' % quote(name))
+            f.write('            return RomKanaMapFile.build_builtin (\n')
+            f.write('                metadata,\n')
+            f.write('                ROM_KANA_SOURCES_%s,\n' % suffix)
+            f.write('                ROM_KANA_ENTRIES_%s);\n' % suffix)
+        f.write('        default:\n')
+        f.write('            return null;\n')
+        f.write('        }\n')
+        f.write('    }\n')
+        f.write('}\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -60,8 +60,10 @@ namespace Skk {
             // ignore key release event
             if ((key.modifiers & ModifierType.RELEASE_MASK) != 0)
                 return null;
-            // clear shift mask
-            key.modifiers &= ~ModifierType.SHIFT_MASK;
+            // clear shift mask; events without it are left untouched,
+            // as Context may pass shared ones
+            if ((key.modifiers & ModifierType.SHIFT_MASK) != 0)
+                key.modifiers &= ~ModifierType.SHIFT_MASK;
             return key;
         }
     }
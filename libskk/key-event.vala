@@ -199,6 +199,43 @@ namespace Skk {
             }
         }
 
+        // Parsed key events by their string representation.  The
+        // cached objects are only handed out when the caller knows
+        // that nothing modifies them, since filters may.
+        const int KEY_EVENT_CACHE_SIZE = 1024;
+        static Map<string,KeyEvent>? key_event_cache = null;
+        static Mutex key_event_cache_mutex;
+
+        // Same as KeyEvent.from_string, but avoids parsing the same
+        // string twice.  If shared is true, the cached event itself
+        // is returned unless it has the shift mask, which
+        // SimpleKeyEventFilter clears.
+        internal static KeyEvent from_string_cached (string key,
+                                                     bool shared = false) throws KeyEventFormatError {
+            KeyEvent? template = null;
+            key_event_cache_mutex.lock ();
+            if (key_event_cache == null) {
+                key_event_cache = new HashMap<string,KeyEvent> ();
+            }
+            template = key_event_cache.get (key);
+            key_event_cache_mutex.unlock ();
+
+            if (template == null) {
+                template = new KeyEvent.from_string (key);
+                key_event_cache_mutex.lock ();
+                if (key_event_cache.size >= KEY_EVENT_CACHE_SIZE) {
+                    key_event_cache.clear ();
+                }
+                key_event_cache.set (key, template);
+                key_event_cache_mutex.unlock ();
+            }
+            if (shared &&
+                (template.modifiers & ModifierType.SHIFT_MASK) == 0) {
+                return template;
+            }
+            return template.copy ();
+        }
+
         /**
          * Convert the KeyEvent to string.
          *
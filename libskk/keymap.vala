@@ -18,33 +18,209 @@
 using Gee;
 
 namespace Skk {
+    // Commands a key may be bound to.  Keymap resolves the command
+    // names once when it is loaded, so that state handlers can switch
+    // on them instead of comparing strings for each key event.
+    enum KeymapCommand {
+        // no command is bound to the key
+        NONE,
+        // a command no state handler knows about
+        UNKNOWN,
+        ABORT,
+        ABORT_TO_LATIN,
+        ABORT_TO_LATIN_UNHANDLED,
+        COMMIT,
+        COMMIT_UNHANDLED,
+        START_PREEDIT,
+        START_PREEDIT_KANA,
+        START_PREEDIT_NO_DELETE,
+        SET_INPUT_MODE_HIRAGANA,
+        SET_INPUT_MODE_KATAKANA,
+        SET_INPUT_MODE_HANKAKU_KATAKANA,
+        SET_INPUT_MODE_LATIN,
+        SET_INPUT_MODE_WIDE_LATIN,
+        DELETE,
+        REGISTER,
+        ABBREV,
+        KUTEN,
+        NEXT_CANDIDATE,
+        PREVIOUS_CANDIDATE,
+        PURGE_CANDIDATE,
+        COMPLETE,
+        SPECIAL_MIDASI,
+        EXPAND_PREEDIT,
+        SHRINK_PREEDIT,
+        // "insert-kana-" followed by the kana
+        INSERT_KANA,
+        // "upper-" followed by the lower case character
+        UPPER
+    }
+
+    struct KeymapCommandEntry {
+        string name;
+        KeymapCommand command;
+    }
+
+    class KeymapBinding {
+        // the key as KeyEvent.to_string() formats it
+        internal string key;
+        internal ModifierType modifiers;
+        internal string name;
+        internal KeymapCommand command;
+        // another binding for the same base key
+        internal KeymapBinding? next = null;
+
+        const KeymapCommandEntry[] commands = {
+            { "abort", KeymapCommand.ABORT },
+            { "abort-to-latin", KeymapCommand.ABORT_TO_LATIN },
+            { "abort-to-latin-unhandled",
+              KeymapCommand.ABORT_TO_LATIN_UNHANDLED },
+            { "commit", KeymapCommand.COMMIT },
+            { "commit-unhandled", KeymapCommand.COMMIT_UNHANDLED },
+            { "start-preedit", KeymapCommand.START_PREEDIT },
+            { "start-preedit-kana", KeymapCommand.START_PREEDIT_KANA },
+            { "start-preedit-no-delete",
+              KeymapCommand.START_PREEDIT_NO_DELETE },
+            { "set-input-mode-hiragana",
+              KeymapCommand.SET_INPUT_MODE_HIRAGANA },
+            { "set-input-mode-katakana",
+              KeymapCommand.SET_INPUT_MODE_KATAKANA },
+            { "set-input-mode-hankaku-katakana",
+              KeymapCommand.SET_INPUT_MODE_HANKAKU_KATAKANA },
+            { "set-input-mode-latin", KeymapCommand.SET_INPUT_MODE_LATIN },
+            { "set-input-mode-wide-latin",
+              KeymapCommand.SET_INPUT_MODE_WIDE_LATIN },
+            { "delete", KeymapCommand.DELETE },
+            { "register", KeymapCommand.REGISTER },
+            { "abbrev", KeymapCommand.ABBREV },
+            { "kuten", KeymapCommand.KUTEN },
+            { "next-candidate", KeymapCommand.NEXT_CANDIDATE },
+            { "previous-candidate", KeymapCommand.PREVIOUS_CANDIDATE },
+            { "purge-candidate", KeymapCommand.PURGE_CANDIDATE },
+            { "complete", KeymapCommand.COMPLETE },
+            { "special-midasi", KeymapCommand.SPECIAL_MIDASI },
+            { "expand-preedit", KeymapCommand.EXPAND_PREEDIT },
+            { "shrink-preedit", KeymapCommand.SHRINK_PREEDIT }
+        };
+
+        static KeymapCommand resolve (string name) {
+            if (name.has_prefix ("insert-kana-")) {
+                return KeymapCommand.INSERT_KANA;
+            }
+            if (name.has_prefix ("upper-")) {
+                return KeymapCommand.UPPER;
+            }
+            foreach (var entry in commands) {
+                if (entry.name == name) {
+                    return entry.command;
+                }
+            }
+            return KeymapCommand.UNKNOWN;
+        }
+
+        internal KeymapBinding (string key, ModifierType modifiers) {
+            this.key = key;
+            this.modifiers = modifiers;
+        }
+
+        internal void bind (string name) {
+            this.name = name;
+            this.command = resolve (name);
+        }
+    }
+
     class Keymap : Object {
-        Map<string,string> entries = new HashMap<string,string> ();
+        // modifiers KeyEvent.to_string() shows; the others (e.g. the
+        // shift mask) never told bindings apart
+        const ModifierType MODIFIER_MASK =
+            ModifierType.CONTROL_MASK |
+            ModifierType.META_MASK |
+            ModifierType.HYPER_MASK |
+            ModifierType.SUPER_MASK |
+            ModifierType.MOD1_MASK |
+            ModifierType.LSHIFT_MASK |
+            ModifierType.RSHIFT_MASK |
+            ModifierType.USLEEP_MASK |
+            ModifierType.RELEASE_MASK;
+
+        // Bindings by the base name of the key, chained by modifiers,
+        // so that looking up a key event does not format it as a
+        // string.
+        Map<string,KeymapBinding> entries =
+            new HashMap<string,KeymapBinding> ();
 
         public new void @set (string key, string command) {
             try {
                 var ev = new KeyEvent.from_string (key);
-                entries.set (ev.to_string (), command);
+                var modifiers = ev.modifiers & MODIFIER_MASK;
+                var _base = ev.name != null ? ev.name : ev.code.to_string ();
+                var head = entries.get (_base);
+                var binding = head;
+                while (binding != null && binding.modifiers != modifiers) {
+                    binding = binding.next;
+                }
+                if (binding == null) {
+                    binding = new KeymapBinding (ev.to_string (), modifiers);
+                    binding.next = head;
+                    entries.set (_base, binding);
+                }
+                binding.bind (command);
             } catch (KeyEventFormatError e) {
                 warning ("can't get key event from string %s: %s",
                          key, e.message);
             }
         }
 
+        internal KeymapBinding? lookup_binding (KeyEvent key) {
+            unowned string? _base = key.name;
+            var binding = _base != null ?
+                entries.get (_base) : entries.get (key.code.to_string ());
+            var modifiers = key.modifiers & MODIFIER_MASK;
+            while (binding != null && binding.modifiers != modifiers) {
+                binding = binding.next;
+            }
+            return binding;
+        }
+
         public string? lookup_key (KeyEvent key) {
-            return entries.get (key.to_string ());
+            var binding = lookup_binding (key);
+            return binding != null ? binding.name : null;
+        }
+
+        internal KeymapCommand lookup_command (KeyEvent key) {
+            var binding = lookup_binding (key);
+            return binding != null ? binding.command : KeymapCommand.NONE;
+        }
+
+        internal void add_memory_usage (ref MemoryUsage usage) {
+            usage.heap_bytes += MemoryUsageUtils.instance_size (
+                typeof (Keymap));
+            foreach (var entry in entries.entries) {
+                usage.heap_bytes += MemoryUsageUtils.HASH_NODE_SIZE +
+                    MemoryUsageUtils.string_size (entry.key);
+                for (var binding = entry.value;
+                     binding != null;
+                     binding = binding.next) {
+                    usage.heap_bytes +=
+                        MemoryUsageUtils.string_size (binding.key) +
+                        MemoryUsageUtils.string_size (binding.name);
+                    usage.entries++;
+                }
+            }
         }
 
         public KeyEvent? where_is (string command) {
-            var iter = entries.map_iterator ();
-            while (iter.next ()) {
-                if (iter.get_value () == command) {
-                    var key = iter.get_key ();
-                    try {
-                        return new KeyEvent.from_string (key);
-                    } catch (KeyEventFormatError e) {
-                        warning ("can't get key event from string %s: %s",
-                                 key, e.message);
+            foreach (var head in entries.values) {
+                for (var binding = head;
+                     binding != null;
+                     binding = binding.next) {
+                    if (binding.name == command) {
+                        try {
+                            return new KeyEvent.from_string (binding.key);
+                        } catch (KeyEventFormatError e) {
+                            warning ("can't get key event from string %s: %s",
+                                     binding.key, e.message);
+                        }
                     }
                 }
             }
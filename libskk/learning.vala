@@ -0,0 +1,505 @@
+/*
+ * Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+ * Copyright (C) 2011-2026 Red Hat, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+using Gee;
+
+namespace Skk {
+    /**
+     * Policy used to choose the entry to drop when a bounded store
+     * is full.
+     *
+     * @since 1.2.0
+     */
+    public enum EvictionPolicy {
+        /**
+         * Drop the least recently used entry.
+         */
+        LRU,
+
+        /**
+         * Drop the least frequently used entry, the least recently
+         * used one among ties.
+         */
+        LFU
+    }
+
+    /**
+     * Usage statistics of a candidate or a midasi.
+     *
+     * @since 1.2.0
+     */
+    public struct LearningUsage {
+        /**
+         * Number of times it has been selected.
+         */
+        public uint count;
+
+        /**
+         * Logical timestamp of the last selection.  Larger is more
+         * recent; 0 means never.
+         */
+        public uint64 last_used;
+    }
+
+    /**
+     * Store of candidate selection frequency and recency.
+     *
+     * The store is used by {@link Context} to rank the candidates
+     * returned by the dictionaries, and by {@link UserDict} to choose
+     * the entries to drop when it is bounded.
+     *
+     * @since 1.2.0
+     */
+    public class LearningStore : Object {
+        class Entry {
+            public string key;
+            public string midasi;
+            public bool okuri;
+            public string text;
+            public LearningUsage usage;
+            // number of candidates, for the aggregated entries
+            public uint n_candidates;
+        }
+
+        Map<string,Entry> entries = new HashMap<string,Entry> ();
+        // Aggregated usage per midasi; text is unused.
+        Map<string,Entry> midasi_entries = new HashMap<string,Entry> ();
+        // The entries from the most to the least valuable, so that
+        // the one to evict is found without a scan.  An entry must be
+        // taken out before its usage is modified.
+        TreeSet<Entry> order = new_order (EvictionPolicy.LRU);
+        uint64 clock = 0;
+        File? file;
+
+        /**
+         * Maximum number of candidates tracked, 0 for unlimited.
+         *
+         * Lowering it drops the least valuable candidates at once.
+         */
+        public uint max_entries {
+            get {
+                return _max_entries;
+            }
+            set {
+                _max_entries = value;
+                trim (null);
+            }
+        }
+        uint _max_entries = 0;
+
+        /**
+         * Policy used to drop entries when the store is full.
+         */
+        public EvictionPolicy policy {
+            get {
+                return _policy;
+            }
+            set {
+                if (_policy == value) {
+                    return;
+                }
+                _policy = value;
+                order = new_order (_policy);
+                order.add_all (entries.values);
+            }
+        }
+        EvictionPolicy _policy = EvictionPolicy.LRU;
+
+        /**
+         * Number of candidates currently tracked.
+         */
+        public int size {
+            get {
+                return entries.size;
+            }
+        }
+
+        /**
+         * Signal emitted when a candidate is dropped from the store.
+         *
+         * @param midasi the midasi of the candidate
+         * @param okuri whether the candidate is okuri-ari
+         * @param text the text of the candidate
+         */
+        public signal void evicted (string midasi, bool okuri, string text);
+
+        // Emitted when the aggregated usage of a midasi changes, or
+        // with a null midasi when all of them have changed.
+        internal signal void usage_changed (string? midasi, bool okuri);
+
+        static string make_midasi_key (string midasi, bool okuri) {
+            return (okuri ? "1" : "0") + midasi;
+        }
+
+        static string make_key (string midasi, bool okuri, string text) {
+            return make_midasi_key (midasi, okuri) + "\t" + text;
+        }
+
+        /**
+         * Compare two usages according to //policy//.
+         *
+         * @param a a usage
+         * @param b another usage
+         *
+         * @return negative if `a` should be kept rather than `b`,
+         * positive if `b` should be kept rather than `a`, 0 if tied
+         */
+        public int compare_usage (LearningUsage a, LearningUsage b) {
+            return compare_usage_with_policy (_policy, a, b);
+        }
+
+        internal static int compare_usage_with_policy (EvictionPolicy policy,
+                                                       LearningUsage a,
+                                                       LearningUsage b)
+        {
+            if (policy == EvictionPolicy.LFU && a.count != b.count) {
+                return a.count > b.count ? -1 : 1;
+            }
+            if (a.last_used != b.last_used) {
+                return a.last_used > b.last_used ? -1 : 1;
+            }
+            return 0;
+        }
+
+        // Static, so that the comparator does not keep a reference
+        // to the store.
+        static TreeSet<Entry> new_order (EvictionPolicy policy) {
+            return new TreeSet<Entry> ((a, b) => {
+                    var result = compare_usage_with_policy (policy,
+                                                            a.usage,
+                                                            b.usage);
+                    if (result != 0) {
+                        return result;
+                    }
+                    return strcmp (a.key, b.key);
+                });
+        }
+
+        /**
+         * Record that a candidate has been selected.
+         *
+         * @param candidate a candidate
+         */
+        public void record (Candidate candidate) {
+            var now = ++clock;
+            var key = make_key (candidate.midasi,
+                                candidate.okuri,
+                                candidate.text);
+            var midasi_entry = get_midasi_entry (candidate.midasi,
+                                                 candidate.okuri);
+            var entry = entries.get (key);
+            if (entry == null) {
+                entry = new Entry ();
+                entry.key = key;
+                entry.midasi = candidate.midasi;
+                entry.okuri = candidate.okuri;
+                entry.text = candidate.text;
+                entries.set (key, entry);
+                midasi_entry.n_candidates++;
+            } else {
+                order.remove (entry);
+            }
+            entry.usage.count++;
+            entry.usage.last_used = now;
+            order.add (entry);
+
+            midasi_entry.usage.count++;
+            midasi_entry.usage.last_used = now;
+            usage_changed (candidate.midasi, candidate.okuri);
+
+            trim (entry);
+        }
+
+        /**
+         * Forget the statistics of a candidate.
+         *
+         * The selections of the candidate are no longer counted in
+         * the usage of its midasi.
+         *
+         * @param candidate a candidate
+         */
+        public void forget (Candidate candidate) {
+            var entry = entries.get (make_key (candidate.midasi,
+                                               candidate.okuri,
+                                               candidate.text));
+            if (entry != null) {
+                remove_entry (entry, true);
+            }
+        }
+
+        /**
+         * Return the statistics of a candidate.
+         *
+         * @param candidate a candidate
+         *
+         * @return the usage, zero if the candidate is unknown
+         */
+        public LearningUsage get_candidate_usage (Candidate candidate) {
+            var entry = entries.get (make_key (candidate.midasi,
+                                               candidate.okuri,
+                                               candidate.text));
+            if (entry == null) {
+                return LearningUsage ();
+            }
+            return entry.usage;
+        }
+
+        /**
+         * Return the aggregated statistics of a midasi.
+         *
+         * @param midasi a midasi
+         * @param okuri whether the midasi is okuri-ari
+         *
+         * @return the usage, zero if the midasi is unknown
+         */
+        public LearningUsage get_usage (string midasi, bool okuri) {
+            var entry = midasi_entries.get (make_midasi_key (midasi, okuri));
+            if (entry == null) {
+                return LearningUsage ();
+            }
+            return entry.usage;
+        }
+
+        Entry get_midasi_entry (string midasi, bool okuri) {
+            var midasi_key = make_midasi_key (midasi, okuri);
+            var entry = midasi_entries.get (midasi_key);
+            if (entry == null) {
+                entry = new Entry ();
+                entry.key = midasi_key;
+                entry.midasi = midasi;
+                entry.okuri = okuri;
+                midasi_entries.set (midasi_key, entry);
+            }
+            return entry;
+        }
+
+        // Drop a candidate, and the aggregated usage of its midasi
+        // once no candidate refers to it.  If subtract is true, its
+        // selections are also taken out of the aggregated count.
+        void remove_entry (Entry entry, bool subtract) {
+            entries.unset (entry.key);
+            order.remove (entry);
+            var midasi_key = make_midasi_key (entry.midasi, entry.okuri);
+            var midasi_entry = midasi_entries.get (midasi_key);
+            if (midasi_entry != null) {
+                if (subtract) {
+                    midasi_entry.usage.count -= uint.min (
+                        midasi_entry.usage.count, entry.usage.count);
+                }
+                if (--midasi_entry.n_candidates == 0) {
+                    midasi_entries.unset (midasi_key);
+                }
+            }
+            usage_changed (entry.midasi, entry.okuri);
+        }
+
+        void evict (Entry? keep) {
+            var victim = order.last ();
+            if (victim == keep) {
+                victim = order.lower (victim);
+            }
+            if (victim != null) {
+                remove_entry (victim, false);
+                evicted (victim.midasi, victim.okuri, victim.text);
+            }
+        }
+
+        // Drop the least valuable candidates other than keep until
+        // at most max_entries are left.
+        void trim (Entry? keep) {
+            while (_max_entries > 0 && entries.size > _max_entries) {
+                evict (keep);
+            }
+        }
+
+        /**
+         * Reorder candidates so the learned ones come first.
+         *
+         * Candidates which have been selected before are sorted by
+         * //policy// and moved in front of the others; the order is
+         * otherwise preserved.
+         *
+         * @param candidates a list of candidates
+         */
+        internal void rank (Gee.List<Candidate> candidates) {
+            if (entries.is_empty) {
+                return;
+            }
+            var learned = new ArrayList<Candidate> ();
+            var learned_entries = new HashMap<Candidate,Entry> ();
+            var rest = new ArrayList<Candidate> ();
+            foreach (var candidate in candidates) {
+                var entry = entries.get (make_key (candidate.midasi,
+                                                   candidate.okuri,
+                                                   candidate.text));
+                if (entry != null) {
+                    learned.add (candidate);
+                    learned_entries.set (candidate, entry);
+                } else {
+                    rest.add (candidate);
+                }
+            }
+            if (learned.is_empty) {
+                return;
+            }
+            // Gee's TimSort is stable.
+            learned.sort ((a, b) => {
+                    return compare_usage (learned_entries.get (a).usage,
+                                          learned_entries.get (b).usage);
+                });
+            candidates.clear ();
+            candidates.add_all (learned);
+            candidates.add_all (rest);
+        }
+
+        /**
+         * Drop all the statistics.
+         */
+        public void clear () {
+            entries.clear ();
+            midasi_entries.clear ();
+            order.clear ();
+            clock = 0;
+            usage_changed (null, false);
+        }
+
+        void load () throws GLib.Error {
+            uint8[] contents;
+            file.load_contents (null, out contents, null);
+            var memory = new MemoryInputStream.from_data (contents, g_free);
+            var data = new DataInputStream (memory);
+            string? line;
+            size_t length;
+            while ((line = data.read_line (out length)) != null) {
+                if (line.has_prefix (";")) {
+                    continue;
+                }
+                // count, last_used, okuri, midasi, text
+                var fields = line.split ("\t", 5);
+                if (fields.length != 5) {
+                    warning ("%s: malformed learning entry: %s",
+                             file.get_path (), line);
+                    continue;
+                }
+                var entry = new Entry ();
+                entry.usage.count = (uint) uint64.parse (fields[0]);
+                entry.usage.last_used = uint64.parse (fields[1]);
+                entry.okuri = fields[2] == "1";
+                entry.midasi = fields[3];
+                entry.text = fields[4];
+                entry.key = make_key (entry.midasi, entry.okuri, entry.text);
+                var old_entry = entries.get (entry.key);
+                if (old_entry != null) {
+                    remove_entry (old_entry, true);
+                }
+                entries.set (entry.key, entry);
+                order.add (entry);
+
+                var midasi_entry = get_midasi_entry (entry.midasi,
+                                                     entry.okuri);
+                midasi_entry.n_candidates++;
+                midasi_entry.usage.count += entry.usage.count;
+                if (entry.usage.last_used > midasi_entry.usage.last_used) {
+                    midasi_entry.usage.last_used = entry.usage.last_used;
+                }
+                if (entry.usage.last_used > clock) {
+                    clock = entry.usage.last_used;
+                }
+            }
+            trim (null);
+        }
+
+        /**
+         * Save the statistics to the file given at construction time.
+         *
+         * @throws GLib.Error if the file cannot be written
+         */
+        public void save () throws GLib.Error {
+            if (file == null) {
+                return;
+            }
+            var builder = new StringBuilder ();
+            builder.append (";; -*- mode: fundamental; coding: utf-8 -*-\n");
+            foreach (var entry in entries.values) {
+                builder.append_printf ("%u\t%" + uint64.FORMAT + "\t%s\t%s\t%s\n",
+                                       entry.usage.count,
+                                       entry.usage.last_used,
+                                       entry.okuri ? "1" : "0",
+                                       entry.midasi,
+                                       entry.text);
+            }
+            var contents = builder.str;
+            DirUtils.create_with_parents (Path.get_dirname (file.get_path ()),
+                                          448);
+#if VALA_0_16
+            file.replace_contents (contents.data,
+                                   null,
+                                   false,
+                                   FileCreateFlags.PRIVATE,
+                                   null);
+#else
+            file.replace_contents (contents,
+                                   contents.length,
+                                   null,
+                                   false,
+                                   FileCreateFlags.PRIVATE,
+                                   null);
+#endif
+        }
+
+        /**
+         * Create a new LearningStore.
+         *
+         * @param path a path to the file where statistics are kept,
+         * or `null` to keep them only in memory
+         *
+         * @return a new LearningStore
+         * @throws GLib.Error if the file exists but cannot be read
+         */
+        public LearningStore (string? path = null) throws GLib.Error {
+            if (path != null) {
+                file = File.new_for_path (path);
+                if (FileUtils.test (path, FileTest.EXISTS)) {
+                    load ();
+                }
+            }
+        }
+
+        internal MemoryUsage get_memory_usage () {
+            var usage = MemoryUsage ();
+            usage.heap_bytes = MemoryUsageUtils.instance_size (get_type ());
+            add_entries_usage (ref usage, entries);
+            add_entries_usage (ref usage, midasi_entries);
+            usage.heap_bytes += order.size * MemoryUsageUtils.TREE_NODE_SIZE;
+            return usage;
+        }
+
+        static void add_entries_usage (ref MemoryUsage usage,
+                                       Map<string,Entry> map)
+        {
+            foreach (var mapentry in map.entries) {
+                var entry = mapentry.value;
+                usage.heap_bytes += MemoryUsageUtils.HASH_NODE_SIZE +
+                    MemoryUsageUtils.string_size (mapentry.key) +
+                    sizeof (Entry) +
+                    MemoryUsageUtils.string_size (entry.midasi) +
+                    MemoryUsageUtils.string_size (entry.text);
+            }
+            usage.entries += map.size;
+        }
+    }
+}
@@ -117,6 +117,17 @@ namespace Skk {
         internal MapFile (RuleMetadata metadata,
                           string type,
                           string name) throws RuleParseError
+        {
+            load_file (metadata, type, name);
+        }
+
+        // For subclasses which may not need to read any file.
+        internal MapFile.empty () {
+        }
+
+        internal void load_file (RuleMetadata metadata,
+                                 string type,
+                                 string name) throws RuleParseError
         {
             Set<string> included = new HashSet<string> ();
             load (metadata, type, name, included);
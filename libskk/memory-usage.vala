@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+ * Copyright (C) 2011-2026 Red Hat, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+namespace Skk {
+    /**
+     * Approximate memory used by an object.
+     *
+     * Heap sizes are estimates: they count the instances and strings
+     * an object owns, but not allocator overhead.
+     *
+     * @since 1.2.0
+     */
+    public struct MemoryUsage {
+        /**
+         * Bytes allocated on the heap.
+         */
+        public size_t heap_bytes;
+
+        /**
+         * Bytes of files mapped into memory.
+         */
+        public size_t mapped_bytes;
+
+        /**
+         * Number of entries, e.g. dictionary entries or rule nodes.
+         */
+        public uint entries;
+
+        /**
+         * Add another usage to this one.
+         *
+         * @param other a MemoryUsage
+         */
+        public void add (MemoryUsage other) {
+            heap_bytes += other.heap_bytes;
+            mapped_bytes += other.mapped_bytes;
+            entries += other.entries;
+        }
+    }
+
+    abstract class MemoryUsageUtils : Object {
+        // A Gee hash map node: key, value, hash and next pointer.
+        internal const size_t HASH_NODE_SIZE = 4 * sizeof (void *);
+
+        // A Gee tree set node: key, color, left, right, prev and next
+        // pointers.
+        internal const size_t TREE_NODE_SIZE = 6 * sizeof (void *);
+
+        // Size of an instance of type, not counting what it refers
+        // to.
+        internal static size_t instance_size (Type type) {
+            TypeQuery query;
+            type.query (out query);
+            return query.instance_size;
+        }
+
+        internal static size_t string_size (string? str) {
+            return str == null ? 0 : str.length + 1;
+        }
+    }
+}
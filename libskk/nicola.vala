@@ -15,7 +15,6 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-using Gee;
 
 namespace Skk {
     /**
@@ -33,8 +32,8 @@ namespace Skk {
      */
     public class NicolaKeyEventFilter : KeyEventFilter {
         static int64 get_time () {
-            var tv = TimeVal ();
-            return (((int64) tv.tv_sec) * 1000000) + tv.tv_usec;
+            // wall-clock time may jump (NTP, suspend)
+            return get_monotonic_time ();
         }
 
         public GetTime get_time_func = get_time;
@@ -68,17 +67,13 @@ namespace Skk {
          */
         public string[] special_doubles;
 
-        class TimedEntry<T> {
-            public T data;
-            public int64 time;
-
-            public TimedEntry (T data, int64 time) {
-                this.data = data;
-                this.time = time;
-            }
-        }
-
-        LinkedList<TimedEntry<KeyEvent>> pending = new LinkedList<TimedEntry<KeyEvent>> ();
+        // Pending key events, newest first, kept in a ring buffer.
+        // At most 3 events are considered at once (see dispatch).
+        const int PENDING_CAPACITY = 3;
+        KeyEvent?[] pending_keys = new KeyEvent?[PENDING_CAPACITY];
+        int64[] pending_times = new int64[PENDING_CAPACITY];
+        int pending_head = 0;
+        int pending_size = 0;
 
         // we can't use normal constructor here since KeyEventFilter
         // is constructed with Object.new (type).
@@ -86,6 +81,34 @@ namespace Skk {
             special_doubles = SPECIAL_DOUBLES;
         }
 
+        int pending_index (int i) {
+            return (pending_head + i) % PENDING_CAPACITY;
+        }
+
+        unowned KeyEvent pending_key (int i) {
+            return pending_keys[pending_index (i)];
+        }
+
+        int64 pending_time (int i) {
+            return pending_times[pending_index (i)];
+        }
+
+        void push_pending (KeyEvent key, int64 time) {
+            pending_head = (pending_head + PENDING_CAPACITY - 1) %
+                PENDING_CAPACITY;
+            pending_keys[pending_head] = key;
+            pending_times[pending_head] = time;
+            pending_size++;
+        }
+
+        // Keep only the newest n events.
+        void truncate_pending (int n) {
+            while (pending_size > n) {
+                pending_size--;
+                pending_keys[pending_index (pending_size)] = null;
+            }
+        }
+
         static bool is_char (KeyEvent key) {
             return key.code != 0;
         }
@@ -102,50 +125,54 @@ namespace Skk {
             return is_lshift (key) || is_rshift (key);
         }
 
-        static string get_special_double_name (KeyEvent a, KeyEvent b) {
+        // Find the special double "[xy]" for a and b without
+        // building its name; chars are ASCII (see filter_key_event).
+        unowned string? lookup_special_double (KeyEvent a, KeyEvent b) {
+            char first, second;
             if (is_shift (a) && is_shift (b)) {
-                return "[LR]";
+                first = 'L';
+                second = 'R';
             } else if (is_char (a) && is_char (b)) {
-                unichar ac, bc;
                 if (a.code < b.code) {
-                    ac = a.code;
-                    bc = b.code;
+                    first = (char) a.code;
+                    second = (char) b.code;
                 } else {
-                    ac = b.code;
-                    bc = a.code;
+                    first = (char) b.code;
+                    second = (char) a.code;
                 }
-                return @"[$ac$bc]";
             } else {
                 return_val_if_reached (null);
             }
+            foreach (unowned string name in special_doubles) {
+                if (name.length == 4 &&
+                    name[0] == '[' && name[1] == first &&
+                    name[2] == second && name[3] == ']') {
+                    return name;
+                }
+            }
+            return null;
         }
 
         KeyEvent? queue (KeyEvent key, int64 time, out int64 wait) {
             // press/release a same key
             if ((key.modifiers & ModifierType.RELEASE_MASK) != 0) {
-                if (pending.size > 0 && pending.get (0).data.base_equal (key)) {
-                    var entry = pending.get (0);
+                if (pending_size > 0 && pending_key (0).base_equal (key)) {
+                    var data = pending_key (0);
                     wait = get_next_wait (key, time);
-                    pending.clear ();
-                    return entry.data;
+                    truncate_pending (0);
+                    return data;
                 }
             }
             // ignore key repeat
             else {
-                if (pending.size > 0 && pending.get (0).data.base_equal (key)) {
-                    pending.get (0).time = time;
+                if (pending_size > 0 && pending_key (0).base_equal (key)) {
+                    pending_times[pending_index (0)] = time;
                     wait = get_next_wait (key, time);
                     return key;
                 }
                 else {
-                    if (pending.size > 2) {
-                        var iter = pending.bidir_list_iterator ();
-                        iter.last ();
-                        do {
-                            iter.remove ();
-                        } while (pending.size > 2 && iter.previous ());
-                    }
-                    pending.insert (0, new TimedEntry<KeyEvent> (key, time));
+                    truncate_pending (PENDING_CAPACITY - 1);
+                    push_pending (key, time);
                 }
             }
             wait = maxwait;
@@ -153,28 +180,24 @@ namespace Skk {
         }
 
         int64 get_next_wait (KeyEvent key, int64 time) {
-            if (pending.size > 0) {
-                var iter = pending.bidir_list_iterator ();
-                iter.last ();
-                do {
-                    var entry = iter.get ();
-                    if (time - entry.time > timeout) {
-                        iter.remove ();
-                    }
-                } while (iter.previous ());
+            // events are queued in time order, so the expired ones
+            // are the oldest
+            while (pending_size > 0 &&
+                   time - pending_time (pending_size - 1) > timeout) {
+                truncate_pending (pending_size - 1);
             }
-            if (pending.size > 0) {
-                return timeout - (time - pending.last ().time);
+            if (pending_size > 0) {
+                return timeout - (time - pending_time (pending_size - 1));
             } else {
                 return maxwait;
             }
         }
 
         KeyEvent? dispatch_single (int64 time) {
-            var entry = pending.peek ();
-            if (time - entry.time > timeout) {
-                pending.clear ();
-                return entry.data;
+            if (time - pending_time (0) > timeout) {
+                var data = pending_key (0);
+                truncate_pending (0);
+                return data;
             }
             return null;
         }
@@ -188,62 +211,60 @@ namespace Skk {
         }
 
         KeyEvent? dispatch (int64 time) {
-            if (pending.size == 3) {
-                var b = pending.get (0);
-                var s = pending.get (1);
-                var a = pending.get (2);
-                var t1 = s.time - a.time;
-                var t2 = b.time - s.time;
+            if (pending_size == 3) {
+                var b = pending_key (0);
+                var s = pending_key (1);
+                var a = pending_key (2);
+                var t1 = pending_time (1) - pending_time (2);
+                var t2 = pending_time (0) - pending_time (1);
                 if (t1 <= t2) {
-                    pending.clear ();
-                    pending.offer_head (b);
+                    truncate_pending (1);
                     var r = dispatch_single (time);
-                    apply_shift (s.data, a.data);
-                    forwarded (a.data);
+                    apply_shift (s, a);
+                    forwarded (a);
                     return r;
                 } else {
-                    pending.clear ();
-                    apply_shift (s.data, b.data);
-                    forwarded (a.data);
-                    return b.data;
+                    truncate_pending (0);
+                    apply_shift (s, b);
+                    forwarded (a);
+                    return b;
                 }
-            } else if (pending.size == 2) {
-                var b = pending.get (0);
-                var a = pending.get (1);
-                if (b.time - a.time > overlap) {
-                    pending.clear ();
-                    pending.offer_head (b);
+            } else if (pending_size == 2) {
+                var b = pending_key (0);
+                var a = pending_key (1);
+                var a_time = pending_time (1);
+                if (pending_time (0) - a_time > overlap) {
+                    truncate_pending (1);
                     var r = dispatch_single (time);
-                    forwarded (a.data);
+                    forwarded (a);
                     return r;
-                } else if ((is_char (a.data) && is_char (b.data)) ||
-                           (is_shift (a.data) && is_shift (b.data))) {
+                } else if ((is_char (a) && is_char (b)) ||
+                           (is_shift (a) && is_shift (b))) {
                     // skk-nicola uses some combinations of 2 character
                     // keys ([fj], [gh], etc.) and 2 shift keys ([LR]).
-                    var name = get_special_double_name (b.data, a.data);
-                    if (name in special_doubles) {
-                        pending.clear ();
+                    unowned string? name = lookup_special_double (b, a);
+                    if (name != null) {
+                        truncate_pending (0);
                         return new KeyEvent (name,
                                              (unichar) 0,
                                              ModifierType.NONE);
                     } else {
-                        pending.clear ();
-                        pending.offer_head (b);
+                        truncate_pending (1);
                         var r = dispatch_single (time);
-                        forwarded (a.data);
+                        forwarded (a);
                         return r;
                     }
-                } else if (time - a.time > timeout) {
-                    pending.clear ();
-                    if (is_shift (b.data)) {
-                        apply_shift (b.data, a.data);
-                        return a.data;
+                } else if (time - a_time > timeout) {
+                    truncate_pending (0);
+                    if (is_shift (b)) {
+                        apply_shift (b, a);
+                        return a;
                     } else {
-                        apply_shift (a.data, b.data);
-                        return b.data;
+                        apply_shift (a, b);
+                        return b;
                     }
                 }
-            } else if (pending.size == 1) {
+            } else if (pending_size == 1) {
                 return dispatch_single (time);
             }
 
@@ -300,7 +321,7 @@ namespace Skk {
          * {@inheritDoc}
          */
         public override void reset () {
-            pending.clear ();
+            truncate_pending (0);
         }
     }
 }
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+ * Copyright (C) 2011-2026 Red Hat, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+namespace Skk {
+    // Inverted index of a read-only dictionary, mapping the text of
+    // each candidate back to the entry containing it.
+    //
+    // It is an open-addressing hash table referring to offsets in
+    // the dictionary file, so it is only valid for one version of the
+    // file.  The table is written to the user cache directory, one
+    // file per dictionary path, and later processes map it instead of
+    // scanning the dictionary.  The version it was built for is kept
+    // in the header, so a rebuild replaces the stale table.
+    //
+    // Layout, all integers are 32-bit little endian:
+    //
+    //   "SKKREV02"
+    //   SHA-1 of the version string, in hex
+    //   number of slots, a power of 2
+    //   slots: hash, text offset, entry offset
+    //
+    // Offsets are in the dictionary file; an entry offset of 0 marks
+    // an empty slot.  Texts are compared in the encoding of the
+    // dictionary, which must keep "/" and ";" as single bytes.
+    class ReverseIndex : Object {
+        const string MAGIC = "SKKREV02";
+        const int VERSION_SIZE = 40;
+        const int HEADER_SIZE = 52;
+        const int SLOT_SIZE = 12;
+
+        // Either mapped from the cache file, or kept on the heap if
+        // the cache cannot be written.
+        MappedMemory? mem = null;
+        uint8[]? data = null;
+        uint8 *slots;
+        uint32 n_slots;
+
+        static uint32 read_uint32 (uint8 *p) {
+            return ((uint32) p[3] << 24) | ((uint32) p[2] << 16) |
+                ((uint32) p[1] << 8) | (uint32) p[0];
+        }
+
+        static void write_uint32 (uint8 *p, uint32 value) {
+            p[0] = (uint8) value;
+            p[1] = (uint8) (value >> 8);
+            p[2] = (uint8) (value >> 16);
+            p[3] = (uint8) (value >> 24);
+        }
+
+        static uint32 hash (uint8 *p, size_t length) {
+            uint32 h = 5381;
+            for (size_t i = 0; i < length; i++) {
+                h = ((h << 5) + h) ^ p[i];
+            }
+            return h;
+        }
+
+        // Length of the candidate text starting at p, which ends at
+        // "/" or ";".
+        static size_t text_length (uint8 *p, uint8 *end) {
+            uint8 *q = p;
+            while (q < end && *q != '/' && *q != ';' && *q != '\n') {
+                q++;
+            }
+            return q - p;
+        }
+
+        // Append (text offset, entry offset) pairs for the
+        // candidates in "/text;annotation/.../" between start and
+        // end.
+        internal static void add_candidates (ref uint32[] pairs,
+                                             uint8 *source,
+                                             size_t start,
+                                             size_t end,
+                                             uint32 entry_offset)
+        {
+            for (size_t i = start; i < end; i++) {
+                if (source[i] != '/') {
+                    continue;
+                }
+                var length = text_length (source + i + 1, source + end);
+                if (length > 0) {
+                    pairs += (uint32) (i + 1);
+                    pairs += entry_offset;
+                }
+                i += length;
+            }
+        }
+
+        static File get_cache_file (string path) {
+            var name = Checksum.compute_for_string (ChecksumType.SHA1, path);
+            return File.new_for_path (
+                Path.build_filename (Environment.get_user_cache_dir (),
+                                     "libskk",
+                                     "reverse-index",
+                                     name));
+        }
+
+        ReverseIndex () {
+        }
+
+        static string get_version_digest (string version) {
+            return Checksum.compute_for_string (ChecksumType.SHA1, version);
+        }
+
+        void init_slots (uint8 *p, size_t length) throws SkkDictError {
+            if (length < HEADER_SIZE ||
+                Memory.cmp (p, MAGIC, MAGIC.length) != 0) {
+                throw new SkkDictError.MALFORMED_INPUT (
+                    "not a reverse index");
+            }
+            n_slots = read_uint32 (p + MAGIC.length + VERSION_SIZE);
+            if (n_slots == 0 || (n_slots & (n_slots - 1)) != 0 ||
+                n_slots != (length - HEADER_SIZE) / SLOT_SIZE) {
+                throw new SkkDictError.MALFORMED_INPUT (
+                    "corrupted reverse index");
+            }
+            slots = p + HEADER_SIZE;
+        }
+
+        // Map the index cached for the dictionary at path, or return
+        // null if there is none or it was built for another version.
+        internal static ReverseIndex? load (string path, string version) {
+            var file = get_cache_file (path);
+            if (!file.query_exists ()) {
+                return null;
+            }
+            try {
+                var index = new ReverseIndex ();
+                index.mem = new MemoryMappedFile (file).remap ();
+                index.init_slots ((uint8 *) index.mem.memory,
+                                  index.mem.length);
+                uint8 *p = (uint8 *) index.mem.memory + MAGIC.length;
+                if (Memory.cmp (p, get_version_digest (version),
+                                VERSION_SIZE) != 0) {
+                    return null;
+                }
+                return index;
+            } catch (SkkDictError e) {
+                warning ("ignoring reverse index %s: %s",
+                         file.get_path (), e.message);
+                return null;
+            }
+        }
+
+        // Build the index from the pairs given by add_candidates ()
+        // and cache it for the dictionary at path, replacing the one
+        // built for an older version.
+        internal static ReverseIndex build (string path,
+                                            string version,
+                                            uint8 *source,
+                                            size_t source_length,
+                                            uint32[] pairs)
+        {
+            var n_records = pairs.length / 2;
+            uint32 n_slots = 16;
+            while (n_slots < n_records * 2) {
+                n_slots *= 2;
+            }
+
+            var data = new uint8[HEADER_SIZE + n_slots * SLOT_SIZE];
+            Memory.copy (data, MAGIC, MAGIC.length);
+            Memory.copy ((uint8 *) data + MAGIC.length,
+                         get_version_digest (version), VERSION_SIZE);
+            write_uint32 ((uint8 *) data + MAGIC.length + VERSION_SIZE,
+                          n_slots);
+            uint8 *slots = (uint8 *) data + HEADER_SIZE;
+            for (var i = 0; i < pairs.length; i += 2) {
+                var text_offset = pairs[i];
+                var length = text_length (source + text_offset,
+                                          source + source_length);
+                var h = hash (source + text_offset, length);
+                var slot = h & (n_slots - 1);
+                while (read_uint32 (slots + slot * SLOT_SIZE + 8) != 0) {
+                    slot = (slot + 1) & (n_slots - 1);
+                }
+                write_uint32 (slots + slot * SLOT_SIZE, h);
+                write_uint32 (slots + slot * SLOT_SIZE + 4, text_offset);
+                write_uint32 (slots + slot * SLOT_SIZE + 8, pairs[i + 1]);
+            }
+
+            var file = get_cache_file (path);
+            try {
+                DirUtils.create_with_parents (file.get_parent ().get_path (),
+                                              0700);
+                // written to a temporary file and renamed, so the
+                // processes mapping the old index are not affected
+                FileUtils.set_data (file.get_path (), data);
+                var index = load (path, version);
+                if (index != null) {
+                    return index;
+                }
+            } catch (GLib.Error e) {
+                debug ("can't cache reverse index %s: %s",
+                       file.get_path (), e.message);
+            }
+
+            var index = new ReverseIndex ();
+            index.data = (owned) data;
+            try {
+                index.init_slots ((uint8 *) index.data, index.data.length);
+            } catch (SkkDictError e) {
+                assert_not_reached ();
+            }
+            return index;
+        }
+
+        // Return the offsets of the entries which have a candidate
+        // whose text is text, in the order of the dictionary file.
+        internal uint32[] lookup (uint8 *source,
+                                  size_t source_length,
+                                  string text)
+        {
+            uint32[] offsets = {};
+            var h = hash ((uint8 *) text, text.length);
+            var slot = h & (n_slots - 1);
+            // bounded, in case the cached file is corrupted
+            for (uint32 i = 0; i < n_slots; i++) {
+                uint8 *p = slots + slot * SLOT_SIZE;
+                var entry_offset = read_uint32 (p + 8);
+                if (entry_offset == 0) {
+                    break;
+                }
+                var text_offset = read_uint32 (p + 4);
+                if (read_uint32 (p) == h && text_offset < source_length &&
+                    text_length (source + text_offset,
+                                 source + source_length) == text.length &&
+                    Memory.cmp (source + text_offset,
+                                text, text.length) == 0) {
+                    offsets += entry_offset;
+                }
+                slot = (slot + 1) & (n_slots - 1);
+            }
+            // an entry may list the same text twice
+            sort_unique (ref offsets);
+            return offsets;
+        }
+
+        static void sort_unique (ref uint32[] offsets) {
+            // insertion sort; a text is in a handful of entries
+            for (var i = 1; i < offsets.length; i++) {
+                var offset = offsets[i];
+                var j = i;
+                for (; j > 0 && offsets[j - 1] > offset; j--) {
+                    offsets[j] = offsets[j - 1];
+                }
+                offsets[j] = offset;
+            }
+            var n = 0;
+            for (var i = 0; i < offsets.length; i++) {
+                if (n == 0 || offsets[n - 1] != offsets[i]) {
+                    offsets[n++] = offsets[i];
+                }
+            }
+            offsets.length = n;
+        }
+
+        internal size_t get_heap_size () {
+            return MemoryUsageUtils.instance_size (get_type ()) +
+                (data != null ? data.length : 0);
+        }
+
+        // Return the candidates of an entry whose text is text.
+        internal static void filter_candidates (ref Candidate[] result,
+                                                Candidate[] candidates,
+                                                string text)
+        {
+            foreach (var candidate in candidates) {
+                if (candidate.text == text) {
+                    result += candidate;
+                }
+            }
+        }
+    }
+}
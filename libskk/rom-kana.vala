@@ -71,6 +71,26 @@ namespace Skk {
             node.entry = entry;
         }
 
+        // Add the size of this subtree; each node is an entry.
+        internal void add_memory_usage (ref MemoryUsage usage) {
+            usage.heap_bytes += MemoryUsageUtils.instance_size (
+                typeof (RomKanaNode));
+            usage.entries++;
+            if (entry != null) {
+                usage.heap_bytes += sizeof (RomKanaEntry) +
+                    MemoryUsageUtils.string_size (entry.rom) +
+                    MemoryUsageUtils.string_size (entry.carryover) +
+                    MemoryUsageUtils.string_size (entry.hiragana) +
+                    MemoryUsageUtils.string_size (entry.katakana) +
+                    MemoryUsageUtils.string_size (entry.hankaku_katakana);
+            }
+            foreach (var child in children) {
+                if (child != null) {
+                    child.add_memory_usage (ref usage);
+                }
+            }
+        }
+
 #if 0
         RomKanaNode? lookup_node (string key) {
             var node = this;
@@ -174,12 +194,17 @@ namespace Skk {
         StringBuilder _output = new StringBuilder ();
         StringBuilder _preedit = new StringBuilder ();
 
+        // Bumped whenever output or preedit may have changed, so
+        // callers can tell if they need to re-read them.
+        internal uint serial = 0;
+
         public string output {
             get {
                 return _output.str;
             }
             internal set {
                 _output.assign (value);
+                serial++;
             }
         }
         public string preedit {
@@ -188,6 +213,37 @@ namespace Skk {
             }
         }
 
+        // Queries for the state handlers, which look at the buffers
+        // on every key event; unlike output and preedit, these never
+        // copy the buffer contents.
+        internal bool has_output {
+            get {
+                return _output.len > 0;
+            }
+        }
+
+        internal bool has_preedit {
+            get {
+                return _preedit.len > 0;
+            }
+        }
+
+        internal size_t output_length {
+            get {
+                return _output.len;
+            }
+        }
+
+        internal void append_output (string str) {
+            _output.append (str);
+            serial++;
+        }
+
+        internal void truncate_output (size_t length) {
+            _output.truncate (length);
+            serial++;
+        }
+
         const string[] NN = { "ん", "ン", "ﾝ" };
 
         public RomKanaConverter () {
@@ -206,7 +262,7 @@ namespace Skk {
         }
 
         public bool is_valid (unichar uc) {
-            if (uc > 128)
+            if (uc >= 128)
                 return false;
             return _rule.root_node.valid[(int)uc];
         }
@@ -219,6 +275,7 @@ namespace Skk {
                 _output.append (NN[kana_mode]);
                 _preedit.erase ();
                 current_node = rule.root_node;
+                serial++;
                 return true;
             }
             return false;
@@ -245,7 +302,8 @@ namespace Skk {
          * @return `true` if the character is handled, `false` otherwise
          */
         public bool append (unichar uc) {
-            var child_node = current_node.children[uc];
+            serial++;
+            RomKanaNode? child_node = uc < 128 ? current_node.children[uc] : null;
             if (child_node == null) {
                 // no such transition path in trie
                 var retval = output_nn_if_any ();
@@ -254,14 +312,13 @@ namespace Skk {
                 if (index >= 0) {
                     index = PERIOD_RULE[period_style].index_of_nth_char (index);
                     unichar period = PERIOD_RULE[period_style].get_char (index);
-                    string kana_period = Util.convert_by_input_mode(
-                        period.to_string(),
-                        (InputMode)kana_mode);
-                    _output.append (kana_period);
+                    Util.append_by_input_mode (_output,
+                                               period.to_string (),
+                                               (InputMode) kana_mode);
                     _preedit.erase ();
                     current_node = rule.root_node;
                     return true;
-                } else if (rule.root_node.children[uc] == null) {
+                } else if (uc >= 128 || rule.root_node.children[uc] == null) {
                     _output.append_unichar (uc);
                     _preedit.erase ();
                     current_node = rule.root_node;
@@ -304,6 +361,8 @@ namespace Skk {
         {
             if (preedit_only && _preedit.len == 0)
                 return false;
+            if (uc >= 128)
+                return false;
             var child_node = current_node.children[uc];
             if (child_node == null)
                 return false;
@@ -317,6 +376,7 @@ namespace Skk {
          * Reset the internal state of the converter.
          */
         public void reset () {
+            serial++;
             _output.erase ();
             _preedit.erase ();
             current_node = rule.root_node;
@@ -328,22 +388,30 @@ namespace Skk {
          * @return `true` if any character is removed, `false` otherwise
          */
         public bool delete () {
+            serial++;
             if (_preedit.len > 0) {
                 current_node = current_node.parent;
                 if (current_node == null)
                     current_node = rule.root_node;
-                _preedit.truncate (
-                    _preedit.str.index_of_nth_char (
-                        _preedit.str.char_count () - 1));
+                delete_last_char (_preedit);
                 return true;
             }
             if (_output.len > 0) {
-                _output.truncate (
-                    _output.str.index_of_nth_char (
-                        _output.str.char_count () - 1));
+                delete_last_char (_output);
                 return true;
             }
             return false;
         }
+
+        // Remove the last character of a non-empty builder, stepping
+        // back over UTF-8 continuation bytes instead of counting the
+        // characters from the start.
+        static void delete_last_char (StringBuilder builder) {
+            var length = builder.len - 1;
+            while (length > 0 && ((uint8) builder.str[length] & 0xc0) == 0x80) {
+                length--;
+            }
+            builder.truncate (length);
+        }
     }
 }
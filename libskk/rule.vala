@@ -40,6 +40,29 @@ namespace Skk {
     class RomKanaMapFile : MapFile {
         internal RomKanaNode root_node;
 
+        // Fill in the katakana and hankaku katakana a rule leaves
+        // out.  Shared with build_builtin, so that the compiled
+        // tables convert kana with the same code.
+        static RomKanaEntry make_entry (string rom,
+                                        string carryover,
+                                        string hiragana,
+                                        string? katakana,
+                                        string? hankaku_katakana)
+        {
+            var _katakana = katakana != null ?
+                katakana : Util.get_katakana (hiragana);
+            var _hankaku_katakana = hankaku_katakana != null ?
+                hankaku_katakana : Util.get_hankaku_katakana (_katakana);
+            RomKanaEntry entry = {
+                rom,
+                carryover,
+                hiragana,
+                _katakana,
+                _hankaku_katakana
+            };
+            return entry;
+        }
+
         RomKanaNode parse_rule (Map<string,Json.Node> map) throws RuleParseError
         {
             var node = new RomKanaNode (null);
@@ -49,22 +72,14 @@ namespace Skk {
                     var components = value.get_array ();
                     var length = components.get_length ();
                     if (2 <= length && length <= 4) {
-                        var carryover = components.get_string_element (0);
-                        var hiragana = components.get_string_element (1);
-                        var katakana = length >= 3 ?
-                            components.get_string_element (2) :
-                            Util.get_katakana (hiragana);
-                        var hankaku_katakana = length == 4 ?
-                            components.get_string_element (3) :
-                            Util.get_hankaku_katakana (katakana);
-
-                        RomKanaEntry entry = {
+                        var entry = make_entry (
                             key,
-                            carryover,
-                            hiragana,
-                            katakana,
-                            hankaku_katakana
-                        };
+                            components.get_string_element (0),
+                            components.get_string_element (1),
+                            length >= 3 ?
+                            components.get_string_element (2) : null,
+                            length == 4 ?
+                            components.get_string_element (3) : null);
                         node.insert (key, entry);
                     }
                     else {
@@ -79,14 +94,126 @@ namespace Skk {
             return node;
         }
 
-        public RomKanaMapFile (RuleMetadata metadata) throws RuleParseError {
-            base (metadata, "rom-kana", "default");
+        // Verdicts of check_builtin_sources, by the paths the sources
+        // were found at; a rule is usually loaded by every context.
+        static Map<string,bool> builtin_verdicts =
+            new HashMap<string,bool> ();
+
+        // Check that the files a compiled table was generated from
+        // are still the ones found in the data path; otherwise the
+        // rule, or a rule it includes, has been overridden.  The
+        // files installed along with the library are the ones it was
+        // compiled from, others are compared by checksum.
+        static bool check_builtin_sources (RuleMetadata metadata,
+                                           RomKanaSource[] sources)
+        {
+            var bundled_dir = Path.build_filename (Config.PKGDATADIR,
+                                                   "rules");
+            string[] filenames = {};
+            var bundled = true;
+            foreach (var source in sources) {
+                RuleMetadata? source_metadata;
+                if (source.rule == metadata.name) {
+                    source_metadata = metadata;
+                } else {
+                    source_metadata = Rule.find_rule (source.rule);
+                    if (source_metadata == null) {
+                        return false;
+                    }
+                }
+                var filename = source_metadata.locate_map_file ("rom-kana",
+                                                                source.name);
+                if (filename == null) {
+                    return false;
+                }
+                if (filename != Path.build_filename (bundled_dir,
+                                                     source.rule,
+                                                     "rom-kana",
+                                                     source.name + ".json")) {
+                    bundled = false;
+                }
+                filenames += filename;
+            }
+            if (bundled) {
+                return true;
+            }
+
+            var key = string.joinv ("\n", filenames);
+            lock (builtin_verdicts) {
+                if (builtin_verdicts.has_key (key)) {
+                    return builtin_verdicts.get (key);
+                }
+            }
+            var verdict = true;
+            for (var i = 0; i < sources.length; i++) {
+                string contents;
+                size_t length;
+                try {
+                    FileUtils.get_contents (filenames[i],
+                                            out contents,
+                                            out length);
+                } catch (FileError e) {
+                    verdict = false;
+                    break;
+                }
+                var checksum = Checksum.compute_for_string (
+                    ChecksumType.SHA256, contents, length);
+                if (checksum != sources[i].checksum) {
+                    verdict = false;
+                    break;
+                }
+            }
+            lock (builtin_verdicts) {
+                builtin_verdicts.set (key, verdict);
+            }
+            return verdict;
+        }
+
+        // Called from the generated build_builtin_rom_kana, with the
+        // tables compiled from the bundled rule.
+        internal static RomKanaNode? build_builtin (RuleMetadata metadata,
+                                                    RomKanaSource[] sources,
+                                                    RomKanaTableEntry[] entries)
+        {
+            if (!check_builtin_sources (metadata, sources)) {
+                return null;
+            }
+            var node = new RomKanaNode (null);
+            for (var i = 0; i < entries.length; i++) {
+                node.insert (entries[i].rom,
+                             make_entry (entries[i].rom,
+                                         entries[i].carryover,
+                                         entries[i].hiragana,
+                                         entries[i].katakana,
+                                         entries[i].hankaku_katakana));
+            }
+            return node;
+        }
+
+        void load_rom_kana (RuleMetadata metadata) throws RuleParseError {
+            load_file (metadata, "rom-kana", "default");
             if (has_map ("rom-kana")) {
                 root_node = parse_rule (get ("rom-kana"));
             } else {
                 throw new RuleParseError.FAILED ("no rom-kana entry");
             }
         }
+
+        public RomKanaMapFile (RuleMetadata metadata) throws RuleParseError {
+            base.empty ();
+            // bundled rules are compiled in, see gen-rom-kana-tables.py
+            root_node = build_builtin_rom_kana (metadata);
+            if (root_node == null) {
+                load_rom_kana (metadata);
+            }
+        }
+
+        // Always parse the rule files, even for a bundled rule; used
+        // to check the compiled tables against them.
+        internal RomKanaMapFile.parsed (RuleMetadata metadata) throws RuleParseError {
+            base.empty ();
+            load_rom_kana (metadata);
+        }
     }
 
     public errordomain RuleParseError {
@@ -253,6 +380,9 @@ namespace Skk {
          * @return a new Rule
          */
         public Rule (string name) throws RuleParseError {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
             var metadata = find_rule (name);
             if (metadata == null) {
                 throw new RuleParseError.FAILED (
@@ -277,6 +407,9 @@ namespace Skk {
                 _metadata = default_metadata;
             }
             rom_kana = new RomKanaMapFile (_metadata);
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Rule", "name=%s", name);
+#endif
         }
 
         ~Rule () {
@@ -355,5 +488,27 @@ namespace Skk {
             }
             return rules;
         }
+
+        /**
+         * Return the approximate memory used by the rule.
+         *
+         * Entries are the nodes of the rom-kana trie and the keymap
+         * entries.
+         *
+         * @return a MemoryUsage
+         * @since 1.2.0
+         */
+        public MemoryUsage get_memory_usage () {
+            var usage = MemoryUsage () {
+                heap_bytes = MemoryUsageUtils.instance_size (typeof (Rule))
+            };
+            rom_kana.root_node.add_memory_usage (ref usage);
+            foreach (var keymap in keymaps) {
+                if (keymap != null) {
+                    keymap.keymap.add_memory_usage (ref usage);
+                }
+            }
+            return usage;
+        }
     }
 }
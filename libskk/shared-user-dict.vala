@@ -0,0 +1,571 @@
+/*
+ * Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+ * Copyright (C) 2011-2026 Red Hat, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+namespace Skk {
+    [CCode (cname = "flock", cheader_filename = "sys/file.h")]
+    extern int flock (int fd, int operation);
+    [CCode (cname = "LOCK_SH", cheader_filename = "sys/file.h")]
+    extern const int LOCK_SH;
+    [CCode (cname = "LOCK_EX", cheader_filename = "sys/file.h")]
+    extern const int LOCK_EX;
+    [CCode (cname = "LOCK_UN", cheader_filename = "sys/file.h")]
+    extern const int LOCK_UN;
+
+    /**
+     * User dictionary shared by several processes of a user.
+     *
+     * Each selection and purge is appended to a journal file next
+     * to the dictionary, "PATH.journal".  Every process maps the
+     * journal and replays the records appended by the others before
+     * answering a query.  Two processes using the same path
+     * therefore see each other's changes without reloading the
+     * dictionary, and neither overwrites the other's on save.
+     *
+     * {@link save} merges the journal into the dictionary file, which
+     * stays in the usual SKK format, and then empties the journal.
+     * The dictionary file is replaced atomically before the journal
+     * is emptied, so a crash in between only replays some records
+     * twice.  Records are checksummed, and a record left incomplete
+     * by a crashed process is dropped by the next writer.  The
+     * journal is locked with flock(2) while it is read or written.
+     *
+     * Entries beyond {@link max_entries} are only dropped by {@link
+     * save}, so that every process sharing the dictionary keeps the
+     * same entries.
+     *
+     * @since 1.2.0
+     */
+    public class SharedUserDict : Dict {
+        // Layout, all integers are 32-bit little endian:
+        //
+        //   "SKKJNL01"
+        //   generation, incremented each time the journal is merged
+        //   records: payload length, checksum of the payload, and
+        //   payload: operation, okuri (one byte each), midasi, text,
+        //   annotation
+        //
+        // Strings are a length followed by UTF-8 bytes; a length of
+        // 0xffffffff means null.
+        const string MAGIC = "SKKJNL01";
+        const int HEADER_SIZE = 12;
+        const int RECORD_HEADER_SIZE = 8;
+        const uint8 OP_SELECT = 1;
+        const uint8 OP_PURGE = 2;
+        const uint32 NO_STRING = 0xffffffff;
+
+        static uint32 read_uint32 (uint8 *p) {
+            return ((uint32) p[3] << 24) | ((uint32) p[2] << 16) |
+                ((uint32) p[1] << 8) | (uint32) p[0];
+        }
+
+        static void append_uint32 (ByteArray buffer, uint32 value) {
+            uint8 bytes[4] = {
+                (uint8) value,
+                (uint8) (value >> 8),
+                (uint8) (value >> 16),
+                (uint8) (value >> 24)
+            };
+            buffer.append (bytes);
+        }
+
+        static void append_string (ByteArray buffer, string? str) {
+            if (str == null) {
+                append_uint32 (buffer, NO_STRING);
+            } else {
+                append_uint32 (buffer, str.length);
+                buffer.append (str.data);
+            }
+        }
+
+        // FNV-1a
+        static uint32 checksum (uint8 *p, size_t length) {
+            uint32 h = 2166136261U;
+            for (size_t i = 0; i < length; i++) {
+                h = (h ^ p[i]) * 16777619U;
+            }
+            return h;
+        }
+
+        static ByteArray encode_record (uint8 op, Candidate candidate) {
+            var payload = new ByteArray ();
+            uint8 head[2] = { op, candidate.okuri ? (uint8) 1 : (uint8) 0 };
+            payload.append (head);
+            append_string (payload, candidate.midasi);
+            append_string (payload, candidate.text);
+            append_string (payload, candidate.annotation);
+
+            var record = new ByteArray ();
+            append_uint32 (record, payload.len);
+            append_uint32 (record,
+                           checksum ((uint8 *) payload.data, payload.len));
+            record.append (payload.data);
+            return record;
+        }
+
+        static bool read_string (uint8 *p, size_t length, ref size_t pos,
+                                 out string? str)
+        {
+            str = null;
+            if (length - pos < 4) {
+                return false;
+            }
+            var n = read_uint32 (p + pos);
+            pos += 4;
+            if (n == NO_STRING) {
+                return true;
+            }
+            if (length - pos < n) {
+                return false;
+            }
+            str = ((string) ((char *) p + pos)).ndup (n);
+            pos += n;
+            return str.validate ();
+        }
+
+        string path;
+        string encoding;
+        File journal_file;
+        int fd = -1;
+        MemoryMappedFile mmap;
+        MappedMemory? mem = null;
+        uint32 generation = 0;
+        size_t journal_offset = HEADER_SIZE;
+        UserDict user_dict;
+
+        void lock_journal (int operation) throws GLib.Error {
+            while (flock (fd, operation) < 0) {
+                if (Posix.errno != Posix.EINTR) {
+                    throw new IOError.FAILED ("can't lock %s: %s",
+                                              journal_file.get_path (),
+                                              Posix.strerror (Posix.errno));
+                }
+            }
+        }
+
+        void unlock_journal () {
+            flock (fd, LOCK_UN);
+        }
+
+        void write_all (uint8 *data, size_t length) throws GLib.Error {
+            while (length > 0) {
+                var written = Posix.write (fd, data, length);
+                if (written < 0) {
+                    if (Posix.errno == Posix.EINTR) {
+                        continue;
+                    }
+                    throw new IOError.FAILED ("can't write %s: %s",
+                                              journal_file.get_path (),
+                                              Posix.strerror (Posix.errno));
+                }
+                data += written;
+                length -= written;
+            }
+        }
+
+        // Truncate the journal at offset and make it durable.
+        void truncate_journal (size_t offset) throws GLib.Error {
+            if (Posix.ftruncate (fd, (Posix.off_t) offset) < 0 ||
+                Posix.fsync (fd) < 0) {
+                throw new IOError.FAILED ("can't truncate %s: %s",
+                                          journal_file.get_path (),
+                                          Posix.strerror (Posix.errno));
+            }
+        }
+
+        // Start an empty journal; called with the exclusive lock.
+        void write_header (uint32 new_generation) throws GLib.Error {
+            var header = new ByteArray ();
+            header.append (MAGIC.data);
+            append_uint32 (header, new_generation);
+            Posix.lseek (fd, 0, Posix.SEEK_SET);
+            write_all ((uint8 *) header.data, header.len);
+            truncate_journal (HEADER_SIZE);
+        }
+
+        // Apply the record at offset and return the offset of the
+        // next one, or 0 if the record is incomplete or corrupted.
+        size_t apply_record (size_t offset) {
+            uint8 *p = (uint8 *) mem.memory + offset;
+            var available = mem.length - offset;
+            if (available < RECORD_HEADER_SIZE) {
+                return 0;
+            }
+            var length = read_uint32 (p);
+            if (length > available - RECORD_HEADER_SIZE ||
+                checksum (p + RECORD_HEADER_SIZE, length) !=
+                read_uint32 (p + 4)) {
+                return 0;
+            }
+
+            uint8 *payload = p + RECORD_HEADER_SIZE;
+            if (length < 2) {
+                return 0;
+            }
+            var op = payload[0];
+            var okuri = payload[1] != 0;
+            size_t pos = 2;
+            string? midasi, text, annotation;
+            if (!read_string (payload, length, ref pos, out midasi) ||
+                !read_string (payload, length, ref pos, out text) ||
+                !read_string (payload, length, ref pos, out annotation) ||
+                midasi == null || text == null) {
+                return 0;
+            }
+
+            var candidate = new Candidate (midasi, okuri, text, annotation);
+            switch (op) {
+            case OP_SELECT:
+                user_dict.select_candidate (candidate);
+                break;
+            case OP_PURGE:
+                user_dict.purge_candidate (candidate);
+                break;
+            default:
+                return 0;
+            }
+            return offset + RECORD_HEADER_SIZE + length;
+        }
+
+        // Replay the records appended since the last call, or load
+        // the dictionary file again if the journal has been merged
+        // into it.  Called with the journal locked.
+        void replay () throws GLib.Error {
+            Posix.Stat stat;
+            if (Posix.fstat (fd, out stat) < 0) {
+                throw new IOError.FAILED ("can't stat %s",
+                                          journal_file.get_path ());
+            }
+            if (mem == null || mem.length != stat.st_size) {
+                mem = mmap.remap ();
+            }
+            if (mem.length < HEADER_SIZE ||
+                Memory.cmp (mem.memory, MAGIC, MAGIC.length) != 0) {
+                throw new SkkDictError.MALFORMED_INPUT (
+                    "not a user dictionary journal");
+            }
+            var current = read_uint32 ((uint8 *) mem.memory + MAGIC.length);
+            if (current != generation) {
+                user_dict = new UserDict (path, encoding);
+                generation = current;
+                journal_offset = HEADER_SIZE;
+            }
+            while (journal_offset < mem.length) {
+                var next = apply_record (journal_offset);
+                if (next == 0) {
+                    break;
+                }
+                journal_offset = next;
+            }
+        }
+
+        // Whether records have been appended or the journal has been
+        // merged since the last replay.  Checked without the lock:
+        // the generation is rewritten in place in the mapped header,
+        // and records are only appended.
+        bool journal_changed () {
+            if (mem == null ||
+                read_uint32 ((uint8 *) mem.memory + MAGIC.length) !=
+                generation) {
+                return true;
+            }
+            Posix.Stat stat;
+            return Posix.fstat (fd, out stat) < 0 ||
+                stat.st_size != mem.length;
+        }
+
+        // Replay the journal under a shared lock, if it has changed.
+        void sync () {
+            lock (user_dict) {
+                if (!journal_changed ()) {
+                    return;
+                }
+                try {
+                    lock_journal (LOCK_SH);
+                    try {
+                        replay ();
+                    } finally {
+                        unlock_journal ();
+                    }
+                } catch (GLib.Error e) {
+                    warning ("can't read user dictionary journal %s: %s",
+                             journal_file.get_path (), e.message);
+                }
+            }
+        }
+
+        // Append a record and apply it along with the ones appended
+        // by other processes before it.
+        void append (ByteArray record) throws GLib.Error {
+            lock (user_dict) {
+                lock_journal (LOCK_EX);
+                try {
+                    replay ();
+                    // drop a record left incomplete by a crash
+                    if (journal_offset < mem.length) {
+                        truncate_journal (journal_offset);
+                    }
+                    Posix.lseek (fd, (Posix.off_t) journal_offset,
+                                 Posix.SEEK_SET);
+                    write_all ((uint8 *) record.data, record.len);
+                    if (Posix.fsync (fd) < 0) {
+                        throw new IOError.FAILED (
+                            "can't sync %s: %s",
+                            journal_file.get_path (),
+                            Posix.strerror (Posix.errno));
+                    }
+                    replay ();
+                } finally {
+                    unlock_journal ();
+                }
+            }
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override void reload () throws GLib.Error {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
+            sync ();
+            lock (user_dict) {
+                // the file may also be written by a plain UserDict
+                user_dict.reload ();
+            }
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Dict.reload", "%s", get_type ().name ());
+#endif
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override Candidate[] lookup (string midasi, bool okuri = false) {
+            sync ();
+            lock (user_dict) {
+                return user_dict.lookup (midasi, okuri);
+            }
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override string[] complete (string midasi) {
+            sync ();
+            lock (user_dict) {
+                return user_dict.complete (midasi);
+            }
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override string[] complete_prefix (string midasi,
+                                                  bool okuri = false,
+                                                  int limit = -1)
+        {
+            sync ();
+            lock (user_dict) {
+                return user_dict.complete_prefix (midasi, okuri, limit);
+            }
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override Candidate[] reverse_lookup (string text) {
+            sync ();
+            lock (user_dict) {
+                return user_dict.reverse_lookup (text);
+            }
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override bool read_only {
+            get {
+                return false;
+            }
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override bool select_candidate (Candidate candidate) {
+            // nothing to record if it is already the first one
+            var candidates = lookup (candidate.midasi, candidate.okuri);
+            if (candidates.length > 0 && candidates[0].text == candidate.text) {
+                return false;
+            }
+            try {
+                append (encode_record (OP_SELECT, candidate));
+            } catch (GLib.Error e) {
+                warning ("can't write user dictionary journal %s: %s",
+                         journal_file.get_path (), e.message);
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override bool purge_candidate (Candidate candidate) {
+            var found = false;
+            foreach (var c in lookup (candidate.midasi, candidate.okuri)) {
+                if (c.text == candidate.text) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                return false;
+            }
+            try {
+                append (encode_record (OP_PURGE, candidate));
+            } catch (GLib.Error e) {
+                warning ("can't write user dictionary journal %s: %s",
+                         journal_file.get_path (), e.message);
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * {@inheritDoc}
+         *
+         * This merges the changes made by all the processes sharing
+         * the dictionary into the file and empties the journal.
+         */
+        public override void save () throws GLib.Error {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
+            lock (user_dict) {
+                lock_journal (LOCK_EX);
+                try {
+                    replay ();
+                    // setting the limit trims the entries; the other
+                    // processes load the trimmed file once the
+                    // journal is merged
+                    user_dict.learning = learning;
+                    user_dict.max_entries = max_entries;
+                    user_dict.max_entries = 0;
+                    user_dict.learning = null;
+                    user_dict.save ();
+                    write_header (generation + 1);
+                    generation++;
+                    journal_offset = HEADER_SIZE;
+                    mem = mmap.remap ();
+                } finally {
+                    unlock_journal ();
+                }
+            }
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Dict.save", "%s", get_type ().name ());
+#endif
+        }
+
+        /**
+         * Maximum number of midasi kept, 0 for unlimited.
+         *
+         * Unlike {@link UserDict.max_entries}, this is only enforced
+         * by {@link save}, when the journal is merged.
+         *
+         * @since 1.2.0
+         */
+        public uint max_entries { get; set; default = 0; }
+
+        /**
+         * Learning store used to choose the entries dropped by {@link
+         * save}, see {@link UserDict.learning}.
+         *
+         * @since 1.2.0
+         */
+        public LearningStore? learning { get; set; default = null; }
+
+        internal override File? get_backing_file () {
+            // the journal changes whenever another process selects
+            // or purges a candidate
+            return journal_file;
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override MemoryUsage get_memory_usage () {
+            lock (user_dict) {
+                var usage = user_dict.get_memory_usage ();
+                usage.heap_bytes += MemoryUsageUtils.instance_size (
+                    get_type ());
+                if (mem != null) {
+                    usage.mapped_bytes += mem.length;
+                }
+                return usage;
+            }
+        }
+
+        /**
+         * Create a new SharedUserDict.
+         *
+         * @param path a path to the file
+         * @param encoding encoding of the file (default UTF-8)
+         *
+         * @return a new SharedUserDict
+         * @throws GLib.Error if opening the file is failed
+         */
+        public SharedUserDict (string path,
+                               string encoding = "UTF-8") throws GLib.Error
+        {
+            this.path = path;
+            this.encoding = encoding;
+            this.journal_file = File.new_for_path (path + ".journal");
+            this.mmap = new MemoryMappedFile (journal_file);
+
+            DirUtils.create_with_parents (Path.get_dirname (path), 448);
+            fd = Posix.open (journal_file.get_path (),
+                             Posix.O_RDWR | Posix.O_CREAT, 0600);
+            if (fd < 0) {
+                throw new IOError.FAILED ("can't open %s: %s",
+                                          journal_file.get_path (),
+                                          Posix.strerror (Posix.errno));
+            }
+
+            lock_journal (LOCK_EX);
+            try {
+                Posix.Stat stat;
+                if (Posix.fstat (fd, out stat) == 0 &&
+                    stat.st_size < HEADER_SIZE) {
+                    // new, or left incomplete by a crash
+                    write_header (1);
+                }
+                // generation 0 never matches, so replay () loads the
+                // dictionary file under the lock
+                replay ();
+            } finally {
+                unlock_journal ();
+            }
+        }
+
+        ~SharedUserDict () {
+            if (fd >= 0) {
+                Posix.close (fd);
+            }
+        }
+    }
+}
@@ -50,6 +50,18 @@ namespace Skk {
          * {@inheritDoc}
          */
         public override void reload () {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
+            lock (connection) {
+                reload_unlocked ();
+            }
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Dict.reload", "%s", get_type ().name ());
+#endif
+        }
+
+        void reload_unlocked () {
             close_connection ();
             try {
                 var client = new SocketClient ();
@@ -101,10 +113,36 @@ namespace Skk {
             return builder.str[0:index];
         }
 
+        // Send a request and read the response line, a round-trip
+        // to the server.
+        string request (string command) throws SkkServError, GLib.Error {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
+            size_t bytes_written;
+            connection.output_stream.write_all (command.data,
+                                                out bytes_written);
+            connection.output_stream.flush ();
+            var response = read_response ();
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "SkkServ.request",
+                        "request=%c bytes=%d response=%d",
+                        command[0], command.length, response.length);
+#endif
+            return response;
+        }
+
         /**
          * {@inheritDoc}
          */
         public override Candidate[] lookup (string midasi, bool okuri = false) {
+            // DictCompletionSource may call complete() from a thread
+            lock (connection) {
+                return lookup_unlocked (midasi, okuri);
+            }
+        }
+
+        Candidate[] lookup_unlocked (string midasi, bool okuri) {
             if (connection == null)
                 return new Candidate[0];
             string _midasi;
@@ -114,11 +152,7 @@ namespace Skk {
                 return new Candidate[0];
             }
             try {
-                size_t bytes_written;
-                connection.output_stream.write_all (
-                    "1%s ".printf (_midasi).data, out bytes_written);
-                connection.output_stream.flush ();
-                var response = read_response ();
+                var response = request ("1%s ".printf (_midasi));
                 if (response.length == 0)
                     return new Candidate[0];
                 return split_candidates (midasi,
@@ -136,6 +170,12 @@ namespace Skk {
          * {@inheritDoc}
          */
         public override string[] complete (string midasi) {
+            lock (connection) {
+                return complete_unlocked (midasi);
+            }
+        }
+
+        string[] complete_unlocked (string midasi) {
             if (connection == null)
                 return new string[0];
             string _midasi;
@@ -145,11 +185,7 @@ namespace Skk {
                 return new string[0];
             }
             try {
-                size_t bytes_written;
-                connection.output_stream.write_all (
-                    "4%s ".printf (_midasi).data, out bytes_written);
-                connection.output_stream.flush ();
-                var response = read_response ();
+                var response = request ("4%s ".printf (_midasi));
                 if (response.length < 2)
                     return new string[0];
                 return converter.decode (
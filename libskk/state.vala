@@ -27,8 +27,173 @@ namespace Skk {
         "〕", "}", "]", "?", ".", ",", "!"
     };
 
+    // Snapshot of what a State's preedit depends on, taken to tell
+    // if the preedit needs to be rebuilt.
+    struct PreeditStamp {
+        StateHandlerType handler_type;
+        uint serial;
+        uint rom_kana_serial;
+        uint okuri_rom_kana_serial;
+        size_t abbrev_len;
+        size_t kuten_len;
+        size_t output_len;
+        int cursor_pos;
+        bool okuri;
+        uint surrounding_end;
+        string? auto_start_henkan_keyword;
+
+        internal bool equal (PreeditStamp other) {
+            return handler_type == other.handler_type &&
+                serial == other.serial &&
+                rom_kana_serial == other.rom_kana_serial &&
+                okuri_rom_kana_serial == other.okuri_rom_kana_serial &&
+                abbrev_len == other.abbrev_len &&
+                kuten_len == other.kuten_len &&
+                output_len == other.output_len &&
+                cursor_pos == other.cursor_pos &&
+                okuri == other.okuri &&
+                surrounding_end == other.surrounding_end &&
+                auto_start_henkan_keyword == other.auto_start_henkan_keyword;
+        }
+    }
+
+    // Shared by the tasks of a lookup, so the caller can wait for
+    // them to finish.
+    class LookupBatch {
+        public Mutex mutex;
+        public Cond cond;
+
+        public LookupBatch () {
+            mutex = Mutex ();
+            cond = Cond ();
+        }
+    }
+
+    // Counters shared by the states of a Context.
+    class LookupStats {
+        public uint prefetch_hits = 0;
+        public uint prefetch_misses = 0;
+    }
+
+    // Lookup of a dictionary, possibly run on a worker thread.
+    class LookupTask {
+        public Dict dict;
+        public string midasi;
+        public bool okuri;
+        public LookupBatch? batch;
+
+        // Guarded by batch.mutex if batch is set.
+        public Candidate[] candidates = {};
+        public bool done = false;
+
+        // Set by the caller if the task missed the deadline; the
+        // results are then ignored even if they arrive later.
+        public bool expired = false;
+
+        // Set under batch.mutex when a queued prefetch is no longer
+        // needed, so the worker skips it.
+        public bool cancelled = false;
+
+        // Dictionaries with a lookup running on a worker thread.
+        // A dictionary is never queried from two workers at once.
+        // Guarded by busy_mutex; busy_cond is signalled when a
+        // dictionary is released.
+        static HashSet<Dict> busy_dictionaries = new HashSet<Dict> ();
+        static Mutex busy_mutex;
+        static Cond busy_cond;
+
+        static ThreadPool<LookupTask>? pool = null;
+        const int MAX_WORKERS = 4;
+
+        public LookupTask (Dict dict, string midasi, bool okuri,
+                           LookupBatch? batch) {
+            this.dict = dict;
+            this.midasi = midasi;
+            this.okuri = okuri;
+            this.batch = batch;
+        }
+
+        // Only the built-in dictionaries are known to be safe to query
+        // from another thread.  UserDict is in memory anyway.
+        public static bool can_run_in_worker (Dict dict) {
+            return dict is FileDict || dict is CdbDict || dict is BlockDict ||
+                dict is SkkServ;
+        }
+
+        public void run () {
+            if (batch != null) {
+                batch.mutex.lock ();
+                var skip = cancelled;
+                batch.mutex.unlock ();
+                if (skip) {
+                    return;
+                }
+            }
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
+            var result = dict.lookup (midasi, okuri);
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Dict.lookup",
+                        "%s midasi=%d okuri=%d candidates=%d",
+                        dict.get_type ().name (), (int) midasi.char_count (),
+                        (int) okuri, result.length);
+#endif
+            if (batch == null) {
+                candidates = result;
+                done = true;
+                return;
+            }
+            batch.mutex.lock ();
+            candidates = result;
+            done = true;
+            batch.cond.broadcast ();
+            batch.mutex.unlock ();
+        }
+
+        static void run_in_worker (owned LookupTask task) {
+            task.run ();
+            busy_mutex.lock ();
+            busy_dictionaries.remove (task.dict);
+            busy_cond.broadcast ();
+            busy_mutex.unlock ();
+        }
+
+        // Queue the task on the worker pool.  If the dictionary is
+        // still busy with an earlier lookup, wait for it until
+        // deadline, in monotonic time, or not at all if deadline is
+        // 0.  Returns false if the task was not queued; the caller
+        // may then run it itself.
+        public bool push (int64 deadline = 0) {
+            busy_mutex.lock ();
+            while (dict in busy_dictionaries) {
+                if (deadline == 0 ||
+                    !busy_cond.wait_until (busy_mutex, deadline)) {
+                    busy_mutex.unlock ();
+                    return false;
+                }
+            }
+            try {
+                if (pool == null) {
+                    pool = new ThreadPool<LookupTask>.with_owned_data (
+                        run_in_worker, MAX_WORKERS, false);
+                }
+                // the worker releases the dictionary under busy_mutex,
+                // so it can't do so before it is marked busy here
+                pool.add (this);
+            } catch (ThreadError e) {
+                warning ("can't queue lookup: %s", e.message);
+                busy_mutex.unlock ();
+                return false;
+            }
+            busy_dictionaries.add (dict);
+            busy_mutex.unlock ();
+            return true;
+        }
+    }
+
     class State : Object {
-        internal Type handler_type;
+        internal StateHandlerType handler_type;
         InputMode _input_mode;
         [CCode(notify = false)]
         internal InputMode input_mode {
@@ -57,6 +222,20 @@ namespace Skk {
         }
 
         internal Gee.List<Dict> dictionaries;
+        internal LearningStore? learning = null;
+        internal bool parallel_lookup = false;
+        internal uint lookup_timeout = 0;
+        internal bool prefetch_enabled = false;
+        internal LookupStats? lookup_stats = null;
+
+        // Lookup of the reading being typed, started in background
+        // by prefetch ().
+        string? prefetch_midasi = null;
+        bool prefetch_okuri = false;
+        LookupBatch? prefetch_batch = null;
+        ArrayList<LookupTask> prefetch_tasks = new ArrayList<LookupTask> ();
+        // Set by lookup_dictionaries if a prefetched task was used.
+        bool prefetch_consumed = false;
         internal CandidateList candidates;
 
         // These two RomKanaConverters are needed to track delete/undo
@@ -76,9 +255,12 @@ namespace Skk {
         // Used by Completion
         ArrayList<string> completion = new ArrayList<string> ();
         internal BidirListIterator<string> completion_iterator;
-        internal Set<string> completion_set = new HashSet<string> ();
+        // the prefix the completion list was made for, or the word
+        // last taken from it; null while no completion is active
+        string? completion_text = null;
         internal CompletionService normal_completion_service = null;
         internal CompletionService abbrev_completion_service = null;
+        Cancellable? completion_cancellable = null;
 
         internal string[] auto_start_henkan_keywords;
         internal string? auto_start_henkan_keyword = null;
@@ -113,6 +295,18 @@ namespace Skk {
             return keymap.lookup_key (key);
         }
 
+        internal KeymapCommand lookup_command (KeyEvent key) {
+            var keymap = _typing_rule.keymaps[input_mode].keymap;
+            return_val_if_fail (keymap != null, KeymapCommand.NONE);
+            return keymap.lookup_command (key);
+        }
+
+        KeymapBinding? lookup_binding (KeyEvent key) {
+            var keymap = _typing_rule.keymaps[input_mode].keymap;
+            return_val_if_fail (keymap != null, null);
+            return keymap.lookup_binding (key);
+        }
+
         internal KeyEvent? where_is (string command) {
             var keymap = _typing_rule.keymaps[input_mode].keymap;
             return_val_if_fail (keymap != null, null);
@@ -120,9 +314,9 @@ namespace Skk {
         }
 
         internal bool isupper (KeyEvent key, out unichar lower_code) {
-            var command = lookup_key (key);
-            if (command != null && command.has_prefix ("upper-")) {
-                lower_code = (unichar) command[6];
+            var binding = lookup_binding (key);
+            if (binding != null && binding.command == KeymapCommand.UPPER) {
+                lower_code = (unichar) binding.name[6];
                 return true;
             } else if (key.code.isupper()) {
                 lower_code = key.code.tolower();
@@ -136,10 +330,31 @@ namespace Skk {
         Regex numeric_ref_regex;
         internal Regex kuten_regex;
 
+        // Bumped on changes affecting the preedit which are not
+        // visible in the other fields of PreeditStamp.
+        internal uint serial = 0;
+
+        internal PreeditStamp get_preedit_stamp () {
+            var stamp = PreeditStamp ();
+            stamp.handler_type = handler_type;
+            stamp.serial = serial;
+            stamp.rom_kana_serial = rom_kana_converter.serial;
+            stamp.okuri_rom_kana_serial = okuri_rom_kana_converter.serial;
+            stamp.abbrev_len = abbrev.len;
+            stamp.kuten_len = kuten.len;
+            stamp.output_len = output.len;
+            stamp.cursor_pos = candidates.cursor_pos;
+            stamp.okuri = okuri;
+            stamp.surrounding_end = surrounding_end;
+            stamp.auto_start_henkan_keyword = auto_start_henkan_keyword;
+            return stamp;
+        }
+
         internal State (Gee.List<Dict> dictionaries) {
             this.dictionaries = dictionaries;
             this.candidates = new SimpleCandidateList ();
             this.candidates.selected.connect (candidate_selected);
+            this.candidates.populated.connect (() => { serial++; });
 
             rom_kana_converter = new RomKanaConverter ();
             okuri_rom_kana_converter = new RomKanaConverter ();
@@ -208,14 +423,14 @@ namespace Skk {
 
         internal void reset () {
             // output and input_mode won't change
-            handler_type = typeof (NoneStateHandler);
+            handler_type = StateHandlerType.NONE;
             rom_kana_converter.reset ();
             okuri_rom_kana_converter.reset ();
             okuri = false;
             _typing_rule.get_filter ().reset ();
-            completion_iterator = null;
-            completion_set.clear ();
-            completion.clear ();
+            cancel_completion ();
+            cancel_prefetch ();
+            end_completion ();
             candidates.clear ();
             abbrev.erase ();
             kuten.erase ();
@@ -223,10 +438,11 @@ namespace Skk {
             auto_start_henkan_keyword = null;
             surrounding_text = null;
             surrounding_end = 0;
+            serial++;
         }
 
         internal void cancel_okuri () {
-            rom_kana_converter.output += okuri_rom_kana_converter.output;
+            rom_kana_converter.append_output (okuri_rom_kana_converter.output);
             okuri_rom_kana_converter.reset ();
             okuri = false;
         }
@@ -332,7 +548,11 @@ namespace Skk {
         }
 
         internal void lookup (string midasi, bool okuri = false) {
-            candidates.clear ();
+            prefetch_consumed = false;
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
+            candidates.add_candidates_start ();
             int[] numerics = new int[0];
             lookup_internal (midasi, numerics, okuri);
             var numeric_midasi = extract_numerics (midasi, out numerics);
@@ -340,14 +560,33 @@ namespace Skk {
                 lookup_internal (numeric_midasi, numerics, okuri);
             }
             candidates.add_candidates_end ();
+            if (prefetch_enabled && lookup_stats != null) {
+                if (prefetch_consumed) {
+                    lookup_stats.prefetch_hits++;
+                } else {
+                    lookup_stats.prefetch_misses++;
+                }
+            }
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "State.lookup",
+                        "midasi=%d okuri=%d candidates=%d",
+                        (int) midasi.char_count (), (int) okuri,
+                        candidates.size);
+#endif
         }
 
         void lookup_internal (string midasi,
                               int[] numerics,
                               bool okuri = false)
         {
-            foreach (var dict in dictionaries) {
-                var _candidates = dict.lookup (midasi, okuri);
+            var merged = new ArrayList<Candidate> ();
+            // merge in the order of dictionaries, whichever answered
+            // first
+            foreach (var task in lookup_dictionaries (midasi, okuri)) {
+                if (task.expired) {
+                    continue;
+                }
+                var _candidates = task.candidates;
                 foreach (var candidate in _candidates) {
                     var text = candidate.text;
                     text = expand_expr (text);
@@ -359,11 +598,211 @@ namespace Skk {
                             candidate.annotation);
                     }
                 }
-                candidates.add_candidates (_candidates);
+                if (learning == null) {
+                    candidates.add_candidates (_candidates);
+                } else {
+                    foreach (var candidate in _candidates) {
+                        merged.add (candidate);
+                    }
+                }
+            }
+            if (learning != null) {
+                learning.rank (merged);
+                candidates.add_candidates (merged.to_array ());
+            }
+        }
+
+        Gee.List<LookupTask> lookup_dictionaries (string midasi, bool okuri) {
+            var tasks = new ArrayList<LookupTask> ();
+
+            // take over the prefetched lookups if they match
+            var prefetched = new HashMap<Dict,LookupTask> ();
+            LookupBatch? batch = null;
+            if (midasi == prefetch_midasi && okuri == prefetch_okuri) {
+                foreach (var task in prefetch_tasks) {
+                    prefetched.set (task.dict, task);
+                }
+                batch = prefetch_batch;
+                prefetch_tasks = new ArrayList<LookupTask> ();
+                prefetch_batch = null;
+                prefetch_midasi = null;
+            } else {
+                cancel_prefetch ();
+            }
+
+            if (!parallel_lookup && prefetched.is_empty) {
+                foreach (var dict in dictionaries) {
+                    var task = new LookupTask (dict, midasi, okuri, null);
+                    task.run ();
+                    tasks.add (task);
+                }
+                return tasks;
+            }
+
+            if (batch == null) {
+                batch = new LookupBatch ();
+            }
+            var pushed = new ArrayList<LookupTask> ();
+            var deferred = new ArrayList<LookupTask> ();
+            foreach (var dict in dictionaries) {
+                var task = prefetched.get (dict);
+                if (task != null) {
+                    pushed.add (task);
+                    prefetch_consumed = true;
+                } else if (parallel_lookup &&
+                           LookupTask.can_run_in_worker (dict)) {
+                    task = new LookupTask (dict, midasi, okuri, batch);
+                    if (task.push ()) {
+                        pushed.add (task);
+                    } else if (dict is SkkServ && lookup_timeout > 0) {
+                        // the connection is held by an earlier lookup,
+                        // typically a prefetch of a shorter reading;
+                        // queue this one once it is released
+                        deferred.add (task);
+                    } else {
+                        // run it here; SkkServ waits for the
+                        // connection to be released
+                        task.batch = null;
+                    }
+                } else {
+                    task = new LookupTask (dict, midasi, okuri, null);
+                }
+                tasks.add (task);
+            }
+
+            // query the other dictionaries while the workers run
+            foreach (var task in tasks) {
+                if (task.batch == null) {
+                    task.run ();
+                }
+            }
+
+            int64 deadline = 0;
+            if (lookup_timeout > 0) {
+                deadline = get_monotonic_time () +
+                    (int64) lookup_timeout * 1000;
+            }
+            foreach (var task in deferred) {
+                if (task.push (deadline)) {
+                    pushed.add (task);
+                } else {
+                    debug ("lookup of %s in busy %s timed out",
+                           midasi, task.dict.get_type ().name ());
+                    task.expired = true;
+                }
+            }
+            batch.mutex.lock ();
+            foreach (var task in pushed) {
+                while (!task.done) {
+                    if (lookup_timeout == 0) {
+                        batch.cond.wait (batch.mutex);
+                    } else if (!batch.cond.wait_until (batch.mutex,
+                                                       deadline)) {
+                        break;
+                    }
+                }
+                if (!task.done) {
+                    debug ("lookup of %s in %s timed out",
+                           midasi, task.dict.get_type ().name ());
+                    task.expired = true;
+                }
+            }
+            batch.mutex.unlock ();
+            return tasks;
+        }
+
+        // Reading which the next lookup will most likely use, or
+        // null if none can be guessed yet.
+        string? get_prefetch_midasi (out bool okuri) {
+            okuri = this.okuri;
+            if (abbrev.len > 0 || !rom_kana_converter.has_output) {
+                return null;
+            }
+            var builder = new StringBuilder ();
+            builder.append (Util.get_hiragana (rom_kana_converter.output));
+            if (rom_kana_converter.preedit == "n") {
+                builder.append ("ん");
+            }
+            if (this.okuri) {
+                // okuri-ari: once the first okuri key is typed, the
+                // prefix is known
+                if (okuri_rom_kana_converter.has_output) {
+                    var prefix = Util.get_okurigana_prefix (
+                        Util.get_hiragana (okuri_rom_kana_converter.output));
+                    if (prefix == null) {
+                        return null;
+                    }
+                    builder.append (prefix);
+                } else if (okuri_rom_kana_converter.has_preedit) {
+                    builder.append_c (okuri_rom_kana_converter.preedit[0]);
+                } else {
+                    return null;
+                }
+            }
+            return builder.str;
+        }
+
+        // Start looking up the current reading in background, so
+        // the lookup on conversion finds the results ready.  Only
+        // dictionaries which can run on worker threads are
+        // prefetched.
+        internal void prefetch () {
+            if (!prefetch_enabled ||
+                handler_type != StateHandlerType.START) {
+                return;
+            }
+            bool _okuri;
+            var midasi = get_prefetch_midasi (out _okuri);
+            if (midasi == prefetch_midasi && _okuri == prefetch_okuri) {
+                return;
+            }
+            cancel_prefetch ();
+            if (midasi == null) {
+                return;
+            }
+            prefetch_midasi = midasi;
+            prefetch_okuri = _okuri;
+            prefetch_batch = new LookupBatch ();
+            foreach (var dict in dictionaries) {
+                if (LookupTask.can_run_in_worker (dict)) {
+                    var task = new LookupTask (dict, midasi, _okuri,
+                                               prefetch_batch);
+                    if (task.push ()) {
+                        prefetch_tasks.add (task);
+                    }
+                }
+            }
+        }
+
+        // Drop the prefetched lookup; queued tasks are skipped, running
+        // ones finish in background and their results are discarded.
+        internal void cancel_prefetch () {
+            if (prefetch_batch != null) {
+                prefetch_batch.mutex.lock ();
+                foreach (var task in prefetch_tasks) {
+                    task.cancelled = true;
+                }
+                prefetch_batch.mutex.unlock ();
+            }
+            prefetch_tasks.clear ();
+            prefetch_batch = null;
+            prefetch_midasi = null;
+        }
+
+        internal void invalidate_completion () {
+            if (normal_completion_service != null) {
+                normal_completion_service.invalidate ();
+            }
+            if (abbrev_completion_service != null) {
+                abbrev_completion_service.invalidate ();
             }
         }
 
         internal void purge_candidate (Candidate candidate) {
+            invalidate_completion ();
+            if (learning != null) {
+                learning.forget (candidate);
+            }
             foreach (var dict in dictionaries) {
                 if (!dict.read_only) {
                     dict.purge_candidate (candidate);
@@ -400,18 +839,38 @@ namespace Skk {
                 }
             }
 
+            cancel_completion();
             completion.clear();
-            completion_set.clear();
+            completion_iterator = null;
+            completion_text = midasi;
 
-            var service = (handler_type == typeof(AbbrevStateHandler)) ?
+            var service = (handler_type == StateHandlerType.ABBREV) ?
                 abbrev_completion_service : normal_completion_service;
-
-            var completions = service.get_completions(midasi);
-            foreach (string word in completions) {
-                if (completion_set.add(word)) {
-                    completion.add(word);
-                }
-            }
+            service.learning = learning;
+
+            if (service.has_remote_sources) {
+                // Local results are delivered through
+                // update_completion before this returns.
+                var cancellable = new Cancellable();
+                completion_cancellable = cancellable;
+                service.get_completions_async.begin(
+                    midasi, -1, cancellable, update_completion,
+                    (obj, res) => {
+                        try {
+                            service.get_completions_async.end(res);
+                        } catch (IOError.CANCELLED e) {
+                        } catch (GLib.Error e) {
+                            warning("completion failed: %s", e.message);
+                        }
+                        if (completion_cancellable == cancellable) {
+                            completion_cancellable = null;
+                        }
+                    });
+                return;
+            }
+
+            // the service returns unique words
+            completion.add_all_array(service.get_completions(midasi));
 
             completion_iterator = completion.bidir_list_iterator();
             if (!completion_iterator.first()) {
@@ -419,6 +878,88 @@ namespace Skk {
             }
         }
 
+        internal void cancel_completion () {
+            if (completion_cancellable != null) {
+                completion_cancellable.cancel ();
+                completion_cancellable = null;
+            }
+        }
+
+        void end_completion () {
+            cancel_completion ();
+            completion_iterator = null;
+            completion.clear ();
+            completion_text = null;
+        }
+
+        // Take the next word from the completion list, remembering it
+        // so that typing after it is seen as extending the prefix.
+        internal string? completion_next () {
+            if (completion_iterator == null) {
+                return null;
+            }
+            string midasi = completion_iterator.get ();
+            completion_text = midasi;
+            if (completion_iterator.has_next ()) {
+                completion_iterator.next ();
+            }
+            return midasi;
+        }
+
+        // Called after a key other than COMPLETE is handled.  If the
+        // prefix has been extended, the completion is restarted so
+        // that the service can narrow its cached list; if it has been
+        // changed otherwise, the completion ends.
+        internal void update_completion_prefix () {
+            if (completion_text == null) {
+                return;
+            }
+            string text;
+            if (handler_type == StateHandlerType.ABBREV) {
+                text = abbrev.str;
+            } else if (handler_type == StateHandlerType.START) {
+                text = rom_kana_converter.output;
+            } else {
+                end_completion ();
+                return;
+            }
+            if (text == completion_text) {
+                return;
+            }
+            if (text.has_prefix (completion_text)) {
+                completion_start (text);
+            } else {
+                end_completion ();
+            }
+        }
+
+        // Replace the completion list, keeping the iterator on the
+        // word which would have been shown next.
+        void update_completion (string[] completions) {
+            string? next = null;
+            if (completion_iterator != null) {
+                next = completion_iterator.get ();
+            }
+
+            completion.clear ();
+            completion.add_all_array (completions);
+            completion_iterator = completion.bidir_list_iterator ();
+            if (!completion_iterator.first ()) {
+                completion_iterator = null;
+            } else if (next != null) {
+                while (completion_iterator.get () != next &&
+                       completion_iterator.has_next ()) {
+                    completion_iterator.next ();
+                }
+                if (completion_iterator.get () != next) {
+                    completion_iterator.first ();
+                }
+            }
+            completions_updated (completions);
+        }
+
+        internal signal void completions_updated (string[] completions);
+
         internal signal bool recursive_edit_abort ();
         internal signal bool recursive_edit_end (string text);
         internal signal void recursive_edit_start (string yomi);
@@ -475,6 +1016,16 @@ namespace Skk {
 
     delegate bool CommandHandler (State state);
 
+    // Index of a StateHandler in the handler table of Context.
+    enum StateHandlerType {
+        NONE,
+        START,
+        SELECT,
+        ABBREV,
+        KUTEN,
+        LAST
+    }
+
     abstract class StateHandler : Object {
         internal abstract bool process_key_event (State state, ref KeyEvent key);
         internal abstract string get_preedit (State state,
@@ -483,46 +1034,56 @@ namespace Skk {
         internal virtual string get_output (State state) {
             return state.output.str;
         }
-    }
 
-    // We can't use Entry<*,InputMode> here because of Vala bug:
-    // https://bugzilla.gnome.org/show_bug.cgi?id=684262
-    struct InputModeCommandEntry {
-        string key;
-        InputMode value;
+        // Input mode a set-input-mode-* command switches to.
+        internal static InputMode get_input_mode (KeymapCommand command) {
+            switch (command) {
+            case KeymapCommand.SET_INPUT_MODE_HIRAGANA:
+                return InputMode.HIRAGANA;
+            case KeymapCommand.SET_INPUT_MODE_KATAKANA:
+                return InputMode.KATAKANA;
+            case KeymapCommand.SET_INPUT_MODE_HANKAKU_KATAKANA:
+                return InputMode.HANKAKU_KATAKANA;
+            case KeymapCommand.SET_INPUT_MODE_LATIN:
+                return InputMode.LATIN;
+            case KeymapCommand.SET_INPUT_MODE_WIDE_LATIN:
+                return InputMode.WIDE_LATIN;
+            default:
+                assert_not_reached ();
+            }
+        }
+
+        // Kana inserted by the insert-kana-* command bound to key.
+        internal static string get_insert_kana (State state, KeyEvent key) {
+            var command = state.lookup_key (key);
+            return command["insert-kana-".length:command.length];
+        }
     }
 
     class NoneStateHandler : StateHandler {
-        const InputModeCommandEntry[] input_mode_commands = {
-            { "set-input-mode-hiragana", InputMode.HIRAGANA },
-            { "set-input-mode-katakana", InputMode.KATAKANA },
-            { "set-input-mode-hankaku-katakana", InputMode.HANKAKU_KATAKANA },
-            { "set-input-mode-latin", InputMode.LATIN },
-            { "set-input-mode-wide-latin", InputMode.WIDE_LATIN }
-        };
-
         internal override bool process_key_event (State state,
                                                   ref KeyEvent key)
         {
-            var command = state.lookup_key (key);
+            var command = state.lookup_command (key);
 
             // if no command nor code is assigned to key, we can't proceed
-            if (command == null && key.code == 0)
+            if (command == KeymapCommand.NONE && key.code == 0)
                 return false;
 
+            switch (command) {
             // check abort and commit event
-            if (command == "abort" ||
-                command == "abort-to-latin" ||
-                command == "abort-to-latin-unhandled") {
+            case KeymapCommand.ABORT:
+            case KeymapCommand.ABORT_TO_LATIN:
+            case KeymapCommand.ABORT_TO_LATIN_UNHANDLED:
                 // whether or not something (will be) changed by the command
                 bool something_changed;
-                if (state.rom_kana_converter.preedit.length > 0) {
+                if (state.rom_kana_converter.has_preedit) {
                     something_changed = true;
                 } else {
                     something_changed = state.recursive_edit_abort ();
                 }
                 state.reset ();
-                if (something_changed || command == "abort") {
+                if (something_changed || command == KeymapCommand.ABORT) {
                     // if the command changes the state (other than input mode),
                     // it is expected to work as simple "abort" this time.
                     return something_changed;
@@ -534,9 +1095,9 @@ namespace Skk {
                 }
                 // abort-to-latin command should consume (handle) the key event
                 // on mode-only changes. abort-to-latin-unhandled should not.
-                return command == "abort-to-latin";
-            } else if (command == "commit" ||
-                       command == "commit-unhandled") {
+                return command == KeymapCommand.ABORT_TO_LATIN;
+            case KeymapCommand.COMMIT:
+            case KeymapCommand.COMMIT_UNHANDLED:
                 bool handled;
                 if (state.output.str.length == 0) {
                     handled = state.recursive_edit_abort ();
@@ -545,9 +1106,9 @@ namespace Skk {
                     handled = state.recursive_edit_end (state.output.str);
                 }
                 state.reset ();
-                return command == "commit" ? true : handled;
-            } else if (command == "start-preedit" ||
-                       command == "start-preedit-kana") {
+                return command == KeymapCommand.COMMIT ? true : handled;
+            case KeymapCommand.START_PREEDIT:
+            case KeymapCommand.START_PREEDIT_KANA:
                 string? text;
                 uint cursor_pos;
                 if (state.retrieve_surrounding_text (out text,
@@ -555,33 +1116,33 @@ namespace Skk {
                     state.surrounding_text = new UnicodeString (
                         text[text.index_of_nth_char (cursor_pos):text.length]);
                     state.surrounding_end = 0;
+                    state.serial++;
                     state.delete_surrounding_text (
                         0, state.surrounding_text.length);
                 }
-                state.handler_type = typeof (StartStateHandler);
+                state.handler_type = StateHandlerType.START;
                 return true;
-            } else if (command == "start-preedit-no-delete") {
-                state.handler_type = typeof (StartStateHandler);
+            case KeymapCommand.START_PREEDIT_NO_DELETE:
+                state.handler_type = StateHandlerType.START;
                 return true;
-            }
             // check mode switch events
-            if (command != null && command.has_prefix ("set-input-mode-") &&
-                !((state.input_mode == InputMode.HIRAGANA ||
-                   state.input_mode == InputMode.KATAKANA ||
-                   state.input_mode == InputMode.HANKAKU_KATAKANA) &&
-                  key.modifiers == 0 &&
-                  state.rom_kana_converter.can_consume (key.code))) {
-                foreach (var entry in input_mode_commands) {
-                    if (entry.key == command) {
-                        state.rom_kana_converter.output_nn_if_any ();
-                        state.input_mode = entry.value;
-                        return true;
-                    }
+            case KeymapCommand.SET_INPUT_MODE_HIRAGANA:
+            case KeymapCommand.SET_INPUT_MODE_KATAKANA:
+            case KeymapCommand.SET_INPUT_MODE_HANKAKU_KATAKANA:
+            case KeymapCommand.SET_INPUT_MODE_LATIN:
+            case KeymapCommand.SET_INPUT_MODE_WIDE_LATIN:
+                if (!((state.input_mode == InputMode.HIRAGANA ||
+                       state.input_mode == InputMode.KATAKANA ||
+                       state.input_mode == InputMode.HANKAKU_KATAKANA) &&
+                      key.modifiers == 0 &&
+                      state.rom_kana_converter.can_consume (key.code))) {
+                    state.rom_kana_converter.output_nn_if_any ();
+                    state.input_mode = get_input_mode (command);
+                    return true;
                 }
-            }
-
+                break;
             // check editing events
-            if (command == "delete") {
+            case KeymapCommand.DELETE:
                 if (state.rom_kana_converter.delete ()) {
                     return true;
                 }
@@ -592,13 +1153,13 @@ namespace Skk {
                     return true;
                 }
                 return false;
-            }
-
-            if (command == "register") {
+            case KeymapCommand.REGISTER:
                 state.request_selection_text();
                 state.output.append(state.selection.str);
                 state.selection.erase();
                 return true;
+            default:
+                break;
             }
 
             switch (state.input_mode) {
@@ -606,32 +1167,32 @@ namespace Skk {
             case InputMode.KATAKANA:
             case InputMode.HANKAKU_KATAKANA:
                 unichar lower_code = 0;
-                if ((command != null || key.modifiers == 0) &&
+                if ((command != KeymapCommand.NONE || key.modifiers == 0) &&
                     state.isupper (key, out lower_code) &&
                     state.rom_kana_converter.is_valid (lower_code)) {
                     state.rom_kana_converter.output_nn_if_any ();
                     state.output.append (state.rom_kana_converter.output);
                     state.rom_kana_converter.output = "";
-                    state.handler_type = typeof (StartStateHandler);
+                    state.handler_type = StateHandlerType.START;
                     return false;
                 }
                 else if (key.modifiers == 0 &&
                          !state.rom_kana_converter.can_consume (key.code,
                                                                 true)) {
-                    if (command == "abbrev") {
-                        state.handler_type = typeof (AbbrevStateHandler);
+                    if (command == KeymapCommand.ABBREV) {
+                        state.handler_type = StateHandlerType.ABBREV;
                         return true;
                     }
-                    else if (command == "kuten") {
-                        state.handler_type = typeof (KutenStateHandler);
+                    else if (command == KeymapCommand.KUTEN) {
+                        state.handler_type = StateHandlerType.KUTEN;
                         return true;
                     }
                 }
-                if (command != null && command.has_prefix ("insert-kana-")) {
-                    var kana = Util.convert_by_input_mode (
-                        command["insert-kana-".length:command.length],
+                if (command == KeymapCommand.INSERT_KANA) {
+                    Util.append_by_input_mode (
+                        state.output,
+                        get_insert_kana (state, key),
                         state.input_mode);
-                    state.output.append (kana);
                     return true;
                 }
                 if (key.modifiers == 0) {
@@ -820,33 +1381,36 @@ namespace Skk {
                                                   ref KeyEvent key)
         {
             MatchInfo kuten_match_info = null;
-            var command = state.lookup_key (key);
-            if (command == "abort" ||
-                command == "abort-to-latin" ||
-                command == "abort-to-latin-unhandled") {
+            switch (state.lookup_command (key)) {
+            case KeymapCommand.ABORT:
+            case KeymapCommand.ABORT_TO_LATIN:
+            case KeymapCommand.ABORT_TO_LATIN_UNHANDLED:
                 state.reset ();
                 return true;
-            }
-            else if (command == "commit-unhandled" &&
-                     is_committable (state, out kuten_match_info)) {
-                // if committable, `is_committable()` returns the match info.
-                assert(kuten_match_info != null);
-
-                var parsed = parse_kuten(state, kuten_match_info);
-                if (parsed != null) {
-                    state.output.append (parsed);
+            case KeymapCommand.COMMIT_UNHANDLED:
+                if (is_committable (state, out kuten_match_info)) {
+                    // if committable, `is_committable()` returns the match info.
+                    assert(kuten_match_info != null);
+
+                    var parsed = parse_kuten(state, kuten_match_info);
+                    if (parsed != null) {
+                        state.output.append (parsed);
+                    }
+                    state.reset ();
+                    return true;
                 }
-                state.reset ();
-                return true;
-            }
-            else if (command == "delete" &&
-                     state.kuten.len > 0) {
-                state.kuten.truncate (state.kuten.len - 1);
-                return true;
+                break;
+            case KeymapCommand.DELETE:
+                if (state.kuten.len > 0) {
+                    state.kuten.truncate (state.kuten.len - 1);
+                    return true;
+                }
+                break;
+            default:
+                break;
             }
-            else if (key.modifiers == 0 &&
-                     append_if_acceptable (state, key.code)) {
-                return true;
+            if (key.modifiers == 0) {
+                append_if_acceptable (state, key.code);
             }
             return true;
         }
@@ -872,64 +1436,63 @@ namespace Skk {
         internal override bool process_key_event (State state,
                                                   ref KeyEvent key)
         {
-            var command = state.lookup_key (key);
-            if (command == "abort" ||
-                command == "abort-to-latin" ||
-                command == "abort-to-latin-unhandled") {
+            var command = state.lookup_command (key);
+            switch (command) {
+            case KeymapCommand.ABORT:
+            case KeymapCommand.ABORT_TO_LATIN:
+            case KeymapCommand.ABORT_TO_LATIN_UNHANDLED:
                 state.reset ();
                 return true;
-            }
-            else if (command == "next-candidate") {
-                state.handler_type = typeof (SelectStateHandler);
+            case KeymapCommand.NEXT_CANDIDATE:
+                state.handler_type = StateHandlerType.SELECT;
                 return false;
+            default:
+                break;
             }
-            else if ((key.modifiers & ModifierType.CONTROL_MASK) != 0 &&
-                     key.code == 'q') {
+            if ((key.modifiers & ModifierType.CONTROL_MASK) != 0 &&
+                key.code == 'q') {
                 state.output.assign (
                     Util.get_wide_latin (state.abbrev.str));
                 state.reset ();
                 return true;
             }
-            else if (command == "delete") {
+            switch (command) {
+            case KeymapCommand.DELETE:
                 if (state.abbrev.len > 0) {
                     state.abbrev.truncate (state.abbrev.len - 1);
                 } else {
                     state.reset ();
                 }
                 return true;
-            }
-            else if (command == "commit") {
+            case KeymapCommand.COMMIT:
                 state.output.assign (state.abbrev.str);
                 state.reset ();
                 return true;
-            }
-            else if (command == "commit-unhandled") {
+            case KeymapCommand.COMMIT_UNHANDLED:
                 state.output.assign (state.abbrev.str);
                 state.reset ();
                 return state.egg_like_newline;
-            }
-            else if (command == "register") {
+            case KeymapCommand.REGISTER:
                 state.request_selection_text();
                 state.abbrev.append(state.selection.str);
                 state.selection.erase();
                 return true;
-            }
-            else if (command == "complete") {
+            case KeymapCommand.COMPLETE:
                 if (state.completion_iterator == null) {
                     state.completion_start (state.abbrev.str);
                 }
-                if (state.completion_iterator != null) {
-                    string midasi = state.completion_iterator.get ();
+                string? midasi = state.completion_next ();
+                if (midasi != null) {
                     state.abbrev.assign (midasi);
-                    if (state.completion_iterator.has_next ()) {
-                        state.completion_iterator.next ();
-                    }
+                    state.serial++;
                 }
+                return true;
+            default:
+                break;
             }
-            else if (key.modifiers == 0 &&
-                     0x20 <= key.code && key.code <= 0x7E) {
+            if (key.modifiers == 0 &&
+                0x20 <= key.code && key.code <= 0x7E) {
                 state.abbrev.append_unichar (key.code);
-                return true;
             }
             return true;
         }
@@ -943,49 +1506,40 @@ namespace Skk {
     }
 
     class StartStateHandler : StateHandler {
-        const InputModeCommandEntry[] end_preedit_commands = {
-            { "set-input-mode-hiragana", InputMode.HIRAGANA },
-            { "set-input-mode-katakana", InputMode.KATAKANA },
-            { "set-input-mode-hankaku-katakana", InputMode.HANKAKU_KATAKANA }
-        };
-
         internal override bool process_key_event (State state,
                                                   ref KeyEvent key)
         {
-            var command = state.lookup_key (key);
+            var command = state.lookup_command (key);
 
             // if no command nor code is assigned to key, we can't proceed
-            if (command == null && key.code == 0)
+            if (command == KeymapCommand.NONE && key.code == 0)
                 return true;
 
-            if (command == "abort" ||
-                command == "abort-to-latin" ||
-                command == "abort-to-latin-unhandled") {
+            switch (command) {
+            case KeymapCommand.ABORT:
+            case KeymapCommand.ABORT_TO_LATIN:
+            case KeymapCommand.ABORT_TO_LATIN_UNHANDLED:
                 state.reset ();
                 return true;
-            }
-
             // ▽ひらがな + 'q' => ヒラガナ
             // which should not change input mode (Issue#8)
-            foreach (var entry in end_preedit_commands) {
-                if (entry.key == command) {
-                    state.rom_kana_converter.output_nn_if_any ();
-                    state.output.append (
-                        Util.convert_by_input_mode (
-                            state.rom_kana_converter.output,
-                            entry.value));
-                    if (state.surrounding_text != null) {
-                        state.output.append (state.surrounding_text.substring (
-                                                 state.surrounding_end));
-                    }
-                    state.rom_kana_converter.reset ();
-                    state.handler_type = typeof (NoneStateHandler);
-                    return true;
+            case KeymapCommand.SET_INPUT_MODE_HIRAGANA:
+            case KeymapCommand.SET_INPUT_MODE_KATAKANA:
+            case KeymapCommand.SET_INPUT_MODE_HANKAKU_KATAKANA:
+                state.rom_kana_converter.output_nn_if_any ();
+                Util.append_by_input_mode (
+                    state.output,
+                    state.rom_kana_converter.output,
+                    get_input_mode (command));
+                if (state.surrounding_text != null) {
+                    state.output.append (state.surrounding_text.substring (
+                                             state.surrounding_end));
                 }
-            }
-
-            if (command == "next-candidate") {
-                if (state.rom_kana_converter.output.length == 0) {
+                state.rom_kana_converter.reset ();
+                state.handler_type = StateHandlerType.NONE;
+                return true;
+            case KeymapCommand.NEXT_CANDIDATE:
+                if (!state.rom_kana_converter.has_output) {
                     if (state.surrounding_text != null) {
                         state.output.append (state.surrounding_text.substring (
                                                  state.surrounding_end));
@@ -993,30 +1547,21 @@ namespace Skk {
                     state.reset ();
                     return true;
                 }
-                state.handler_type = typeof (SelectStateHandler);
+                state.handler_type = StateHandlerType.SELECT;
                 return false;
-            }
-            else if (command == "commit") {
+            case KeymapCommand.COMMIT:
+            case KeymapCommand.COMMIT_UNHANDLED:
                 state.output.append (state.rom_kana_converter.output);
                 if (state.surrounding_text != null) {
                     state.output.append (state.surrounding_text.substring (
                                              state.surrounding_end));
                 }
                 state.reset ();
-                return true;
-            }
-            else if (command == "commit-unhandled") {
-                state.output.append (state.rom_kana_converter.output);
-                if (state.surrounding_text != null) {
-                    state.output.append (state.surrounding_text.substring (
-                                             state.surrounding_end));
-                }
-                state.reset ();
-                return state.egg_like_newline;
-            }
-            else if (command == "delete") {
+                return command == KeymapCommand.COMMIT ?
+                    true : state.egg_like_newline;
+            case KeymapCommand.DELETE:
                 if (state.okuri_rom_kana_converter.delete ()) {
-                    if (state.okuri_rom_kana_converter.preedit.length == 0) {
+                    if (!state.okuri_rom_kana_converter.has_preedit) {
                         state.okuri = false;
                     }
                     return true;
@@ -1030,27 +1575,22 @@ namespace Skk {
                             state.output.str.char_count () - 1));
                     return true;
                 }
-                state.handler_type = typeof (NoneStateHandler);
+                state.handler_type = StateHandlerType.NONE;
                 return true;
-            }
-            else if (command == "complete") {
+            case KeymapCommand.COMPLETE:
                 if (state.completion_iterator == null) {
                     state.completion_start (state.rom_kana_converter.output);
                 }
-                if (state.completion_iterator != null) {
-                    string midasi = state.completion_iterator.get ();
+                string? midasi = state.completion_next ();
+                if (midasi != null) {
                     state.rom_kana_converter.reset ();
                     state.rom_kana_converter.output = midasi;
-                    if (state.completion_iterator.has_next ()) {
-                        state.completion_iterator.next ();
-                    }
                 }
                 return true;
-            }
-            else if (command == "special-midasi") {
-                if (state.rom_kana_converter.output.length > 0) {
+            case KeymapCommand.SPECIAL_MIDASI:
+                if (state.rom_kana_converter.has_output) {
                     state.rom_kana_converter.append (key.code.tolower ());
-                    state.handler_type = typeof (SelectStateHandler);
+                    state.handler_type = StateHandlerType.SELECT;
                     key = state.where_is ("next-candidate");
                     return false;
                 }
@@ -1058,32 +1598,28 @@ namespace Skk {
                     state.rom_kana_converter.append (key.code);
                     return true;
                 }
-            }
-            else if (command != null && command.has_prefix ("insert-kana-")) {
+            case KeymapCommand.INSERT_KANA:
                 var kana = Util.convert_by_input_mode (
-                    command["insert-kana-".length:command.length],
+                    get_insert_kana (state, key),
                     state.input_mode);
                 if (state.okuri) {
                     state.okuri_rom_kana_converter.output = kana;
-                    state.handler_type = typeof (SelectStateHandler);
+                    state.handler_type = StateHandlerType.SELECT;
                     key = state.where_is ("next-candidate");
                     return false;
                 } else {
-                    state.rom_kana_converter.output += kana;
+                    state.rom_kana_converter.append_output (kana);
                     return true;
                 }
-            }
-            else if (command == "start-preedit") {
+            case KeymapCommand.START_PREEDIT:
                 return true;
-            }
-            else if (command == "start-preedit-kana" ||
-                     command == "start-preedit-no-delete") {
-                if (state.rom_kana_converter.output.length > 0) {
+            case KeymapCommand.START_PREEDIT_KANA:
+            case KeymapCommand.START_PREEDIT_NO_DELETE:
+                if (state.rom_kana_converter.has_output) {
                     state.okuri = true;
                 }
                 return true;
-            }
-            else if (command == "expand-preedit") {
+            case KeymapCommand.EXPAND_PREEDIT:
                 if (state.surrounding_text != null &&
                     state.surrounding_end < state.surrounding_text.length) {
                     state.surrounding_end++;
@@ -1092,8 +1628,8 @@ namespace Skk {
                             0, state.surrounding_end);
                     return true;
                 }
-            }
-            else if (command == "shrink-preedit") {
+                break;
+            case KeymapCommand.SHRINK_PREEDIT:
                 if (state.surrounding_text != null &&
                     state.surrounding_end > 0) {
                     state.surrounding_end--;
@@ -1102,22 +1638,24 @@ namespace Skk {
                             0, state.surrounding_end);
                     return true;
                 }
-            }
-            else if (command == "register") {
+                break;
+            case KeymapCommand.REGISTER:
                 state.request_selection_text();
-                state.rom_kana_converter.output += state.selection.str;
+                state.rom_kana_converter.append_output (state.selection.str);
                 state.selection.erase();
                 return true;
+            default:
+                break;
             }
 
             unichar lower_code;
             bool is_upper = state.isupper (key, out lower_code);
-            if ((command != null || key.modifiers == 0) &&
+            if ((command != KeymapCommand.NONE || key.modifiers == 0) &&
                 state.rom_kana_converter.is_valid (lower_code)) {
                 // okuri_rom_kana_converter is started or being started
                 if (state.okuri ||
                     (is_upper &&
-                     state.rom_kana_converter.output.length > 0 &&
+                     state.rom_kana_converter.has_output &&
                      !state.rom_kana_converter.can_consume (
                          lower_code, true))) {
                     if (!state.okuri &&
@@ -1131,8 +1669,8 @@ namespace Skk {
                     if (is_upper)
                         state.okuri_rom_kana_converter.output_nn_if_any ();
                     state.okuri_rom_kana_converter.append (lower_code);
-                    if (state.okuri_rom_kana_converter.preedit.length == 0) {
-                        state.handler_type = typeof (SelectStateHandler);
+                    if (!state.okuri_rom_kana_converter.has_preedit) {
+                        state.handler_type = StateHandlerType.SELECT;
                         key = state.where_is ("next-candidate");
                         return false;
                     }
@@ -1141,7 +1679,7 @@ namespace Skk {
                 else {
                     state.rom_kana_converter.append (lower_code);
                     if (check_auto_conversion (state, key)) {
-                        state.handler_type = typeof (SelectStateHandler);
+                        state.handler_type = StateHandlerType.SELECT;
                         key = state.where_is ("next-candidate");
                         return false;
                     }
@@ -1151,7 +1689,7 @@ namespace Skk {
             else if (key.modifiers == 0) {
                 state.rom_kana_converter.append (lower_code);
                 if (check_auto_conversion (state, key)) {
-                    state.handler_type = typeof (SelectStateHandler);
+                    state.handler_type = StateHandlerType.SELECT;
                     key = state.where_is ("next-candidate");
                     return false;
                 }
@@ -1179,11 +1717,13 @@ namespace Skk {
 
         bool check_auto_conversion (State state, KeyEvent key) {
             foreach (var keyword in state.auto_start_henkan_keywords) {
-                if (state.rom_kana_converter.output.length > keyword.length &&
+                if (state.rom_kana_converter.output_length > keyword.length &&
                     state.rom_kana_converter.output.has_suffix (keyword)) {
                     state.auto_start_henkan_keyword = keyword;
-                    state.rom_kana_converter.output = state.rom_kana_converter.output[0:-keyword.length];
-                    state.handler_type = typeof (SelectStateHandler);
+                    state.rom_kana_converter.truncate_output (
+                        state.rom_kana_converter.output_length -
+                        keyword.length);
+                    state.handler_type = StateHandlerType.SELECT;
                     return true;
                 }
             }
@@ -1195,31 +1735,30 @@ namespace Skk {
         internal override bool process_key_event (State state,
                                                   ref KeyEvent key)
         {
-            var command = state.lookup_key (key);
+            var command = state.lookup_command (key);
 
             // if no command nor code is assigned to key, we can't proceed
-            if (command == null && key.code == 0)
+            if (command == KeymapCommand.NONE && key.code == 0)
                 return true;
 
-            if (command == "previous-candidate") {
+            switch (command) {
+            case KeymapCommand.PREVIOUS_CANDIDATE:
                 if (!state.candidates.previous ()) {
                     state.candidates.clear ();
                     if (state.abbrev.len > 0) {
-                        state.handler_type = typeof (AbbrevStateHandler);
+                        state.handler_type = StateHandlerType.ABBREV;
                     }
                     else {
-                        state.handler_type = typeof (StartStateHandler);
+                        state.handler_type = StateHandlerType.START;
                     }
                 }
                 return true;
-            }
-            else if (command == "purge-candidate") {
+            case KeymapCommand.PURGE_CANDIDATE:
                 var candidate = state.candidates.get ();
                 state.purge_candidate (candidate);
                 state.reset ();
                 return true;
-            }
-            else if (command == "next-candidate") {
+            case KeymapCommand.NEXT_CANDIDATE:
                 if (state.candidates.cursor_pos < 0) {
                     state.lookup (state.get_midasi (), state.okuri);
                     if (state.candidates.size > 0) {
@@ -1234,28 +1773,26 @@ namespace Skk {
                 if (state.candidates.size == 0) {
                     state.candidates.clear ();
                     if (state.abbrev.len > 0) {
-                        state.handler_type = typeof (AbbrevStateHandler);
+                        state.handler_type = StateHandlerType.ABBREV;
                     }
                     else {
-                        state.handler_type = typeof (StartStateHandler);
+                        state.handler_type = StateHandlerType.START;
                     }
                 }
                 return true;
-            }
-            else if (command == "abort" ||
-                     command == "abort-to-latin" ||
-                     command == "abort-to-latin-unhandled") {
+            case KeymapCommand.ABORT:
+            case KeymapCommand.ABORT_TO_LATIN:
+            case KeymapCommand.ABORT_TO_LATIN_UNHANDLED:
                 state.candidates.clear ();
                 state.cancel_okuri ();
                 state.auto_start_henkan_keyword = null;
                 if (state.abbrev.len > 0) {
-                    state.handler_type = typeof (AbbrevStateHandler);
+                    state.handler_type = StateHandlerType.ABBREV;
                 } else {
-                    state.handler_type = typeof (StartStateHandler);
+                    state.handler_type = StateHandlerType.START;
                 }
                 return true;
-            }
-            else {
+            default:
                 string surrounding_after = "";
                 if (state.surrounding_text != null) {
                     surrounding_after = state.surrounding_text.substring (
@@ -1263,18 +1800,18 @@ namespace Skk {
                 }
                 state.candidates.select ();
                 state.output.append (surrounding_after);
-                if (command == "special-midasi") {
+                if (command == KeymapCommand.SPECIAL_MIDASI) {
                     state.candidates.clear ();
-                    state.handler_type = typeof (StartStateHandler);
+                    state.handler_type = StateHandlerType.START;
                     return false;
                 }
                 else {
                     state.reset ();
                     if ((key.modifiers == 0 &&
                          0x20 <= key.code && key.code <= 0x7E) ||
-                        command == "delete" ||
+                        command == KeymapCommand.DELETE ||
                          (!state.egg_like_newline &&
-                          command == "commit-unhandled")) {
+                          command == KeymapCommand.COMMIT_UNHANDLED)) {
                         return false;
                     }
                     else {
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+ * Copyright (C) 2011-2026 Red Hat, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if ENABLE_TRACING
+namespace Skk {
+    [CCode (has_target = false)]
+    delegate void TraceExitFunc ();
+    [CCode (cname = "atexit", cheader_filename = "stdlib.h")]
+    extern int atexit (TraceExitFunc func);
+
+    // Marks for the "tracing" build option, so that input lag can be
+    // correlated with the rest of the desktop.  A mark covers a span
+    // of time, from a Trace.now () value to the call of Trace.mark.
+    //
+    // Marks go to sysprof when the process runs under it, and to the
+    // capture file named by LIBSKK_TRACE_FILE if set, which can be
+    // opened with sysprof or read with SysprofCaptureReader.  The
+    // file is flushed at most once a second and at exit.
+    //
+    // Dictionaries mark their reload and save, and lookups are
+    // marked where libskk makes them, in LookupTask; a lookup an
+    // application calls directly is not marked.
+    //
+    // Call sites enclose Trace.now and Trace.mark in #if
+    // ENABLE_TRACING, so that nothing is left of them when the
+    // option is off.
+    class Trace {
+        const string GROUP = "libskk";
+        const int64 FLUSH_INTERVAL = 1000000000; // in nanoseconds
+
+        // Set once init has run; the rest is guarded by lock
+        // (writer), as marks come from the lookup threads as well.
+        static int initialized = 0;
+        static Sysprof.CaptureWriter? writer = null;
+        static int64 flushed_time = 0;
+
+        static void init () {
+            if (AtomicInt.get (ref initialized) != 0) {
+                return;
+            }
+            Sysprof.clock_init ();
+            Sysprof.collector_init ();
+            var filename = Environment.get_variable ("LIBSKK_TRACE_FILE");
+            if (filename != null) {
+                writer = new Sysprof.CaptureWriter (filename, 0);
+                if (writer == null) {
+                    warning ("can't open trace file %s", filename);
+                } else {
+                    atexit (flush);
+                }
+            }
+            AtomicInt.set (ref initialized, 1);
+        }
+
+        static void flush () {
+            lock (writer) {
+                if (writer != null) {
+                    writer.flush ();
+                }
+            }
+        }
+
+        internal static int64 now () {
+            // the clock is chosen by init
+            if (AtomicInt.get (ref initialized) == 0) {
+                lock (writer) {
+                    init ();
+                }
+            }
+            return Sysprof.clock_get_current_time ();
+        }
+
+        [PrintfFormat]
+        internal static void mark (int64 begin,
+                                   string name,
+                                   string format,
+                                   ...)
+        {
+            var end = now ();
+            var message = format.vprintf (va_list ());
+            lock (writer) {
+                Sysprof.collector_mark (begin, end - begin,
+                                        GROUP, name, message);
+                if (writer != null) {
+                    writer.add_mark (begin, -1, (int32) Posix.getpid (),
+                                     (uint64) (end - begin),
+                                     GROUP, name, message);
+                    // not on every mark, which would make a write
+                    // per keystroke
+                    if (end - flushed_time >= FLUSH_INTERVAL) {
+                        writer.flush ();
+                        flushed_time = end;
+                    }
+                }
+            }
+        }
+    }
+}
+#endif
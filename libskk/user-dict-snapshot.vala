@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+ * Copyright (C) 2011-2026 Red Hat, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+using Gee;
+
+namespace Skk {
+    // Binary copy of the entries of a user dictionary, written next
+    // to the text file when it is saved.  Loading it skips decoding
+    // and splitting every line; it is only used while the etag of the
+    // text file is the one recorded, so the text file stays the
+    // source of truth.
+    //
+    // Layout, all integers are 32-bit little endian and strings are
+    // a length followed by UTF-8 bytes:
+    //
+    //   "SKKUSR01"
+    //   etag of the text file
+    //   coding system of the text file, empty if none
+    //   number of okuri-ari entries
+    //   number of okuri-nasi entries
+    //   entries, okuri-ari first: midasi, number of candidates, and
+    //   text and annotation of each candidate; an annotation length
+    //   of 0xffffffff means no annotation
+    class UserDictSnapshot : Object {
+        const string MAGIC = "SKKUSR01";
+        const uint32 NO_STRING = 0xffffffff;
+
+        MappedMemory mem;
+        size_t offset;
+
+        internal static File get_file (File file) {
+            return File.new_for_path (file.get_path () + ".snapshot");
+        }
+
+        static void append_uint32 (ByteArray buffer, uint32 value) {
+            uint8 bytes[4] = {
+                (uint8) value,
+                (uint8) (value >> 8),
+                (uint8) (value >> 16),
+                (uint8) (value >> 24)
+            };
+            buffer.append (bytes);
+        }
+
+        static void append_string (ByteArray buffer, string? str) {
+            if (str == null) {
+                append_uint32 (buffer, NO_STRING);
+            } else {
+                append_uint32 (buffer, str.length);
+                buffer.append (str.data);
+            }
+        }
+
+        static void append_entries (ByteArray buffer,
+                                    Map<string,Gee.List<Candidate>> entries)
+        {
+            foreach (var entry in entries.entries) {
+                append_string (buffer, entry.key);
+                append_uint32 (buffer, entry.value.size);
+                foreach (var candidate in entry.value) {
+                    append_string (buffer, candidate.text);
+                    append_string (buffer, candidate.annotation);
+                }
+            }
+        }
+
+        // Write the snapshot of the entries just saved to file.
+        internal static void save (File file,
+                                   string etag,
+                                   string? coding,
+                                   Map<string,Gee.List<Candidate>> okuri_ari_entries,
+                                   Map<string,Gee.List<Candidate>> okuri_nasi_entries)
+            throws GLib.Error
+        {
+            var buffer = new ByteArray ();
+            buffer.append (MAGIC.data);
+            append_string (buffer, etag);
+            append_string (buffer, coding ?? "");
+            append_uint32 (buffer, okuri_ari_entries.size);
+            append_uint32 (buffer, okuri_nasi_entries.size);
+            append_entries (buffer, okuri_ari_entries);
+            append_entries (buffer, okuri_nasi_entries);
+            // as private as the text file
+#if VALA_0_16
+            get_file (file).replace_contents (buffer.data,
+                                              null,
+                                              false,
+                                              FileCreateFlags.PRIVATE,
+                                              null);
+#else
+            get_file (file).replace_contents ((string) buffer.data,
+                                              buffer.len,
+                                              null,
+                                              false,
+                                              FileCreateFlags.PRIVATE,
+                                              null);
+#endif
+        }
+
+        UserDictSnapshot (MappedMemory mem) {
+            this.mem = mem;
+            this.offset = 0;
+        }
+
+        uint32 read_uint32 () throws SkkDictError {
+            if (mem.length - offset < 4) {
+                throw new SkkDictError.MALFORMED_INPUT ("truncated snapshot");
+            }
+            uint8 *p = (uint8 *) mem.memory + offset;
+            offset += 4;
+            return ((uint32) p[3] << 24) | ((uint32) p[2] << 16) |
+                ((uint32) p[1] << 8) | (uint32) p[0];
+        }
+
+        string? read_string () throws SkkDictError {
+            var length = read_uint32 ();
+            if (length == NO_STRING) {
+                return null;
+            }
+            if (mem.length - offset < length) {
+                throw new SkkDictError.MALFORMED_INPUT ("truncated snapshot");
+            }
+            var str = ((string) ((char *) mem.memory + offset)).ndup (length);
+            offset += length;
+            if (!str.validate ()) {
+                throw new SkkDictError.MALFORMED_INPUT ("invalid string");
+            }
+            return str;
+        }
+
+        string read_non_null_string () throws SkkDictError {
+            var str = read_string ();
+            if (str == null) {
+                throw new SkkDictError.MALFORMED_INPUT ("missing string");
+            }
+            return str;
+        }
+
+        void read_entries (Map<string,Gee.List<Candidate>> entries,
+                           bool okuri,
+                           uint32 n_entries) throws SkkDictError
+        {
+            for (uint32 i = 0; i < n_entries; i++) {
+                var midasi = read_non_null_string ();
+                var n_candidates = read_uint32 ();
+                // each candidate takes at least 8 bytes
+                if ((mem.length - offset) / 8 < n_candidates) {
+                    throw new SkkDictError.MALFORMED_INPUT (
+                        "truncated snapshot");
+                }
+                var list = new ArrayList<Candidate> ();
+                var shared_midasi = new SharedString (midasi);
+                for (uint32 j = 0; j < n_candidates; j++) {
+                    var text = read_non_null_string ();
+                    var annotation = read_string ();
+                    var candidate = new Candidate.with_shared_midasi (
+                        shared_midasi, okuri, text, annotation);
+                    candidate.get_output_hash ();
+                    list.add (candidate);
+                }
+                entries.set (midasi, list);
+            }
+        }
+
+        // Read the snapshot of file into the entries, if it was
+        // written when the text file had etag.  Return false if the
+        // text file has to be parsed instead; the entries may then be
+        // partially filled.
+        internal static bool load (File file,
+                                   string etag,
+                                   out string? coding,
+                                   Map<string,Gee.List<Candidate>> okuri_ari_entries,
+                                   Map<string,Gee.List<Candidate>> okuri_nasi_entries)
+        {
+            coding = null;
+            var snapshot_file = get_file (file);
+            if (!snapshot_file.query_exists ()) {
+                return false;
+            }
+            try {
+                var snapshot = new UserDictSnapshot (
+                    new MemoryMappedFile (snapshot_file).remap ());
+                if (snapshot.mem.length < MAGIC.length ||
+                    Memory.cmp (snapshot.mem.memory, MAGIC,
+                                MAGIC.length) != 0) {
+                    throw new SkkDictError.MALFORMED_INPUT (
+                        "not a user dictionary snapshot");
+                }
+                snapshot.offset = MAGIC.length;
+                if (snapshot.read_non_null_string () != etag) {
+                    // stale; the text file was modified after save
+                    return false;
+                }
+                var _coding = snapshot.read_non_null_string ();
+                var n_okuri_ari_entries = snapshot.read_uint32 ();
+                var n_okuri_nasi_entries = snapshot.read_uint32 ();
+                snapshot.read_entries (okuri_ari_entries, true,
+                                       n_okuri_ari_entries);
+                snapshot.read_entries (okuri_nasi_entries, false,
+                                       n_okuri_nasi_entries);
+                if (_coding != "") {
+                    coding = _coding;
+                }
+                return true;
+            } catch (SkkDictError e) {
+                warning ("ignoring user dictionary snapshot %s: %s",
+                         snapshot_file.get_path (), e.message);
+                return false;
+            }
+        }
+    }
+}
@@ -41,16 +41,7 @@ namespace Skk {
 
             var coding = EncodingConverter.extract_coding_system (line);
             if (coding != null) {
-                try {
-                    var _converter = new EncodingConverter.from_coding_system (
-                        coding);
-                    if (_converter != null) {
-                        converter = _converter;
-                    }
-                } catch (Error e) {
-                    warning ("can't create converter from coding system %s: %s",
-                             coding, e.message);
-                }
+                set_coding_system (coding);
                 // proceed to the next line
                 line = data.read_line (out length);
                 if (line == null) {
@@ -118,10 +109,116 @@ namespace Skk {
             }
         }
 
+        void set_coding_system (string coding) {
+            try {
+                var _converter = new EncodingConverter.from_coding_system (
+                    coding);
+                if (_converter != null) {
+                    converter = _converter;
+                }
+            } catch (Error e) {
+                warning ("can't create converter from coding system %s: %s",
+                         coding, e.message);
+            }
+        }
+
+        // Adopt the snapshot written by the last save, if the text
+        // file has not changed since.
+        bool load_snapshot (string text_etag) {
+            string? coding;
+            if (!UserDictSnapshot.load (file, text_etag, out coding,
+                                        okuri_ari_entries,
+                                        okuri_nasi_entries)) {
+                okuri_ari_entries.clear ();
+                okuri_nasi_entries.clear ();
+                return false;
+            }
+            if (coding != null) {
+                set_coding_system (coding);
+            }
+            etag = text_etag;
+            return true;
+        }
+
+        // A selection, purge or eviction made in this process since
+        // the last load or save.
+        class Change {
+            // null if the whole midasi has been evicted
+            public Candidate? candidate;
+            public bool purge;
+        }
+
+        static int find_text (Gee.List<Candidate> candidates, string text) {
+            var index = 0;
+            foreach (var c in candidates) {
+                if (c.text == text) {
+                    return index;
+                }
+                index++;
+            }
+            return -1;
+        }
+
+        // Replay the changes made in this process on top of the
+        // freshly loaded entries, so that candidates added to the same
+        // midasi by another process are kept.
+        static void merge_changes (Map<string,Gee.List<Candidate>> entries,
+                                   Map<string,Gee.List<Change>> changes)
+        {
+            foreach (var mapentry in changes.entries) {
+                var midasi = mapentry.key;
+                var candidates = entries.get (midasi);
+                foreach (var change in mapentry.value) {
+                    if (change.candidate == null) {
+                        candidates = null;
+                    } else if (change.purge) {
+                        if (candidates != null) {
+                            int index;
+                            while ((index = find_text (
+                                        candidates,
+                                        change.candidate.text)) >= 0) {
+                                candidates.remove_at (index);
+                            }
+                        }
+                    } else {
+                        if (candidates == null) {
+                            candidates = new ArrayList<Candidate> ();
+                        }
+                        var index = find_text (candidates,
+                                               change.candidate.text);
+                        if (index < 0) {
+                            candidates.insert (0, change.candidate);
+                        } else if (index > 0) {
+                            var first = candidates[0];
+                            candidates[0] = candidates[index];
+                            candidates[index] = first;
+                        }
+                    }
+                }
+                if (candidates == null || candidates.is_empty) {
+                    entries.unset (midasi);
+                } else {
+                    entries.set (midasi, candidates);
+                }
+            }
+        }
+
         /**
          * {@inheritDoc}
+         *
+         * Candidates selected or purged in this process and not saved
+         * yet are moved or removed again in the entries read from the
+         * file, so changes made by another process, even to the same
+         * midasi, are merged instead of overwritten by the next
+         * {@link save}.
+         *
+         * If the file has not changed since the last {@link save},
+         * the binary snapshot written by it is loaded instead.
          */
         public override void reload () throws GLib.Error {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
 #if VALA_0_16
             string attributes = FileAttribute.ETAG_VALUE;
 #else
@@ -130,18 +227,29 @@ namespace Skk {
             FileInfo info = file.query_info (attributes,
                                              FileQueryInfoFlags.NONE);
             if (info.get_etag () != etag) {
-                this.okuri_ari_entries.clear ();
-                this.okuri_nasi_entries.clear ();
-                try {
-                    load ();
-                } catch (SkkDictError e) {
-                    warning ("error parsing user dictionary %s: %s",
-                             file.get_path (), e.message);
-                } catch (GLib.IOError e) {
-                    warning ("error reading user dictionary %s: %s",
-                             file.get_path (), e.message);
+                okuri_ari_entries = new HashMap<string,Gee.List<Candidate>> ();
+                okuri_nasi_entries = new HashMap<string,Gee.List<Candidate>> ();
+                if (!load_snapshot (info.get_etag ())) {
+                    try {
+                        load ();
+                    } catch (SkkDictError e) {
+                        warning ("error parsing user dictionary %s: %s",
+                                 file.get_path (), e.message);
+                    } catch (GLib.IOError e) {
+                        warning ("error reading user dictionary %s: %s",
+                                 file.get_path (), e.message);
+                    }
                 }
+                merge_changes (okuri_ari_entries, okuri_ari_changes);
+                merge_changes (okuri_nasi_entries, okuri_nasi_changes);
+                okuri_ari_reverse = null;
+                okuri_nasi_reverse = null;
+                invalidate_eviction_order ();
+                trim ();
             }
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Dict.reload", "%s", get_type ().name ());
+#endif
         }
 
         static int compare_entry_asc (Map.Entry<string,Gee.List<Candidate>> a,
@@ -171,8 +279,31 @@ namespace Skk {
 
         /**
          * {@inheritDoc}
+         *
+         * If the file has been modified by another process since it
+         * was loaded, the changes are merged first.  A binary
+         * snapshot of the entries is also written next to the file,
+         * with the suffix ".snapshot", to speed up the next load.
          */
         public override void save () throws GLib.Error {
+#if ENABLE_TRACING
+            var trace_begin = Trace.now ();
+#endif
+            trim ();
+            try {
+                write_contents ();
+            } catch (IOError.WRONG_ETAG e) {
+                reload ();
+                write_contents ();
+            }
+            okuri_ari_changes.clear ();
+            okuri_nasi_changes.clear ();
+#if ENABLE_TRACING
+            Trace.mark (trace_begin, "Dict.save", "%s", get_type ().name ());
+#endif
+        }
+
+        void write_contents () throws GLib.Error {
             var builder = new StringBuilder ();
             var coding = converter.get_coding_system ();
             if (coding != null) {
@@ -209,6 +340,15 @@ namespace Skk {
                                    FileCreateFlags.PRIVATE,
                                    out etag);
 #endif
+            try {
+                UserDictSnapshot.save (file, etag, coding,
+                                       okuri_ari_entries,
+                                       okuri_nasi_entries);
+            } catch (GLib.Error e) {
+                warning ("can't write user dictionary snapshot %s: %s",
+                         UserDictSnapshot.get_file (file).get_path (),
+                         e.message);
+            }
         }
 
         Map<string,Gee.List<Candidate>> get_entries (bool okuri = false) {
@@ -219,6 +359,26 @@ namespace Skk {
             }
         }
 
+        void add_change (string midasi,
+                         bool okuri,
+                         Candidate? candidate,
+                         bool purge = false)
+        {
+            var changes = okuri ? okuri_ari_changes : okuri_nasi_changes;
+            var list = changes.get (midasi);
+            if (list == null) {
+                list = new ArrayList<Change> ();
+                changes.set (midasi, list);
+            } else if (candidate == null) {
+                // the earlier changes are dropped along with the midasi
+                list.clear ();
+            }
+            var change = new Change ();
+            change.candidate = candidate;
+            change.purge = purge;
+            list.add (change);
+        }
+
         /**
          * {@inheritDoc}
          */
@@ -235,33 +395,38 @@ namespace Skk {
          * {@inheritDoc}
          */
         public override string[] complete (string midasi) {
-            Gee.List<string> completion = new ArrayList<string> ();
-            Gee.List<string> keys = new ArrayList<string> ();
-            keys.add_all (okuri_nasi_entries.keys);
-            keys.sort ();
-            var iter = keys.iterator ();
-            // find the first matching entry
-            while (iter.next ()) {
-                var key = iter.get ();
-                if (key.has_prefix (midasi)) {
-                    // don't add midasi word itself
-                    if (key != midasi) {
-                        completion.add (key);
-                    }
-                    break;
-                }
+            return complete_prefix (midasi);
+        }
+
+        /**
+         * {@inheritDoc}
+         *
+         * The midasi are sorted as in the file, descending for
+         * okuri-ari entries.
+         */
+        public override string[] complete_prefix (string midasi,
+                                                  bool okuri = false,
+                                                  int limit = -1)
+        {
+            var completion = new ArrayList<string> ();
+            if (limit == 0) {
+                return completion.to_array ();
             }
-            // loop until the last matching entry
-            while (iter.next ()) {
-                var key = iter.get ();
-                if (!key.has_prefix (midasi)) {
-                    break;
-                }
+            // only sort the matching keys
+            foreach (var key in get_entries (okuri).keys) {
                 // don't add midasi word itself
-                if (key != midasi) {
+                if (key != midasi && key.has_prefix (midasi)) {
                     completion.add (key);
                 }
             }
+            if (okuri) {
+                completion.sort ((a, b) => strcmp (b, a));
+            } else {
+                completion.sort ();
+            }
+            if (limit > 0 && completion.size > limit) {
+                return completion.slice (0, limit).to_array ();
+            }
             return completion.to_array ();
         }
 
@@ -272,6 +437,7 @@ namespace Skk {
             var entries = get_entries (candidate.okuri);
             if (!entries.has_key (candidate.midasi)) {
                 entries.set (candidate.midasi, new ArrayList<Candidate> ());
+                add_eviction_node (candidate.midasi, candidate.okuri);
             }
             var index = 0;
             var candidates = entries.get (candidate.midasi);
@@ -281,6 +447,8 @@ namespace Skk {
                         var first = candidates[0];
                         candidates[0] = candidates[index];
                         candidates[index] = first;
+                        add_change (candidate.midasi, candidate.okuri,
+                                    candidate);
                         return true;
                     }
                     return false;
@@ -288,9 +456,141 @@ namespace Skk {
                 index++;
             }
             candidates.insert (0, candidate);
+            add_reverse (candidate.okuri, candidate.midasi, candidate.text);
+            add_change (candidate.midasi, candidate.okuri, candidate);
+            trim (candidate);
             return true;
         }
 
+        // A midasi in the eviction order, with the usage it is
+        // ranked by.
+        class EvictionNode {
+            public string key;
+            public string midasi;
+            public bool okuri;
+            public LearningUsage usage;
+        }
+
+        // The midasi from the first to the last to drop, built on the
+        // first eviction and then kept in sync with the entries and
+        // the learning store; null until then or after a reload.
+        TreeSet<EvictionNode>? eviction_order = null;
+        Map<string,EvictionNode>? eviction_nodes = null;
+
+        static string make_eviction_key (string midasi, bool okuri) {
+            return (okuri ? "1" : "0") + midasi;
+        }
+
+        // Midasi the store knows nothing about have zero usage and go
+        // first; ties are broken by the key, okuri-ari first.
+        static TreeSet<EvictionNode> new_eviction_order (
+            EvictionPolicy policy)
+        {
+            return new TreeSet<EvictionNode> ((a, b) => {
+                    var result = LearningStore.compare_usage_with_policy (
+                        policy, b.usage, a.usage);
+                    if (result != 0) {
+                        return result;
+                    }
+                    return strcmp (b.key, a.key);
+                });
+        }
+
+        void build_eviction_order () {
+            eviction_order = new_eviction_order (
+                learning != null ? learning.policy : EvictionPolicy.LRU);
+            eviction_nodes = new HashMap<string,EvictionNode> ();
+            for (var i = 0; i < 2; i++) {
+                var okuri = i == 0;
+                foreach (var midasi in get_entries (okuri).keys) {
+                    add_eviction_node (midasi, okuri);
+                }
+            }
+        }
+
+        void invalidate_eviction_order () {
+            eviction_order = null;
+            eviction_nodes = null;
+        }
+
+        void add_eviction_node (string midasi, bool okuri) {
+            if (eviction_order == null) {
+                return;
+            }
+            var node = new EvictionNode ();
+            node.key = make_eviction_key (midasi, okuri);
+            node.midasi = midasi;
+            node.okuri = okuri;
+            if (learning != null) {
+                node.usage = learning.get_usage (midasi, okuri);
+            }
+            eviction_nodes.set (node.key, node);
+            eviction_order.add (node);
+        }
+
+        void remove_eviction_node (string midasi, bool okuri) {
+            if (eviction_order == null) {
+                return;
+            }
+            EvictionNode? node;
+            if (eviction_nodes.unset (make_eviction_key (midasi, okuri),
+                                      out node)) {
+                eviction_order.remove (node);
+            }
+        }
+
+        void learning_usage_changed_cb (string? midasi, bool okuri) {
+            if (eviction_order == null) {
+                return;
+            }
+            if (midasi == null) {
+                invalidate_eviction_order ();
+                return;
+            }
+            var node = eviction_nodes.get (make_eviction_key (midasi, okuri));
+            if (node != null) {
+                eviction_order.remove (node);
+                node.usage = learning.get_usage (midasi, okuri);
+                eviction_order.add (node);
+            }
+        }
+
+        void learning_policy_changed_cb (Object s, ParamSpec? p) {
+            invalidate_eviction_order ();
+        }
+
+        // Drop the least valuable midasi other than the one just
+        // selected, as ranked by the learning store.  Midasi the store
+        // knows nothing about go first.
+        void evict (Candidate? keep) {
+            if (eviction_order == null) {
+                build_eviction_order ();
+            }
+            var victim = eviction_order.first ();
+            if (keep != null &&
+                victim.okuri == keep.okuri && victim.midasi == keep.midasi) {
+                victim = eviction_order.higher (victim);
+            }
+            if (victim != null) {
+                var entries = get_entries (victim.okuri);
+                foreach (var c in entries.get (victim.midasi)) {
+                    remove_reverse (victim.okuri, victim.midasi, c.text);
+                }
+                entries.unset (victim.midasi);
+                remove_eviction_node (victim.midasi, victim.okuri);
+                add_change (victim.midasi, victim.okuri, null);
+            }
+        }
+
+        // Drop the entries ranked lowest, other than the midasi of
+        // keep, until at most max_entries are left.
+        void trim (Candidate? keep = null) {
+            while (_max_entries > 0 &&
+                   okuri_ari_entries.size + okuri_nasi_entries.size > _max_entries) {
+                evict (keep);
+            }
+        }
+
         /**
          * {@inheritDoc}
          */
@@ -311,12 +611,95 @@ namespace Skk {
                     }
                     if (candidates.size == 0) {
                         entries.unset (candidate.midasi);
+                        remove_eviction_node (candidate.midasi,
+                                              candidate.okuri);
                     }
                 }
             }
+            if (modified) {
+                remove_reverse (candidate.okuri,
+                                candidate.midasi,
+                                candidate.text);
+                add_change (candidate.midasi, candidate.okuri, candidate,
+                            true);
+            }
             return modified;
         }
 
+        // Map from candidate text to midasi, built on the first
+        // reverse_lookup and then kept in sync with the entries.
+        Map<string,Set<string>>? get_reverse (bool okuri) {
+            return okuri ? okuri_ari_reverse : okuri_nasi_reverse;
+        }
+
+        static Map<string,Set<string>> build_reverse (
+            Map<string,Gee.List<Candidate>> entries)
+        {
+            var reverse = new HashMap<string,Set<string>> ();
+            foreach (var entry in entries.entries) {
+                foreach (var c in entry.value) {
+                    if (!reverse.has_key (c.text)) {
+                        reverse.set (c.text, new HashSet<string> ());
+                    }
+                    reverse.get (c.text).add (entry.key);
+                }
+            }
+            return reverse;
+        }
+
+        void add_reverse (bool okuri, string midasi, string text) {
+            var reverse = get_reverse (okuri);
+            if (reverse == null) {
+                return;
+            }
+            if (!reverse.has_key (text)) {
+                reverse.set (text, new HashSet<string> ());
+            }
+            reverse.get (text).add (midasi);
+        }
+
+        void remove_reverse (bool okuri, string midasi, string text) {
+            var reverse = get_reverse (okuri);
+            if (reverse == null || !reverse.has_key (text)) {
+                return;
+            }
+            var midasi_set = reverse.get (text);
+            midasi_set.remove (midasi);
+            if (midasi_set.size == 0) {
+                reverse.unset (text);
+            }
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override Candidate[] reverse_lookup (string text) {
+            if (okuri_ari_reverse == null) {
+                okuri_ari_reverse = build_reverse (okuri_ari_entries);
+                okuri_nasi_reverse = build_reverse (okuri_nasi_entries);
+            }
+            Candidate[] result = {};
+            for (var i = 0; i < 2; i++) {
+                var okuri = i == 0;
+                var reverse = get_reverse (okuri);
+                if (!reverse.has_key (text)) {
+                    continue;
+                }
+                var entries = get_entries (okuri);
+                foreach (var midasi in reverse.get (text)) {
+                    if (!entries.has_key (midasi)) {
+                        continue;
+                    }
+                    foreach (var c in entries.get (midasi)) {
+                        if (c.text == text) {
+                            result += c;
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
         /**
          * {@inheritDoc}
          */
@@ -326,6 +709,98 @@ namespace Skk {
             }
         }
 
+        internal override File? get_backing_file () {
+            return file;
+        }
+
+        static void add_entries_usage (ref MemoryUsage usage,
+                                       Map<string,Gee.List<Candidate>> entries)
+        {
+            var list_size = MemoryUsageUtils.instance_size (
+                typeof (ArrayList<Candidate>));
+            foreach (var entry in entries.entries) {
+                usage.heap_bytes += MemoryUsageUtils.HASH_NODE_SIZE +
+                    MemoryUsageUtils.string_size (entry.key) +
+                    list_size +
+                    entry.value.size * sizeof (void *);
+                foreach (var candidate in entry.value) {
+                    usage.heap_bytes += candidate.get_heap_size ();
+                }
+            }
+            usage.entries += entries.size;
+        }
+
+        /**
+         * {@inheritDoc}
+         */
+        public override MemoryUsage get_memory_usage () {
+            var usage = base.get_memory_usage ();
+            add_entries_usage (ref usage, okuri_ari_entries);
+            add_entries_usage (ref usage, okuri_nasi_entries);
+            if (eviction_nodes != null) {
+                usage.heap_bytes += eviction_nodes.size *
+                    (MemoryUsageUtils.HASH_NODE_SIZE +
+                     MemoryUsageUtils.TREE_NODE_SIZE +
+                     sizeof (EvictionNode));
+            }
+            return usage;
+        }
+
+        /**
+         * Maximum number of midasi kept, 0 for unlimited.
+         *
+         * When the dictionary is over the limit, after a new midasi
+         * is selected, on load, on save or when the limit is lowered,
+         * the entries ranked lowest by {@link learning} are dropped.
+         *
+         * @since 1.2.0
+         */
+        public uint max_entries {
+            get {
+                return _max_entries;
+            }
+            set {
+                _max_entries = value;
+                trim ();
+            }
+        }
+        uint _max_entries = 0;
+
+        /**
+         * Learning store used to choose the entries to drop when the
+         * dictionary is bounded by {@link max_entries}.
+         *
+         * The store is only consulted; record selections on it
+         * through {@link Context.learning}.
+         *
+         * @since 1.2.0
+         */
+        public LearningStore? learning {
+            get {
+                return _learning;
+            }
+            set {
+                if (_learning == value) {
+                    return;
+                }
+                if (_learning != null) {
+                    _learning.usage_changed.disconnect (
+                        learning_usage_changed_cb);
+                    _learning.notify["policy"].disconnect (
+                        learning_policy_changed_cb);
+                }
+                _learning = value;
+                if (_learning != null) {
+                    _learning.usage_changed.connect (
+                        learning_usage_changed_cb);
+                    _learning.notify["policy"].connect (
+                        learning_policy_changed_cb);
+                }
+                invalidate_eviction_order ();
+            }
+        }
+        LearningStore? _learning = null;
+
         File file;
         string etag;
         EncodingConverter converter;
@@ -333,6 +808,12 @@ namespace Skk {
             new HashMap<string,Gee.List<Candidate>> ();
         Map<string,Gee.List<Candidate>> okuri_nasi_entries =
             new HashMap<string,Gee.List<Candidate>> ();
+        Map<string,Gee.List<Change>> okuri_ari_changes =
+            new HashMap<string,Gee.List<Change>> ();
+        Map<string,Gee.List<Change>> okuri_nasi_changes =
+            new HashMap<string,Gee.List<Change>> ();
+        Map<string,Set<string>>? okuri_ari_reverse = null;
+        Map<string,Set<string>>? okuri_nasi_reverse = null;
 
         /**
          * Create a new UserDict.
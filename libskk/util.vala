@@ -154,17 +154,27 @@ namespace Skk {
             null, null, null, "兆", null, null, null, null, "京"
         };
 
+        // Kana tables are indexed by slot: U+3000..U+30FF (CJK
+        // symbols, hiragana and katakana) map to 0..255 and
+        // U+FF00..U+FF9F (fullwidth forms and hankaku katakana) to
+        // 256..415.
+        const int KANA_SLOTS = 416;
+
+        // Characters which may follow a kana to compose a voiced or
+        // semi-voiced one.
+        const unichar[] CompositionMarks = {
+            0x309B, 0x309C, 0xFF9E, 0xFF9F
+        };
+
         // katakana to hiragana
-        static Map<unichar,string> _HiraganaTable =
-            new HashMap<unichar,string> ();
+        static string?[] _HiraganaTable;
         // hiragana or hankaku katakana (not composed) to katakana
-        static Map<unichar,unichar> _KatakanaTable =
-            new HashMap<unichar,unichar> ();
+        static unichar[] _KatakanaTable;
         // katakana to hankaku katakana
-        static Map<unichar,string> _HankakuKatakanaTable =
-            new HashMap<unichar,string> ();
-        static Map<unichar,Map<unichar,unichar>> _CompositionTable =
-            new HashMap<unichar,HashMap<unichar,unichar>> ();
+        static string?[] _HankakuKatakanaTable;
+        // kana followed by a composition mark to katakana, indexed by
+        // slot * CompositionMarks.length + mark index
+        static unichar[] _CompositionTable;
         static Map<string,char> _WideLatinToLatinTable =
             new HashMap<string,char> ();
 
@@ -203,71 +213,121 @@ namespace Skk {
         }
 #endif
 
-        static unichar get_katakana_char (unichar uc) {
-            if (_KatakanaTable.has_key (uc)) {
-                return _KatakanaTable.get (uc);
+        static int get_kana_slot (unichar uc) {
+            if (0x3000 <= uc && uc < 0x3100) {
+                return (int) (uc - 0x3000);
+            }
+            if (0xFF00 <= uc && uc < 0xFFA0) {
+                return (int) (uc - 0xFF00) + 256;
+            }
+            return -1;
+        }
+
+        static int get_composition_mark_index (unichar uc) {
+            for (var i = 0; i < CompositionMarks.length; i++) {
+                if (CompositionMarks[i] == uc) {
+                    return i;
+                }
             }
-            return uc;
+            return -1;
         }
 
-        static void foreach_katakana (string kana,
-                                      Func<unichar> func)
+        // Convert kana to kana_mode and append the result.  Hiragana,
+        // katakana and hankaku katakana are all accepted as input;
+        // other characters are copied as is.
+        internal static void append_kana (StringBuilder builder,
+                                          string kana,
+                                          KanaMode kana_mode)
         {
             int index = 0;
-            unichar uc0;
-            while (kana.get_next_char (ref index, out uc0)) {
-                if (_CompositionTable.has_key (uc0)) {
-                    var composition = _CompositionTable.get (uc0);
-                    unichar uc1;
-                    if (kana.get_next_char (ref index, out uc1)) {
-                        if (composition.has_key (uc1))
-                            func (composition.get (uc1));
-                        else {
-                            func (get_katakana_char (uc0));
-                            func (get_katakana_char (uc1));
+            unichar uc;
+            while (kana.get_next_char (ref index, out uc)) {
+                var slot = get_kana_slot (uc);
+                if (slot < 0) {
+                    builder.append_unichar (uc);
+                    continue;
+                }
+
+                // look ahead for a composition mark
+                unichar katakana = 0;
+                int next_index = index;
+                unichar next_uc;
+                if (kana.get_next_char (ref next_index, out next_uc)) {
+                    var mark = get_composition_mark_index (next_uc);
+                    if (mark >= 0) {
+                        katakana = _CompositionTable[
+                            slot * CompositionMarks.length + mark];
+                        if (katakana != 0) {
+                            index = next_index;
                         }
-                    } else {
-                        func (get_katakana_char (uc0));
-                        break;
                     }
+                }
+                if (katakana == 0) {
+                    katakana = _KatakanaTable[slot];
+                    if (katakana == 0) {
+                        katakana = uc;
+                    }
+                }
+
+                unowned string? converted = null;
+                switch (kana_mode) {
+                case KanaMode.HIRAGANA:
+                    converted = _HiraganaTable[get_kana_slot (katakana)];
+                    break;
+                case KanaMode.HANKAKU_KATAKANA:
+                    converted = _HankakuKatakanaTable[
+                        get_kana_slot (katakana)];
+                    break;
+                default:
+                    break;
+                }
+                if (converted != null) {
+                    builder.append (converted);
                 } else {
-                    func (get_katakana_char (uc0));
+                    builder.append_unichar (katakana);
                 }
             }
         }
 
         internal static string get_katakana (string kana) {
-            StringBuilder builder = new StringBuilder ();
-            foreach_katakana (kana, (uc) => {
-                    builder.append_unichar (uc);
-                });
+            StringBuilder builder = new StringBuilder.sized (kana.length);
+            append_kana (builder, kana, KanaMode.KATAKANA);
             return builder.str;
         }
 
         internal static string get_hiragana (string kana) {
-            StringBuilder builder = new StringBuilder ();
-            foreach_katakana (kana, (uc) => {
-                    if (_HiraganaTable.has_key (uc)) {
-                        builder.append (_HiraganaTable.get (uc));
-                    } else {
-                        builder.append_unichar (uc);
-                    }
-                });
+            StringBuilder builder = new StringBuilder.sized (kana.length);
+            append_kana (builder, kana, KanaMode.HIRAGANA);
             return builder.str;
         }
 
         internal static string get_hankaku_katakana (string kana) {
-            StringBuilder builder = new StringBuilder ();
-            foreach_katakana (kana, (uc) => {
-                    if (_HankakuKatakanaTable.has_key (uc)) {
-                        builder.append (_HankakuKatakanaTable.get (uc));
-                    } else {
-                        builder.append_unichar (uc);
-                    }
-                });
+            StringBuilder builder = new StringBuilder.sized (kana.length);
+            append_kana (builder, kana, KanaMode.HANKAKU_KATAKANA);
             return builder.str;
         }
 
+        // Single-pass variant of convert_by_input_mode, writing into
+        // a caller-supplied buffer.
+        internal static void append_by_input_mode (StringBuilder builder,
+                                                   string str,
+                                                   InputMode input_mode)
+        {
+            switch (input_mode) {
+            case InputMode.HIRAGANA:
+            case InputMode.KATAKANA:
+            case InputMode.HANKAKU_KATAKANA:
+                append_kana (builder, str, (KanaMode) input_mode);
+                break;
+            case InputMode.WIDE_LATIN:
+                builder.append (get_wide_latin (str));
+                break;
+            default:
+                builder.append (str);
+                break;
+            }
+        }
+
         internal static string convert_by_input_mode (string str,
                                                       InputMode input_mode)
         {
@@ -344,57 +404,45 @@ namespace Skk {
             return "";
         }
 
+        static void add_kana_conversion (string kana, unichar katakana) {
+            int index = 0;
+            unichar uc0, uc1;
+            kana.get_next_char (ref index, out uc0);
+            var slot = get_kana_slot (uc0);
+            return_if_fail (slot >= 0);
+            if (kana.get_next_char (ref index, out uc1)) {
+                var mark = get_composition_mark_index (uc1);
+                return_if_fail (mark >= 0);
+                _CompositionTable[slot * CompositionMarks.length + mark] =
+                    katakana;
+            } else {
+                _KatakanaTable[slot] = katakana;
+            }
+        }
+
         static construct {
-            foreach (var entry in KanaTable) {
-                _HiraganaTable.set (entry.katakana,
-                                    entry.hiragana);
-                _HankakuKatakanaTable.set (entry.katakana,
-                                           entry.hankaku_katakana);
-                foreach (var substitute in HankakuKatakanaSubstitute) {
-                    _HankakuKatakanaTable.set (substitute.katakana,
-                                               substitute.hankaku_katakana);
-                }
+            _HiraganaTable = new string?[KANA_SLOTS];
+            _KatakanaTable = new unichar[KANA_SLOTS];
+            _HankakuKatakanaTable = new string?[KANA_SLOTS];
+            _CompositionTable =
+                new unichar[KANA_SLOTS * CompositionMarks.length];
 
+            foreach (var entry in KanaTable) {
+                var slot = get_kana_slot (entry.katakana);
+                _HiraganaTable[slot] = entry.hiragana;
+                _HankakuKatakanaTable[slot] = entry.hankaku_katakana;
                 if (entry.hiragana != null) {
-                    if (entry.hiragana.char_count () > 1) {
-                        int index = 0;
-                        unichar uc0, uc1;
-                        entry.hiragana.get_next_char (ref index, out uc0);
-                        entry.hiragana.get_next_char (ref index, out uc1);
-                        if (!_CompositionTable.has_key (uc0)) {
-                            _CompositionTable.set (
-                                uc0,
-                                new HashMap<unichar,unichar> ());
-                        }
-                        var composition = _CompositionTable.get (uc0);
-                        composition.set (uc1, entry.katakana);
-                    } else {
-                        _KatakanaTable.set (entry.hiragana.get_char (),
-                                            entry.katakana);
-                    }
+                    add_kana_conversion (entry.hiragana, entry.katakana);
                 }
-
                 if (entry.hankaku_katakana != null) {
-                    if (entry.hankaku_katakana.char_count () > 1) {
-                        int index = 0;
-                        unichar uc0, uc1;
-                        entry.hankaku_katakana.get_next_char (
-                            ref index, out uc0);
-                        entry.hankaku_katakana.get_next_char (
-                            ref index, out uc1);
-                        if (!_CompositionTable.has_key (uc0)) {
-                            _CompositionTable.set (
-                                uc0,
-                                new HashMap<unichar,unichar> ());
-                        }
-                        var composition = _CompositionTable.get (uc0);
-                        composition.set (uc1, entry.katakana);
-                    } else {
-                        _KatakanaTable.set (entry.hankaku_katakana.get_char (),
-                                            entry.katakana);
-                    }
+                    add_kana_conversion (entry.hankaku_katakana,
+                                         entry.katakana);
                 }
             }
+            foreach (var substitute in HankakuKatakanaSubstitute) {
+                _HankakuKatakanaTable[get_kana_slot (substitute.katakana)] =
+                    substitute.hankaku_katakana;
+            }
             for (var i = 0; i < WideLatinTable.length; i++) {
                 _WideLatinToLatinTable.set (WideLatinTable[i], i + 32);
             }
@@ -440,20 +488,47 @@ namespace Skk {
         }
     }
 
-    class MemoryMappedFile : Object {
-        void *_memory = null;
-        public void *memory {
-            get {
-                return _memory;
+    [CCode (cname = "memmem", cheader_filename = "string.h")]
+    extern void *memmem (void *haystack, size_t haystacklen,
+                         void *needle, size_t needlelen);
+
+    // A single read-only mapping of a file.  The region is unmapped
+    // when the last reference is dropped, so a reader holding a
+    // reference can keep using it after a newer mapping is published.
+    class MappedMemory : Object {
+        internal void *memory;
+        internal size_t length;
+
+        internal MappedMemory (void *memory, size_t length) {
+            this.memory = memory;
+            this.length = length;
+        }
+
+        ~MappedMemory () {
+            if (memory != null) {
+                Posix.munmap (memory, length);
             }
         }
 
-        size_t _length = 0;
-        public size_t length {
-            get {
-                return _length;
+        // Return the offset of the first occurrence of needle at or
+        // after offset, or -1.
+        internal long find (long offset, string needle) {
+            if (offset < 0 || offset >= (long) length) {
+                return -1;
+            }
+            char *p = (char *) memmem ((char *) memory + offset,
+                                       length - offset,
+                                       needle,
+                                       needle.length);
+            if (p == null) {
+                return -1;
             }
+            return (long) (p - (char *) memory);
         }
+    }
+
+    class MemoryMappedFile : Object {
+        MappedMemory? current = null;
 
         File file;
 
@@ -461,15 +536,36 @@ namespace Skk {
             this.file = file;
         }
 
-        public void remap () throws SkkDictError {
-            if (_memory != null) {
-                Posix.munmap (_memory, _length);
-                _memory = null;
+        /**
+         * Return the currently published mapping.
+         *
+         * The caller should keep the returned reference while
+         * accessing the memory, instead of accessing this object
+         * repeatedly.
+         */
+        public MappedMemory? acquire () {
+            MappedMemory? region;
+            lock (current) {
+                region = current;
             }
-            map ();
+            return region;
         }
 
-        void map () throws SkkDictError {
+        /**
+         * Map the file again and publish the new mapping.
+         *
+         * The previous mapping is not unmapped until all the readers
+         * release it.
+         */
+        public MappedMemory remap () throws SkkDictError {
+            var region = map ();
+            lock (current) {
+                current = region;
+            }
+            return region;
+        }
+
+        MappedMemory map () throws SkkDictError {
             int fd = Posix.open (file.get_path (), Posix.O_RDONLY, 0);
             if (fd < 0) {
                 throw new SkkDictError.NOT_READABLE ("can't open %s",
@@ -479,24 +575,128 @@ namespace Skk {
             Posix.Stat stat;
             int retval = Posix.fstat (fd, out stat);
             if (retval < 0) {
+                Posix.close (fd);
                 throw new SkkDictError.NOT_READABLE ("can't stat fd");
             }
 
-            _memory = Posix.mmap (null,
-                                  stat.st_size,
-                                  Posix.PROT_READ,
-                                  Posix.MAP_SHARED,
-                                  fd,
-                                  0);
-            if (_memory == Posix.MAP_FAILED) {
+            void *memory = Posix.mmap (null,
+                                       stat.st_size,
+                                       Posix.PROT_READ,
+                                       Posix.MAP_SHARED,
+                                       fd,
+                                       0);
+            // the mapping stays valid after closing the descriptor
+            Posix.close (fd);
+            if (memory == Posix.MAP_FAILED) {
                 throw new SkkDictError.NOT_READABLE ("mmap failed");
             }
-            _length = stat.st_size;
+            return new MappedMemory (memory, stat.st_size);
+        }
+    }
+
+    // Watch a file and emit changed() once for each burst of
+    // modifications, so that a writer saving in several steps causes
+    // a single reload.
+    class FileChangeMonitor : Object {
+        FileMonitor monitor;
+        uint timeout_id = 0;
+
+        // delay in milliseconds
+        internal uint delay { get; set; default = 500; }
+
+        internal signal void changed ();
+
+        internal FileChangeMonitor (File file) throws GLib.Error {
+            monitor = file.monitor_file (FileMonitorFlags.NONE);
+            monitor.changed.connect (monitor_changed_cb);
+        }
+
+        ~FileChangeMonitor () {
+            monitor.changed.disconnect (monitor_changed_cb);
+            monitor.cancel ();
+            if (timeout_id > 0) {
+                Source.remove (timeout_id);
+            }
+        }
+
+        void monitor_changed_cb (File file,
+                                 File? other_file,
+                                 FileMonitorEvent event_type)
+        {
+            switch (event_type) {
+            case FileMonitorEvent.CHANGED:
+            case FileMonitorEvent.CHANGES_DONE_HINT:
+            case FileMonitorEvent.CREATED:
+            case FileMonitorEvent.DELETED:
+                if (timeout_id > 0) {
+                    Source.remove (timeout_id);
+                }
+                timeout_id = Timeout.add (delay, timeout_cb);
+                break;
+            default:
+                break;
+            }
+        }
+
+        bool timeout_cb () {
+            timeout_id = 0;
+            changed ();
+            return false;
         }
     }
 
     abstract class KeyEventUtils : Object {
-        public static string? keyval_name (uint keyval) {
+        // Dense keysym -> Unicode tables for the Latin-1 to Latin-9
+        // and kana keysyms (0x0000-0x0FFF) and for the function keys
+        // (0xFF00-0xFFFF), which cover virtually all key events.
+        const uint LEGACY_KEYSYM_SLOTS = 0x1000;
+        const uint FUNCTION_KEYSYM_SLOTS = 0x100;
+
+        static unichar[] unicode_table;
+
+        // Names not in keysyms.vala (e.g. "U3042"), looked up once.
+        static HashTable<uint,string> extra_names =
+            new HashTable<uint,string> (direct_hash, direct_equal);
+
+        static construct {
+            unicode_table = new unichar[LEGACY_KEYSYM_SLOTS +
+                                        FUNCTION_KEYSYM_SLOTS];
+            for (uint i = 0; i < LEGACY_KEYSYM_SLOTS; i++) {
+                unicode_table[i] = keysym_to_unicode (i);
+            }
+            for (uint i = 0; i < FUNCTION_KEYSYM_SLOTS; i++) {
+                unicode_table[LEGACY_KEYSYM_SLOTS + i] =
+                    keysym_to_unicode (0xFF00 + i);
+            }
+        }
+
+        public static unowned string? keyval_name (uint keyval) {
+            int low = 0;
+            int high = KEYSYM_NAMES_BY_KEYSYM.length - 1;
+            while (low <= high) {
+                var mid = (low + high) / 2;
+                var keysym = KEYSYM_NAMES_BY_KEYSYM[mid].keysym;
+                if (keysym == keyval)
+                    return KEYSYM_NAMES_BY_KEYSYM[mid].name;
+                if (keysym < keyval)
+                    low = mid + 1;
+                else
+                    high = mid - 1;
+            }
+            lock (extra_names) {
+                unowned string? name = extra_names.lookup (keyval);
+                if (name == null) {
+                    var xkb_name = keyval_name_xkb (keyval);
+                    if (xkb_name == null)
+                        return null;
+                    name = xkb_name;
+                    extra_names.insert (keyval, (owned) xkb_name);
+                }
+                return name;
+            }
+        }
+
+        static string? keyval_name_xkb (uint keyval) {
             uint8[] buffer = new uint8[64];
             int ret = -1;
 
@@ -523,6 +723,20 @@ namespace Skk {
             else if (name == "\b")
                 name = "BackSpace";
 
+            int low = 0;
+            int high = KEYSYM_NAMES_BY_NAME.length - 1;
+            while (low <= high) {
+                var mid = (low + high) / 2;
+                var cmp = strcmp (KEYSYM_NAMES_BY_NAME[mid].name, name);
+                if (cmp == 0)
+                    return KEYSYM_NAMES_BY_NAME[mid].keysym;
+                if (cmp < 0)
+                    low = mid + 1;
+                else
+                    high = mid - 1;
+            }
+
+            // names such as "U3042" or "0x1000" are not in the table
             var keysym = Xkb.keysym_from_name (name, Xkb.KeysymFlags.NO_FLAGS);
             if (keysym == Xkb.Keysym.NoSymbol) {
                 // handle ASCII keyvals with differnet name (e.g. at,
@@ -537,27 +751,34 @@ namespace Skk {
             return (uint) keysym;
         }
 
+        static unichar keysym_to_unicode (uint keyval) {
+            unichar code = (unichar) Xkb.keysym_to_utf32 ((uint32) keyval);
+            // control characters, e.g. Return and Tab, are not text
+            if (code < 0x20 || (0x7F <= code && code < 0xA0))
+                return '\0';
+            return code;
+        }
+
         public static unichar keyval_unicode (uint keyval) {
             // handle ASCII keyvals with differnet name (e.g. at,
             // percent, etc.)
             if (0x20 <= keyval && keyval < 0x7F)
                 return keyval;
 
-            // special case
-            if (keyval == Keysyms.yen)
-                return "\xc2\xa5".get_char ();
-
-            uint8[] buffer = new uint8[8];
-            int ret = -1;
+            if (keyval < LEGACY_KEYSYM_SLOTS)
+                return unicode_table[keyval];
+            if (0xFF00 <= keyval && keyval <= 0xFFFF)
+                return unicode_table[LEGACY_KEYSYM_SLOTS + keyval - 0xFF00];
 
-            do {
-                ret = Xkb.keysym_to_utf8 ((uint32) keyval, buffer);
-                if (ret == 0)
+            // Unicode keysyms
+            if (0x01000000 <= keyval && keyval <= 0x0110FFFF) {
+                unichar code = keyval - 0x01000000;
+                if (code < 0x20 || (0x7F <= code && code < 0xA0))
                     return '\0';
-                buffer = new uint8[buffer.length * 2];
-            } while (ret == -1);
+                return code;
+            }
 
-            return '\0';
+            return keysym_to_unicode (keyval);
         }
     }
 }
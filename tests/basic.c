@@ -187,6 +187,10 @@ static SkkTransition completion_transitions[] =
     { SKK_INPUT_MODE_HIRAGANA, "K o u k o \t \t", "▽こうこく", "", SKK_INPUT_MODE_HIRAGANA },
     /* no match for midasi word (= "あぱ") */
     { SKK_INPUT_MODE_HIRAGANA, "A p a \t", "▽あぱ", "", SKK_INPUT_MODE_HIRAGANA },
+    /* typing after completion narrows the list to the new prefix */
+    { SKK_INPUT_MODE_HIRAGANA, "A \t y o \t", "▽あいよう", "", SKK_INPUT_MODE_HIRAGANA },
+    /* shortening the prefix ends the completion */
+    { SKK_INPUT_MODE_HIRAGANA, "A \t DEL \t", "▽あい", "", SKK_INPUT_MODE_HIRAGANA },
     /* file dict has midasi word (= あい) while user dict does not */
     { SKK_INPUT_MODE_HIRAGANA, "A i SPC C-j A \t \t", "▽あいさつ", "愛", SKK_INPUT_MODE_HIRAGANA },
 
@@ -197,6 +201,8 @@ static SkkTransition completion_transitions[] =
     { SKK_INPUT_MODE_HIRAGANA, "/ m a i l \t \t", "▽mailing", "", SKK_INPUT_MODE_HIRAGANA },
     /* no more match for "mail" */
     { SKK_INPUT_MODE_HIRAGANA, "/ m a i l \t \t \t ", "▽mailing", "", SKK_INPUT_MODE_HIRAGANA },
+    /* typing after completion narrows the list to "maili" */
+    { SKK_INPUT_MODE_HIRAGANA, "/ m a i \t i \t", "▽mailing", "", SKK_INPUT_MODE_HIRAGANA },
     /* no match for midasi "mailingl" */
     { SKK_INPUT_MODE_HIRAGANA, "/ m a i l i n g l \t ", "▽mailingl", "", SKK_INPUT_MODE_HIRAGANA },
     { 0, NULL }
@@ -688,6 +694,43 @@ commit_unhandled_with_incomplete_kana (void)
   destroy_context (context);
 }
 
+static void
+key_event_unicode (void)
+{
+  SkkKeyEvent *key;
+  GError *error = NULL;
+  gchar *str;
+
+  key = skk_key_event_new_from_x_keysym (0x4b1, SKK_MODIFIER_TYPE_NONE,
+                                         &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (skk_key_event_get_name (key), ==, "kana_A");
+  g_assert_cmpuint (skk_key_event_get_code (key), ==, 0xFF71);
+  g_object_unref (key);
+
+  key = skk_key_event_new_from_x_keysym (0xa5, SKK_MODIFIER_TYPE_NONE,
+                                         &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (skk_key_event_get_name (key), ==, "yen");
+  g_assert_cmpuint (skk_key_event_get_code (key), ==, 0xA5);
+  g_object_unref (key);
+
+  key = skk_key_event_new_from_string ("Return", &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (skk_key_event_get_code (key), ==, 0);
+  g_object_unref (key);
+
+  /* not in the generated table */
+  key = skk_key_event_new_from_string ("U3042", &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (skk_key_event_get_name (key), ==, "U3042");
+  g_assert_cmpuint (skk_key_event_get_code (key), ==, 0x3042);
+  str = skk_key_event_to_string (key);
+  g_assert_cmpstr (str, ==, "U3042");
+  g_free (str);
+  g_object_unref (key);
+}
+
 int
 main (int argc, char **argv) {
   skk_init ();
@@ -745,5 +788,6 @@ main (int argc, char **argv) {
   g_test_add_func ("/libskk/abort_to_latin_commands", abort_to_latin_commands);
   g_test_add_func ("/libskk/commit-unhandled-with-incomplete-kana",
                    commit_unhandled_with_incomplete_kana);
+  g_test_add_func ("/libskk/key-event-unicode", key_event_unicode);
   return g_test_run ();
 }
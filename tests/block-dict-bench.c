@@ -0,0 +1,157 @@
+#include <libskk/libskk.h>
+#include <glib/gstdio.h>
+#include "common.h"
+
+#define N_ENTRIES 50000
+#define N_LOOKUPS 20000
+#define N_HIRAGANA 80
+
+static const guint block_sizes[] = { 4096, 8192, 16384 };
+
+/* Write N_ENTRIES okuri-nasi entries; the midasi are three hiragana
+   counting up, so the file is sorted.  */
+static gchar *
+create_dict (void)
+{
+  GString *contents;
+  GError *error = NULL;
+  gchar *path;
+  gint fd, i;
+
+  contents = g_string_new (";; -*- coding: utf-8 -*-\n"
+                           ";; okuri-ari entries.\n"
+                           ";; okuri-nasi entries.\n");
+  for (i = 0; i < N_ENTRIES; i++)
+    {
+      g_string_append_unichar (contents, 0x3041 + i / (N_HIRAGANA * N_HIRAGANA));
+      g_string_append_unichar (contents, 0x3041 + i / N_HIRAGANA % N_HIRAGANA);
+      g_string_append_unichar (contents, 0x3041 + i % N_HIRAGANA);
+      g_string_append_printf (contents, " /漢字%d/感じ%d;注釈%d/幹事%d/\n",
+                              i, i % 97, i % 13, i % 101);
+    }
+
+  fd = g_file_open_tmp ("block-dict-bench-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+  g_close (fd, NULL);
+  g_file_set_contents (path, contents->str, contents->len, &error);
+  g_assert_no_error (error);
+  g_string_free (contents, TRUE);
+  return path;
+}
+
+static gchar *
+midasi_at (gint i)
+{
+  GString *midasi = g_string_new ("");
+  g_string_append_unichar (midasi, 0x3041 + i / (N_HIRAGANA * N_HIRAGANA));
+  g_string_append_unichar (midasi, 0x3041 + i / N_HIRAGANA % N_HIRAGANA);
+  g_string_append_unichar (midasi, 0x3041 + i % N_HIRAGANA);
+  return g_string_free (midasi, FALSE);
+}
+
+static goffset
+file_size (const gchar *path)
+{
+  GStatBuf buf;
+  g_assert_cmpint (g_stat (path, &buf), ==, 0);
+  return buf.st_size;
+}
+
+/* Look up entries spread over the whole dictionary, so that a block
+   dictionary decompresses a block for most of them.  */
+static gdouble
+measure (SkkDict *dict, gint stride)
+{
+  GTimer *timer;
+  gchar **midasi;
+  gint i;
+
+  midasi = g_new0 (gchar *, N_LOOKUPS + 1);
+  for (i = 0; i < N_LOOKUPS; i++)
+    midasi[i] = midasi_at ((gint) (((gint64) i * stride) % N_ENTRIES));
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_LOOKUPS; i++)
+    {
+      SkkCandidate **candidates;
+      gint n_candidates;
+
+      candidates = skk_dict_lookup (dict, midasi[i], FALSE, &n_candidates);
+      g_assert_cmpint (n_candidates, ==, 3);
+      while (--n_candidates >= 0)
+        g_object_unref (candidates[n_candidates]);
+      g_free (candidates);
+    }
+  g_timer_stop (timer);
+  g_strfreev (midasi);
+
+  return g_timer_elapsed (timer, NULL) / N_LOOKUPS;
+}
+
+static void
+size_and_latency (void)
+{
+  SkkFileDict *file_dict;
+  GError *error = NULL;
+  gdouble elapsed, ratio;
+  gchar *path;
+  gint i;
+
+  if (!g_test_perf ())
+    return;
+
+  path = create_dict ();
+  file_dict = skk_file_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+
+  g_test_message ("file dict: %" G_GOFFSET_FORMAT " bytes", file_size (path));
+  elapsed = measure (SKK_DICT (file_dict), 7919);
+  g_test_minimized_result (elapsed, "file dict lookup: %.6f s", elapsed);
+
+  for (i = 0; i < G_N_ELEMENTS (block_sizes); i++)
+    {
+      SkkBlockDict *dict;
+      gchar *block_path = g_strconcat (path, ".skkz", NULL);
+
+      skk_block_dict_compress (path, block_path, "UTF-8", block_sizes[i],
+                               &error);
+      g_assert_no_error (error);
+      dict = skk_block_dict_new (block_path, &error);
+      g_assert_no_error (error);
+
+      ratio = (gdouble) file_size (block_path) / file_size (path);
+      g_test_minimized_result (ratio,
+                               "block dict (%u): %" G_GOFFSET_FORMAT
+                               " bytes, %.1f%% of file dict",
+                               block_sizes[i],
+                               file_size (block_path),
+                               100.0 * ratio);
+      /* a large stride touches a new block on each lookup, a stride
+         of 1 is mostly served from the block cache */
+      elapsed = measure (SKK_DICT (dict), 7919);
+      g_test_minimized_result (elapsed,
+                               "block dict (%u) lookup: %.6f s",
+                               block_sizes[i], elapsed);
+      elapsed = measure (SKK_DICT (dict), 1);
+      g_test_minimized_result (elapsed,
+                               "block dict (%u) cached lookup: %.6f s",
+                               block_sizes[i], elapsed);
+
+      g_object_unref (dict);
+      g_unlink (block_path);
+      g_free (block_path);
+    }
+
+  g_object_unref (file_dict);
+  g_unlink (path);
+  g_free (path);
+}
+
+int
+main (int argc, char **argv) {
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/block-dict-bench/size-and-latency",
+                   size_and_latency);
+  return g_test_run ();
+}
@@ -0,0 +1,163 @@
+#include <libskk/libskk.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static gchar *
+join_candidates (SkkDict *dict, const gchar *midasi, gboolean okuri)
+{
+  SkkCandidate **candidates;
+  GString *texts = g_string_new ("");
+  gint len, i;
+
+  candidates = skk_dict_lookup (dict, midasi, okuri, &len);
+  for (i = 0; i < len; i++) {
+    gchar *str = skk_candidate_to_string (candidates[i]);
+    g_string_append_printf (texts, "/%s", str);
+    g_free (str);
+    g_object_unref (candidates[i]);
+  }
+  g_free (candidates);
+  return g_string_free (texts, FALSE);
+}
+
+static int
+compare_strings (const void *a, const void *b)
+{
+  return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+static gchar *
+join_completion (SkkDict *dict, const gchar *midasi, gboolean okuri)
+{
+  gchar **completion;
+  gchar *joined;
+  gint len;
+
+  /* the order follows the encoding of the file dictionary, so
+     compare them sorted */
+  completion = skk_dict_complete_prefix (dict, midasi, okuri, -1, &len);
+  qsort (completion, len, sizeof (gchar *), compare_strings);
+  joined = g_strjoinv ("/", completion);
+  g_strfreev (completion);
+  return joined;
+}
+
+static void
+compare (SkkDict *expected, SkkDict *actual)
+{
+  static const struct {
+    const gchar *midasi;
+    gboolean okuri;
+  } lookups[] = {
+    { "かんじ", FALSE },
+    { "あい", FALSE },
+    { "あu", TRUE },
+    { "かk", TRUE },
+    { "ん", FALSE },
+    { "", FALSE }
+  };
+  static const struct {
+    const gchar *midasi;
+    gboolean okuri;
+  } prefixes[] = {
+    { "か", FALSE },
+    { "かん", FALSE },
+    { "あ", FALSE },
+    { "ん", FALSE },
+    { "zzz", FALSE },
+    { "あら", TRUE },
+    { "か", TRUE },
+    { "zzz", TRUE }
+  };
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (lookups); i++) {
+    gchar *a, *b;
+
+    a = join_candidates (expected, lookups[i].midasi, lookups[i].okuri);
+    b = join_candidates (actual, lookups[i].midasi, lookups[i].okuri);
+    g_assert_cmpstr (b, ==, a);
+    g_free (a);
+    g_free (b);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (prefixes); i++) {
+    gchar *a, *b;
+
+    a = join_completion (expected, prefixes[i].midasi, prefixes[i].okuri);
+    b = join_completion (actual, prefixes[i].midasi, prefixes[i].okuri);
+    g_assert_cmpstr (b, ==, a);
+    g_free (a);
+    g_free (b);
+  }
+}
+
+static void
+block_dict (void)
+{
+  static const guint block_sizes[] = { 64, 8192 };
+  const gchar *path = "block-dict.skkz";
+  GError *error = NULL;
+  SkkFileDict *file_dict;
+  gint i;
+
+  file_dict = skk_file_dict_new (LIBSKK_FILE_DICT, "EUC-JP", &error);
+  g_assert_no_error (error);
+
+  for (i = 0; i < G_N_ELEMENTS (block_sizes); i++) {
+    SkkBlockDict *dict;
+    SkkMemoryUsage usage;
+    gboolean read_only;
+    gchar **completion;
+    gint len;
+
+    skk_block_dict_compress (LIBSKK_FILE_DICT, path, "EUC-JP",
+                             block_sizes[i], &error);
+    g_assert_no_error (error);
+
+    dict = skk_block_dict_new (path, &error);
+    g_assert_no_error (error);
+
+    g_assert (skk_dict_get_read_only (SKK_DICT (dict)));
+    g_object_get (dict, "read-only", &read_only, NULL);
+    g_assert (read_only);
+
+    compare (SKK_DICT (file_dict), SKK_DICT (dict));
+    /* once more, from the block cache */
+    compare (SKK_DICT (file_dict), SKK_DICT (dict));
+
+    /* okuri-ari entries come in descending order, as in file
+       dictionaries, and the limit keeps the first ones */
+    completion = skk_dict_complete_prefix (SKK_DICT (dict), "あら", TRUE, -1,
+                                           &len);
+    g_assert_cmpint (len, ==, 7);
+    g_assert_cmpstr (completion[0], ==, "あらわs");
+    g_assert_cmpstr (completion[6], ==, "あらi");
+    g_strfreev (completion);
+
+    completion = skk_dict_complete_prefix (SKK_DICT (dict), "あら", TRUE, 2,
+                                           &len);
+    g_assert_cmpint (len, ==, 2);
+    g_assert_cmpstr (completion[0], ==, "あらわs");
+    g_strfreev (completion);
+
+    skk_dict_get_memory_usage (SKK_DICT (dict), &usage);
+    g_assert_cmpuint (usage.entries, >, 0);
+    g_assert_cmpuint (usage.mapped_bytes, >, 0);
+
+    g_object_unref (dict);
+    g_unlink (path);
+  }
+
+  g_object_unref (file_dict);
+}
+
+int
+main (int argc, char **argv)
+{
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/block-dict", block_dict);
+  return g_test_run ();
+}
@@ -0,0 +1,174 @@
+#include <libskk/libskk.h>
+#include <glib/gstdio.h>
+#include "common.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define N_CANDIDATES 200
+#define N_LOOKUPS 2000
+
+static gchar *
+create_dict (void)
+{
+  GString *contents;
+  GError *error = NULL;
+  gchar *path;
+  gint fd, i;
+
+  contents = g_string_new (";; -*- coding: utf-8 -*-\n"
+                           ";; okuri-ari entries.\n"
+                           ";; okuri-nasi entries.\n"
+                           "かんじ /");
+  for (i = 0; i < N_CANDIDATES; i++) {
+    if (i % 2 == 0)
+      g_string_append_printf (contents, "漢字%d/", i);
+    else
+      g_string_append_printf (contents, "漢字%d;注釈%d/", i, i);
+  }
+  g_string_append_c (contents, '\n');
+
+  fd = g_file_open_tmp ("candidate-bench-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+  g_close (fd, NULL);
+  g_file_set_contents (path, contents->str, contents->len, &error);
+  g_assert_no_error (error);
+  g_string_free (contents, TRUE);
+  return path;
+}
+
+static void
+free_candidates (SkkCandidate **candidates, gint n_candidates)
+{
+  gint i;
+
+  for (i = 0; i < n_candidates; i++)
+    g_object_unref (candidates[i]);
+  g_free (candidates);
+}
+
+static void
+lookup (void)
+{
+  SkkFileDict *dict;
+  SkkCandidate **candidates;
+  GError *error = NULL;
+  GTimer *timer;
+  gchar *path;
+  gint n_candidates, i;
+
+  if (!g_test_perf ())
+    return;
+
+  path = create_dict ();
+  dict = skk_file_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_LOOKUPS; i++) {
+    candidates = skk_dict_lookup (SKK_DICT (dict), "かんじ", FALSE,
+                                  &n_candidates);
+    g_assert_cmpint (n_candidates, ==, N_CANDIDATES);
+    free_candidates (candidates, n_candidates);
+  }
+  g_timer_stop (timer);
+  g_test_minimized_result (g_timer_elapsed (timer, NULL) / N_LOOKUPS,
+                           "lookup of %d candidates: %.6f s",
+                           N_CANDIDATES,
+                           g_timer_elapsed (timer, NULL) / N_LOOKUPS);
+  g_timer_destroy (timer);
+
+#ifdef __GLIBC__
+  {
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 before, after;
+#endif
+    gsize n_allocations;
+
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+
+    before = mallinfo2 ();
+#endif
+    start_counting_allocations ();
+    candidates = skk_dict_lookup (SKK_DICT (dict), "かんじ", FALSE,
+                                  &n_candidates);
+    n_allocations = stop_counting_allocations ();
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+    after = mallinfo2 ();
+    g_test_minimized_result ((gdouble) (after.uordblks - before.uordblks)
+                             / N_CANDIDATES,
+                             "heap: %.1f bytes/candidate",
+                             (gdouble) (after.uordblks - before.uordblks)
+                             / N_CANDIDATES);
+#endif
+    g_test_minimized_result ((gdouble) n_allocations / N_CANDIDATES,
+                             "allocations: %.2f/candidate",
+                             (gdouble) n_allocations / N_CANDIDATES);
+    free_candidates (candidates, n_candidates);
+  }
+#endif
+
+  g_object_unref (dict);
+  g_unlink (path);
+  g_free (path);
+}
+
+static void
+merge (void)
+{
+  SkkFileDict *dicts[2];
+  SkkContext *context;
+  SkkCandidateList *candidates;
+  GError *error = NULL;
+  GTimer *timer;
+  gchar *paths[2];
+  gint i;
+
+  /* both dictionaries have the same candidates, so half of the
+     merged ones are duplicates */
+  for (i = 0; i < 2; i++) {
+    paths[i] = create_dict ();
+    dicts[i] = skk_file_dict_new (paths[i], "UTF-8", &error);
+    g_assert_no_error (error);
+  }
+
+  context = skk_context_new ((SkkDict **) dicts, 2);
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+  candidates = skk_context_get_candidates (context);
+
+  skk_context_process_key_events (context, "K a n j i SPC");
+  g_assert_cmpint (skk_candidate_list_get_size (candidates), ==,
+                   N_CANDIDATES);
+  skk_context_reset (context);
+
+  if (g_test_perf ()) {
+    timer = g_timer_new ();
+    for (i = 0; i < N_LOOKUPS; i++) {
+      skk_context_process_key_events (context, "K a n j i SPC");
+      skk_context_reset (context);
+    }
+    g_timer_stop (timer);
+    g_test_minimized_result (g_timer_elapsed (timer, NULL) / N_LOOKUPS,
+                             "merge of %d candidates: %.6f s",
+                             2 * N_CANDIDATES,
+                             g_timer_elapsed (timer, NULL) / N_LOOKUPS);
+    g_timer_destroy (timer);
+  }
+
+  g_object_unref (context);
+  for (i = 0; i < 2; i++) {
+    g_object_unref (dicts[i]);
+    g_unlink (paths[i]);
+    g_free (paths[i]);
+  }
+}
+
+int
+main (int argc, char **argv) {
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/candidate-bench/lookup", lookup);
+  g_test_add_func ("/libskk/candidate-bench/merge", merge);
+  return g_test_run ();
+}
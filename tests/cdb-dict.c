@@ -41,6 +41,21 @@ cdb_dict (void)
   g_assert_cmpint (len, ==, 0);
   g_free (completion);
 
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "合", &len);
+  g_assert_cmpint (len, ==, 2);
+  while (--len >= 0) {
+    g_assert (skk_candidate_get_okuri (candidates[len]));
+    g_object_unref (candidates[len]);
+  }
+  g_free (candidates);
+
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "幹事", &len);
+  g_assert_cmpint (len, ==, 1);
+  g_assert_cmpstr (skk_candidate_get_midasi (candidates[0]), ==, "かんじ");
+  g_assert (!skk_candidate_get_okuri (candidates[0]));
+  g_object_unref (candidates[0]);
+  g_free (candidates);
+
   error = NULL;
   skk_dict_save (SKK_DICT (dict), &error);
   g_assert_no_error (error);
@@ -0,0 +1,52 @@
+#include <glib.h>
+#include "common.h"
+
+#ifdef __GLIBC__
+/* Count the blocks allocated by interposing the allocator; GLib
+   allocates through malloc, calloc and realloc.  Only linked into
+   the benchmarks.  */
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static gboolean counting = FALSE;
+static gsize n_allocations = 0;
+
+void *
+malloc (size_t size)
+{
+  if (counting)
+    n_allocations++;
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  if (counting)
+    n_allocations++;
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  if (counting)
+    n_allocations++;
+  return __libc_realloc (ptr, size);
+}
+
+void
+start_counting_allocations (void)
+{
+  n_allocations = 0;
+  counting = TRUE;
+}
+
+gsize
+stop_counting_allocations (void)
+{
+  counting = FALSE;
+  return n_allocations;
+}
+#endif
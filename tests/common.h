@@ -18,4 +18,10 @@ void        destroy_context   (SkkContext          *context);
 void        check_transitions (SkkContext          *context,
                                const SkkTransition *transitions);
 
+#ifdef __GLIBC__
+/* in common-alloc.c, linked into the benchmarks */
+void        start_counting_allocations (void);
+gsize       stop_counting_allocations  (void);
+#endif
+
 #endif  /* __COMMON_H__ */
@@ -1,4 +1,5 @@
 #include <libskk/libskk.h>
+#include <string.h>
 #include "common.h"
 
 static void
@@ -95,6 +96,159 @@ basic (void)
   destroy_context (context);
 }
 
+static void
+preedit_updated_cb (SkkContext  *context,
+                    guint        offset,
+                    guint        n_deleted,
+                    const gchar *inserted,
+                    gpointer     user_data)
+{
+  GString *mirror = user_data;
+  const gchar *start, *end;
+
+  start = g_utf8_offset_to_pointer (mirror->str, offset);
+  end = g_utf8_offset_to_pointer (start, n_deleted);
+  g_string_erase (mirror, start - mirror->str, end - start);
+  g_string_insert (mirror, start - mirror->str, inserted);
+}
+
+static void
+preedit_updated (void)
+{
+  static const gchar *keys[] = {
+    "A", "i", "SPC", "SPC", "x", "C-g", "K a n", "j", "i", "BackSpace", NULL
+  };
+  SkkContext *context = create_context (TRUE, TRUE);
+  GString *mirror = g_string_new ("");
+  gint i;
+
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+  g_signal_connect (context, "preedit-updated",
+                    G_CALLBACK (preedit_updated_cb), mirror);
+
+  for (i = 0; keys[i] != NULL; i++) {
+    skk_context_process_key_events (context, keys[i]);
+    g_assert_cmpstr (mirror->str, ==, skk_context_get_preedit (context));
+  }
+
+  g_string_free (mirror, TRUE);
+  destroy_context (context);
+}
+
+static gchar *
+lookup_candidates (SkkContext *context, const gchar *keys)
+{
+  SkkCandidateList *candidates;
+  GString *texts = g_string_new ("");
+  gint i;
+
+  skk_context_reset (context);
+  skk_context_process_key_events (context, keys);
+  candidates = skk_context_get_candidates (context);
+  for (i = 0; i < skk_candidate_list_get_size (candidates); i++) {
+    SkkCandidate *candidate = skk_candidate_list_get (candidates, i);
+    g_string_append_printf (texts, "/%s", skk_candidate_get_text (candidate));
+    g_object_unref (candidate);
+  }
+  skk_context_reset (context);
+  return g_string_free (texts, FALSE);
+}
+
+static void
+parallel_lookup (void)
+{
+  static const gchar *keys[] = {
+    "A i SPC", "K a n j i SPC", "A U", "N a n n n i SPC", NULL
+  };
+  SkkContext *context = create_context (TRUE, TRUE);
+  gint i;
+
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+  for (i = 0; keys[i] != NULL; i++) {
+    gchar *sequential, *parallel;
+
+    skk_context_set_parallel_lookup (context, FALSE);
+    sequential = lookup_candidates (context, keys[i]);
+    skk_context_set_parallel_lookup (context, TRUE);
+    skk_context_set_lookup_timeout (context, 0);
+    parallel = lookup_candidates (context, keys[i]);
+    g_assert_cmpstr (parallel, ==, sequential);
+    g_free (parallel);
+
+    /* a generous deadline should not drop anything */
+    skk_context_set_lookup_timeout (context, 10000);
+    parallel = lookup_candidates (context, keys[i]);
+    g_assert_cmpstr (parallel, ==, sequential);
+    g_free (parallel);
+    g_free (sequential);
+  }
+
+  destroy_context (context);
+}
+
+static void
+prefetch (void)
+{
+  static const gchar *keys[] = {
+    "K a n j i SPC", "K a K u", "A i SPC", NULL
+  };
+  SkkContext *context = create_context (TRUE, TRUE);
+  gint i;
+
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+  for (i = 0; keys[i] != NULL; i++) {
+    gchar *sequential, *prefetched;
+
+    skk_context_set_prefetch (context, FALSE);
+    sequential = lookup_candidates (context, keys[i]);
+    skk_context_set_prefetch (context, TRUE);
+    prefetched = lookup_candidates (context, keys[i]);
+    g_assert_cmpstr (prefetched, ==, sequential);
+    g_free (prefetched);
+    g_free (sequential);
+  }
+  g_assert_cmpuint (skk_context_get_prefetch_hits (context), ==, 3);
+  g_assert_cmpuint (skk_context_get_prefetch_misses (context), ==, 0);
+
+  destroy_context (context);
+
+  /* the user dictionary is not prefetched, so nothing is used */
+  context = create_context (TRUE, FALSE);
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+  skk_context_set_prefetch (context, TRUE);
+  g_free (lookup_candidates (context, keys[0]));
+  g_assert_cmpuint (skk_context_get_prefetch_hits (context), ==, 0);
+  g_assert_cmpuint (skk_context_get_prefetch_misses (context), ==, 1);
+
+  destroy_context (context);
+}
+
+static void
+memory_usage (void)
+{
+  SkkContext *context = create_context (TRUE, TRUE);
+  SkkMemoryUsage usage, after;
+  gchar *report;
+
+  skk_context_get_memory_usage (context, &usage);
+  g_assert_cmpuint (usage.heap_bytes, >, 0);
+  g_assert_cmpuint (usage.entries, >, 0);
+
+  /* candidates are counted while converting */
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+  skk_context_process_key_events (context, "A i SPC");
+  skk_context_get_memory_usage (context, &after);
+  g_assert_cmpuint (after.heap_bytes, >, usage.heap_bytes);
+  g_assert_cmpuint (after.entries, >, usage.entries);
+
+  report = skk_context_get_memory_usage_report (context);
+  g_assert (strstr (report, "candidates") != NULL);
+  g_assert (strstr (report, "total") != NULL);
+  g_free (report);
+
+  destroy_context (context);
+}
+
 int
 main (int argc, char **argv) {
   skk_init ();
@@ -102,5 +256,9 @@ main (int argc, char **argv) {
   g_test_add_func ("/libskk/context/dictionary",
                    dictionary);
   g_test_add_func ("/libskk/context/basic", basic);
+  g_test_add_func ("/libskk/context/preedit-updated", preedit_updated);
+  g_test_add_func ("/libskk/context/parallel-lookup", parallel_lookup);
+  g_test_add_func ("/libskk/context/prefetch", prefetch);
+  g_test_add_func ("/libskk/context/memory-usage", memory_usage);
   return g_test_run ();
 }
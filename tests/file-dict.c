@@ -1,4 +1,5 @@
 #include <libskk/libskk.h>
+#include <glib/gstdio.h>
 
 static void
 file_dict (void)
@@ -38,11 +39,268 @@ file_dict (void)
   g_object_unref (dict);
 }
 
+static void
+complete_prefix (void)
+{
+  GError *error = NULL;
+  SkkFileDict *dict = skk_file_dict_new (LIBSKK_FILE_DICT, "EUC-JP", &error);
+  g_assert_no_error (error);
+
+  gchar **completion, **limited;
+  gint len, limited_len, i;
+
+  /* okuri-ari entries are sorted in descending order */
+  completion = skk_dict_complete_prefix (SKK_DICT (dict), "あら", TRUE, -1,
+                                         &len);
+  g_assert_cmpint (len, ==, 7);
+  g_assert_cmpstr (completion[0], ==, "あらわs");
+  g_assert_cmpstr (completion[6], ==, "あらi");
+  g_strfreev (completion);
+
+  completion = skk_dict_complete_prefix (SKK_DICT (dict), "あらわs", TRUE, -1,
+                                         &len);
+  g_assert_cmpint (len, ==, 0);
+  g_strfreev (completion);
+
+  /* the limit keeps the first ones */
+  completion = skk_dict_complete (SKK_DICT (dict), "か", &len);
+  g_assert_cmpint (len, >, 5);
+  limited = skk_dict_complete_prefix (SKK_DICT (dict), "か", FALSE, 5,
+                                      &limited_len);
+  g_assert_cmpint (limited_len, ==, 5);
+  for (i = 0; i < limited_len; i++)
+    g_assert_cmpstr (limited[i], ==, completion[i]);
+  g_strfreev (limited);
+  g_strfreev (completion);
+
+  completion = skk_dict_complete_prefix (SKK_DICT (dict), "zzz", FALSE, -1,
+                                         &len);
+  g_assert_cmpint (len, ==, 0);
+  g_strfreev (completion);
+
+  g_object_unref (dict);
+}
+
+static void
+write_dict (const gchar *path, const gchar *entries)
+{
+  gchar *contents;
+  GError *error = NULL;
+
+  /* the boundaries must follow a newline, as in real dictionaries */
+  contents = g_strconcat (";; -*- coding: utf-8 -*-\n",
+                          ";; okuri-ari entries.\n",
+                          ";; okuri-nasi entries.\n",
+                          entries,
+                          NULL);
+  g_file_set_contents (path, contents, -1, &error);
+  g_assert_no_error (error);
+  g_free (contents);
+}
+
+static void
+reload (void)
+{
+  const gchar *path = "file-dict-reload.dat";
+  GError *error = NULL;
+  SkkFileDict *dict;
+  SkkCandidate **candidates;
+  gint len;
+
+  write_dict (path, "a /A/\n");
+  dict = skk_file_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+
+  /* keep a candidate from the old mapping across reload */
+  candidates = skk_dict_lookup (SKK_DICT (dict), "a", FALSE, &len);
+  g_assert_cmpint (len, ==, 1);
+
+  /* make sure that the etag changes */
+  g_usleep (G_USEC_PER_SEC);
+  write_dict (path, "a /A/\nb /B/BB/\n");
+  skk_dict_reload (SKK_DICT (dict), &error);
+  g_assert_no_error (error);
+
+  g_assert_cmpstr (skk_candidate_get_text (candidates[0]), ==, "A");
+  while (--len >= 0) {
+    g_object_unref (candidates[len]);
+  }
+  g_free (candidates);
+
+  candidates = skk_dict_lookup (SKK_DICT (dict), "b", FALSE, &len);
+  g_assert_cmpint (len, ==, 2);
+  while (--len >= 0) {
+    g_object_unref (candidates[len]);
+  }
+  g_free (candidates);
+
+  g_object_unref (dict);
+  g_unlink (path);
+}
+
+static void
+reloaded_cb (SkkDict *dict, gpointer user_data)
+{
+  gint *count = user_data;
+  (*count)++;
+}
+
+static gboolean
+quit_cb (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+auto_reload (void)
+{
+  const gchar *path = "file-dict-auto-reload.dat";
+  GError *error = NULL;
+  SkkFileDict *dict;
+  SkkCandidate **candidates;
+  GMainLoop *loop;
+  gint count = 0;
+  gint len;
+
+  write_dict (path, "a /A/\n");
+  dict = skk_file_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  skk_dict_set_auto_reload (SKK_DICT (dict), TRUE);
+  g_assert (skk_dict_get_auto_reload (SKK_DICT (dict)));
+  g_signal_connect (dict, "reloaded", G_CALLBACK (reloaded_cb), &count);
+
+  /* make sure that the etag changes */
+  g_usleep (G_USEC_PER_SEC);
+
+  /* a burst of writes is coalesced into a single reload */
+  write_dict (path, "a /A/\n");
+  write_dict (path, "a /A/\nb /B/\n");
+  write_dict (path, "a /A/\nb /B/BB/\n");
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_timeout_add (2000, quit_cb, loop);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+
+  g_assert_cmpint (count, ==, 1);
+  candidates = skk_dict_lookup (SKK_DICT (dict), "b", FALSE, &len);
+  g_assert_cmpint (len, ==, 2);
+  while (--len >= 0) {
+    g_object_unref (candidates[len]);
+  }
+  g_free (candidates);
+
+  g_object_unref (dict);
+  g_unlink (path);
+}
+
+static void
+reverse_lookup (void)
+{
+  GError *error = NULL;
+  SkkFileDict *dict = skk_file_dict_new (LIBSKK_FILE_DICT, "EUC-JP", &error);
+  g_assert_no_error (error);
+
+  gint len;
+  SkkCandidate **candidates;
+
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "幹事", &len);
+  g_assert_cmpint (len, ==, 1);
+  g_assert_cmpstr (skk_candidate_get_midasi (candidates[0]), ==, "かんじ");
+  g_assert (!skk_candidate_get_okuri (candidates[0]));
+  while (--len >= 0) {
+    g_object_unref (candidates[len]);
+  }
+  g_free (candidates);
+
+  /* okuri-ari entries come first, in the order of the file */
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "会", &len);
+  g_assert_cmpint (len, ==, 4);
+  g_assert_cmpstr (skk_candidate_get_midasi (candidates[0]), ==, "あu");
+  g_assert (skk_candidate_get_okuri (candidates[0]));
+  g_assert_cmpstr (skk_candidate_get_midasi (candidates[1]), ==, "あi");
+  g_assert_cmpstr (skk_candidate_get_midasi (candidates[2]), ==, "え");
+  g_assert (!skk_candidate_get_okuri (candidates[2]));
+  g_assert_cmpstr (skk_candidate_get_midasi (candidates[3]), ==, "かい");
+  while (--len >= 0) {
+    g_object_unref (candidates[len]);
+  }
+  g_free (candidates);
+
+  /* a prefix of a candidate is not a candidate */
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "漢", &len);
+  g_assert_cmpint (len, ==, 0);
+  g_free (candidates);
+
+  g_object_unref (dict);
+
+  /* the index cached by the first dictionary is reused */
+  dict = skk_file_dict_new (LIBSKK_FILE_DICT, "EUC-JP", &error);
+  g_assert_no_error (error);
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "幹事", &len);
+  g_assert_cmpint (len, ==, 1);
+  while (--len >= 0) {
+    g_object_unref (candidates[len]);
+  }
+  g_free (candidates);
+  g_object_unref (dict);
+}
+
+static void
+reverse_index_cache (void)
+{
+  const gchar *path = "file-dict-reverse-index.dat";
+  GError *error = NULL;
+  SkkFileDict *dict;
+  SkkCandidate **candidates;
+  gchar *name, *cache_path;
+  gint len;
+
+  write_dict (path, "a /A/\n");
+  dict = skk_file_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "A", &len);
+  g_assert_cmpint (len, ==, 1);
+  g_object_unref (candidates[0]);
+  g_free (candidates);
+  g_object_unref (dict);
+
+  /* the index is cached once per dictionary path */
+  name = g_compute_checksum_for_string (G_CHECKSUM_SHA1, path, -1);
+  cache_path = g_build_filename (g_get_user_cache_dir (),
+                                 "libskk", "reverse-index", name, NULL);
+  g_assert (g_file_test (cache_path, G_FILE_TEST_EXISTS));
+
+  /* a new version of the same size replaces the stale index */
+  g_usleep (G_USEC_PER_SEC);
+  write_dict (path, "b /A/\n");
+  dict = skk_file_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "A", &len);
+  g_assert_cmpint (len, ==, 1);
+  g_assert_cmpstr (skk_candidate_get_midasi (candidates[0]), ==, "b");
+  g_object_unref (candidates[0]);
+  g_free (candidates);
+  g_object_unref (dict);
+  g_assert (g_file_test (cache_path, G_FILE_TEST_EXISTS));
+
+  g_free (cache_path);
+  g_free (name);
+  g_unlink (path);
+}
+
 int
 main (int argc, char **argv)
 {
   skk_init ();
   g_test_init (&argc, &argv, NULL);
   g_test_add_func ("/libskk/file-dict", file_dict);
+  g_test_add_func ("/libskk/file-dict/reload", reload);
+  g_test_add_func ("/libskk/file-dict/auto-reload", auto_reload);
+  g_test_add_func ("/libskk/file-dict/complete-prefix", complete_prefix);
+  g_test_add_func ("/libskk/file-dict/reverse-lookup", reverse_lookup);
+  g_test_add_func ("/libskk/file-dict/reverse-index-cache",
+                   reverse_index_cache);
   return g_test_run ();
 }
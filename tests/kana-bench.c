@@ -0,0 +1,86 @@
+#include <libskk/libskk.h>
+#include "common.h"
+
+#define N_RULE_LOADS 200
+#define N_CONVERSIONS 2000
+
+static gdouble
+measure_rule_load (const gchar *name)
+{
+  GTimer *timer;
+  gdouble elapsed;
+  gint i;
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_RULE_LOADS; i++) {
+    GError *error = NULL;
+    SkkRule *rule = skk_rule_new (name, &error);
+    g_assert_no_error (error);
+    g_object_unref (rule);
+  }
+  g_timer_stop (timer);
+  elapsed = g_timer_elapsed (timer, NULL) / N_RULE_LOADS;
+  g_timer_destroy (timer);
+  return elapsed;
+}
+
+/* A bundled rule is built from the tables compiled in; a rule in the
+   data path is parsed and every rom-kana entry is converted to
+   katakana and hankaku katakana.  test-sticky only includes the
+   default rule, so both load the same entries. */
+static void
+rule_load (void)
+{
+  gdouble elapsed;
+
+  if (!g_test_perf ())
+    return;
+
+  elapsed = measure_rule_load ("tutcode");
+  g_test_minimized_result (elapsed, "rule load: %.6f s", elapsed);
+  elapsed = measure_rule_load ("default");
+  g_test_minimized_result (elapsed, "bundled rule load: %.6f s", elapsed);
+  elapsed = measure_rule_load ("test-sticky");
+  g_test_minimized_result (elapsed, "parsed rule load: %.6f s", elapsed);
+}
+
+/* Converting the preedit to katakana goes through the same tables. */
+static void
+mode_conversion (void)
+{
+  SkkContext *context;
+  GTimer *timer;
+  gint i;
+
+  if (!g_test_perf ())
+    return;
+
+  context = create_context (FALSE, FALSE);
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_CONVERSIONS; i++) {
+    gchar *output;
+    skk_context_process_key_events (context,
+                                    "K a g a k u g i j u t s u d a i g a k u q");
+    output = skk_context_poll_output (context);
+    g_assert_cmpstr (output, ==, "カガクギジュツダイガク");
+    g_free (output);
+  }
+  g_timer_stop (timer);
+  g_test_minimized_result (g_timer_elapsed (timer, NULL) / N_CONVERSIONS,
+                           "katakana conversion: %.6f s",
+                           g_timer_elapsed (timer, NULL) / N_CONVERSIONS);
+  g_timer_destroy (timer);
+
+  destroy_context (context);
+}
+
+int
+main (int argc, char **argv) {
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/kana-bench/rule-load", rule_load);
+  g_test_add_func ("/libskk/kana-bench/mode-conversion", mode_conversion);
+  return g_test_run ();
+}
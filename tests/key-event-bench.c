@@ -0,0 +1,145 @@
+#include <libskk/libskk.h>
+#include "common.h"
+
+#define N_ITERATIONS 20000
+/* number of keys in the sequence below */
+#define N_EVENTS 17
+
+static void
+process_key_events (void)
+{
+  SkkContext *context;
+  GTimer *timer;
+  gint i;
+
+  if (!g_test_perf ())
+    return;
+
+  context = create_context (FALSE, FALSE);
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_ITERATIONS; i++) {
+    skk_context_process_key_events (context,
+                                    "k o n n n i t i h a (control j) "
+                                    "s e k a i RET");
+    skk_context_clear_output (context);
+  }
+  g_timer_stop (timer);
+  g_test_maximized_result (N_ITERATIONS * N_EVENTS / g_timer_elapsed (timer, NULL),
+                           "%.0f events/s",
+                           N_ITERATIONS * N_EVENTS / g_timer_elapsed (timer, NULL));
+  g_timer_destroy (timer);
+
+  destroy_context (context);
+}
+
+/* Keys driving each of the state handlers; every sequence returns
+   to the initial state.  */
+static const struct {
+  const gchar *name;
+  const gchar *keys;
+} handler_keys[] = {
+  { "none", "a i u e o k a k i k u" },
+  { "start", "K a k i k u k e k o C-g" },
+  { "select", "K a i SPC SPC SPC SPC x x x C-g C-g" },
+  { "abbrev", "/ a b b r e v BackSpace BackSpace C-g" },
+  { "kuten", "\\\\ 3 0 2 2 BackSpace BackSpace BackSpace BackSpace C-g" }
+};
+
+static void
+handlers (void)
+{
+  SkkContext *context;
+  guint i;
+
+  if (!g_test_perf ())
+    return;
+
+  context = create_context (FALSE, TRUE);
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+
+  for (i = 0; i < G_N_ELEMENTS (handler_keys); i++) {
+    gchar **events = g_strsplit (handler_keys[i].keys, " ", -1);
+    guint n_events = g_strv_length (events);
+    GTimer *timer;
+    gdouble rate;
+    gint j;
+
+    g_strfreev (events);
+
+    timer = g_timer_new ();
+    for (j = 0; j < N_ITERATIONS; j++) {
+      skk_context_process_key_events (context, handler_keys[i].keys);
+      skk_context_reset (context);
+      skk_context_clear_output (context);
+    }
+    g_timer_stop (timer);
+    rate = N_ITERATIONS * n_events / g_timer_elapsed (timer, NULL);
+    g_test_maximized_result (rate, "%s: %.0f events/s",
+                             handler_keys[i].name, rate);
+    g_timer_destroy (timer);
+  }
+
+  destroy_context (context);
+}
+
+/* Typing and deleting in the preedit only goes through the start
+   state handler and the rom-kana converter.  */
+static void
+allocations (void)
+{
+#ifdef __GLIBC__
+  static const gchar *keys[] = {
+    "K", "a", "n", "j", "i", "BackSpace", "BackSpace", "BackSpace",
+    "BackSpace", "BackSpace", NULL
+  };
+  SkkContext *context;
+  GPtrArray *events;
+  gsize n_allocations;
+  gint i, j;
+
+  if (!g_test_perf ())
+    return;
+
+  context = create_context (FALSE, FALSE);
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+
+  events = g_ptr_array_new_with_free_func (g_object_unref);
+  for (i = 0; keys[i] != NULL; i++) {
+    GError *error = NULL;
+    SkkKeyEvent *key = skk_key_event_new_from_string (keys[i], &error);
+    g_assert_no_error (error);
+    g_ptr_array_add (events, key);
+  }
+
+  start_counting_allocations ();
+  for (i = 0; i < N_ITERATIONS; i++) {
+    for (j = 0; j < events->len; j++)
+      skk_context_process_key_event (context,
+                                     g_ptr_array_index (events, j));
+    skk_context_reset (context);
+  }
+  n_allocations = stop_counting_allocations ();
+
+  g_test_minimized_result ((gdouble) n_allocations
+                           / (N_ITERATIONS * events->len),
+                           "allocations: %.2f/keystroke",
+                           (gdouble) n_allocations
+                           / (N_ITERATIONS * events->len));
+
+  g_ptr_array_unref (events);
+  destroy_context (context);
+#endif
+}
+
+int
+main (int argc, char **argv) {
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/key-event-bench/process-key-events",
+                   process_key_events);
+  g_test_add_func ("/libskk/key-event-bench/handlers", handlers);
+  g_test_add_func ("/libskk/key-event-bench/allocations", allocations);
+  return g_test_run ();
+}
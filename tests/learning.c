@@ -0,0 +1,266 @@
+#include <libskk/libskk.h>
+#include <glib/gstdio.h>
+#include "common.h"
+
+static void
+record_evicted_cb (SkkLearningStore *store,
+                   const gchar      *midasi,
+                   gboolean          okuri,
+                   const gchar      *text,
+                   gpointer          user_data)
+{
+  gchar **evicted = user_data;
+  g_free (*evicted);
+  *evicted = g_strdup (text);
+}
+
+static void
+record (SkkLearningStore *store, const gchar *text)
+{
+  SkkCandidate *candidate = skk_candidate_new ("a", FALSE, text, NULL, NULL);
+  skk_learning_store_record (store, candidate);
+  g_object_unref (candidate);
+}
+
+static void
+eviction (void)
+{
+  SkkLearningStore *store;
+  SkkLearningUsage usage;
+  gchar *evicted = NULL;
+  GError *error = NULL;
+
+  store = skk_learning_store_new (NULL, &error);
+  g_assert_no_error (error);
+  skk_learning_store_set_max_entries (store, 2);
+  g_signal_connect (store, "evicted",
+                    G_CALLBACK (record_evicted_cb), &evicted);
+
+  /* LRU drops the oldest one even if used more often */
+  record (store, "A");
+  record (store, "A");
+  record (store, "B");
+  record (store, "C");
+  g_assert_cmpstr (evicted, ==, "A");
+  g_assert_cmpint (skk_learning_store_get_size (store), ==, 2);
+
+  /* LFU drops the least used one, the oldest among ties */
+  skk_learning_store_set_policy (store, SKK_EVICTION_POLICY_LFU);
+  record (store, "C");
+  record (store, "D");
+  g_assert_cmpstr (evicted, ==, "B");
+
+  skk_learning_store_get_usage (store, "a", FALSE, &usage);
+  g_assert_cmpint (usage.count, ==, 6);
+
+  /* lowering the limit shrinks the store at once */
+  skk_learning_store_set_max_entries (store, 1);
+  g_assert_cmpint (skk_learning_store_get_size (store), ==, 1);
+  g_assert_cmpstr (evicted, ==, "D");
+
+  g_free (evicted);
+  g_object_unref (store);
+}
+
+static void
+forgetting (void)
+{
+  SkkLearningStore *store;
+  SkkLearningUsage usage;
+  SkkCandidate *candidate;
+  GError *error = NULL;
+
+  store = skk_learning_store_new (NULL, &error);
+  g_assert_no_error (error);
+  record (store, "A");
+  record (store, "A");
+  record (store, "B");
+
+  /* the forgotten selections no longer count for the midasi */
+  candidate = skk_candidate_new ("a", FALSE, "A", NULL, NULL);
+  skk_learning_store_forget (store, candidate);
+  g_object_unref (candidate);
+  skk_learning_store_get_usage (store, "a", FALSE, &usage);
+  g_assert_cmpint (usage.count, ==, 1);
+
+  /* and the midasi is dropped with its last candidate */
+  candidate = skk_candidate_new ("a", FALSE, "B", NULL, NULL);
+  skk_learning_store_forget (store, candidate);
+  g_object_unref (candidate);
+  skk_learning_store_get_usage (store, "a", FALSE, &usage);
+  g_assert_cmpint (usage.count, ==, 0);
+  g_assert_cmpint (usage.last_used, ==, 0);
+  g_assert_cmpint (skk_learning_store_get_size (store), ==, 0);
+
+  g_object_unref (store);
+}
+
+static gboolean
+has_midasi (SkkDict *dict, const gchar *midasi)
+{
+  SkkCandidate **candidates;
+  gint n_candidates, i;
+
+  candidates = skk_dict_lookup (dict, midasi, FALSE, &n_candidates);
+  for (i = 0; i < n_candidates; i++)
+    g_object_unref (candidates[i]);
+  g_free (candidates);
+  return n_candidates > 0;
+}
+
+static void
+select_in (SkkLearningStore *store, SkkDict *dict, const gchar *midasi)
+{
+  SkkCandidate *candidate = skk_candidate_new (midasi, FALSE, "X",
+                                               NULL, NULL);
+  if (store)
+    skk_learning_store_record (store, candidate);
+  skk_dict_select_candidate (dict, candidate);
+  g_object_unref (candidate);
+}
+
+static void
+user_dict_eviction (void)
+{
+  SkkLearningStore *store;
+  SkkUserDict *dict;
+  GError *error = NULL;
+
+  g_remove ("learning-user-dict.dat");
+  store = skk_learning_store_new (NULL, &error);
+  g_assert_no_error (error);
+  dict = skk_user_dict_new ("learning-user-dict.dat", "UTF-8", &error);
+  g_assert_no_error (error);
+  skk_user_dict_set_learning (dict, store);
+  skk_user_dict_set_max_entries (dict, 2);
+
+  /* the least recently selected midasi goes */
+  select_in (store, SKK_DICT (dict), "a");
+  select_in (store, SKK_DICT (dict), "b");
+  select_in (store, SKK_DICT (dict), "a");
+  select_in (store, SKK_DICT (dict), "c");
+  g_assert (has_midasi (SKK_DICT (dict), "a"));
+  g_assert (!has_midasi (SKK_DICT (dict), "b"));
+  g_assert (has_midasi (SKK_DICT (dict), "c"));
+
+  /* a midasi unknown to the store goes first, but not the one
+     just selected */
+  select_in (NULL, SKK_DICT (dict), "d");
+  g_assert (!has_midasi (SKK_DICT (dict), "a"));
+  g_assert (has_midasi (SKK_DICT (dict), "d"));
+  select_in (store, SKK_DICT (dict), "e");
+  g_assert (has_midasi (SKK_DICT (dict), "c"));
+  g_assert (!has_midasi (SKK_DICT (dict), "d"));
+  g_assert (has_midasi (SKK_DICT (dict), "e"));
+
+  /* lowering the limit shrinks the dictionary at once */
+  skk_user_dict_set_max_entries (dict, 1);
+  g_assert (!has_midasi (SKK_DICT (dict), "c"));
+  g_assert (has_midasi (SKK_DICT (dict), "e"));
+
+  /* and so does loading a dictionary over the limit */
+  select_in (NULL, SKK_DICT (dict), "f");
+  skk_user_dict_set_max_entries (dict, 0);
+  select_in (NULL, SKK_DICT (dict), "g");
+  skk_dict_save (SKK_DICT (dict), &error);
+  g_assert_no_error (error);
+  g_object_unref (dict);
+  dict = skk_user_dict_new ("learning-user-dict.dat", "UTF-8", &error);
+  g_assert_no_error (error);
+  skk_user_dict_set_max_entries (dict, 1);
+  g_assert (has_midasi (SKK_DICT (dict), "g"));
+  g_assert (!has_midasi (SKK_DICT (dict), "f"));
+  skk_dict_save (SKK_DICT (dict), &error);
+  g_assert_no_error (error);
+
+  g_object_unref (dict);
+  g_object_unref (store);
+  g_remove ("learning-user-dict.dat");
+}
+
+static void
+ranking (void)
+{
+  SkkContext *context;
+  SkkLearningStore *store;
+  gchar *output;
+  GError *error = NULL;
+
+  context = create_context (FALSE, TRUE);
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+  store = skk_learning_store_new (NULL, &error);
+  g_assert_no_error (error);
+  skk_context_set_learning (context, store);
+
+  skk_context_process_key_events (context, "K a n j i SPC");
+  g_assert_cmpstr (skk_context_get_preedit (context), ==, "▼漢字");
+  skk_context_process_key_events (context, "SPC RET");
+  output = skk_context_poll_output (context);
+  g_assert_cmpstr (output, ==, "幹事");
+  g_free (output);
+
+  /* the file dictionary is read-only; the order comes from the store */
+  skk_context_process_key_events (context, "K a n j i SPC");
+  g_assert_cmpstr (skk_context_get_preedit (context), ==, "▼幹事");
+  skk_context_reset (context);
+
+  g_object_unref (store);
+  destroy_context (context);
+}
+
+static void
+saving (void)
+{
+  SkkDict *dictionaries[2];
+  SkkContext *context;
+  SkkLearningStore *store;
+  GError *error = NULL;
+
+  g_remove ("learning-saving-user-dict.dat");
+  g_remove ("learning-saving.dat");
+  dictionaries[0] = SKK_DICT (skk_user_dict_new ("learning-saving-user-dict.dat",
+                                                 "UTF-8", &error));
+  g_assert_no_error (error);
+  dictionaries[1] = SKK_DICT (skk_file_dict_new (LIBSKK_FILE_DICT, "EUC-JP",
+                                                 &error));
+  g_assert_no_error (error);
+  context = skk_context_new (dictionaries, 2);
+  skk_context_set_input_mode (context, SKK_INPUT_MODE_HIRAGANA);
+  store = skk_learning_store_new ("learning-saving.dat", &error);
+  g_assert_no_error (error);
+  skk_context_set_learning (context, store);
+
+  /* a new entry in the user dictionary saves both */
+  skk_context_process_key_events (context, "K a n j i SPC RET");
+  g_assert (g_file_test ("learning-saving.dat", G_FILE_TEST_EXISTS));
+
+  /* committing the first candidate again saves nothing */
+  g_remove ("learning-saving.dat");
+  skk_context_process_key_events (context, "K a n j i SPC RET");
+  g_assert (!g_file_test ("learning-saving.dat", G_FILE_TEST_EXISTS));
+
+  /* until the next save */
+  skk_context_save_dictionaries (context, &error);
+  g_assert_no_error (error);
+  g_assert (g_file_test ("learning-saving.dat", G_FILE_TEST_EXISTS));
+
+  g_object_unref (store);
+  g_object_unref (context);
+  g_object_unref (dictionaries[0]);
+  g_object_unref (dictionaries[1]);
+  g_remove ("learning-saving-user-dict.dat");
+  g_remove ("learning-saving-user-dict.dat.snapshot");
+  g_remove ("learning-saving.dat");
+}
+
+int
+main (int argc, char **argv) {
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/learning/eviction", eviction);
+  g_test_add_func ("/libskk/learning/forget", forgetting);
+  g_test_add_func ("/libskk/learning/user-dict", user_dict_eviction);
+  g_test_add_func ("/libskk/learning/ranking", ranking);
+  g_test_add_func ("/libskk/learning/saving", saving);
+  return g_test_run ();
+}
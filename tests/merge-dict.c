@@ -0,0 +1,115 @@
+#include <libskk/libskk.h>
+#include <string.h>
+
+static gchar *
+join_candidates (SkkDict *dict, const gchar *midasi, gboolean okuri)
+{
+  SkkCandidate **candidates;
+  GString *texts = g_string_new ("");
+  gint len, i;
+
+  candidates = skk_dict_lookup (dict, midasi, okuri, &len);
+  for (i = 0; i < len; i++) {
+    gchar *str = skk_candidate_to_string (candidates[i]);
+    g_string_append_printf (texts, "/%s", str);
+    g_free (str);
+    g_object_unref (candidates[i]);
+  }
+  g_free (candidates);
+  return g_string_free (texts, FALSE);
+}
+
+static void
+merge_dict (void)
+{
+  static const struct {
+    const gchar *midasi;
+    gboolean okuri;
+    const gchar *expected;
+  } lookups[] = {
+    /* file-dict.dat comes first; annotations are taken from
+       merge-dict.dat */
+    { "かんじ", FALSE, "/漢字;kanji/幹事/感じ;feeling" },
+    { "かk", TRUE, "/書/掛/欠/架/駆/懸/賭;bet" },
+    /* only in one of them */
+    { "あu", TRUE, "/合/逢/会/遭" },
+    { "んんん", FALSE, "/ンンン" },
+  };
+  GError *error = NULL;
+  SkkFileDict *dict;
+  gint i;
+
+  dict = skk_file_dict_new (LIBSKK_MERGED_DICT, "EUC-JP", &error);
+  g_assert_no_error (error);
+
+  for (i = 0; i < G_N_ELEMENTS (lookups); i++) {
+    gchar *texts = join_candidates (SKK_DICT (dict),
+                                    lookups[i].midasi,
+                                    lookups[i].okuri);
+    g_assert_cmpstr (texts, ==, lookups[i].expected);
+    g_free (texts);
+  }
+
+  g_object_unref (dict);
+}
+
+/* Every entry of the inputs is found by bisection in the merged
+   dictionary.  */
+static void
+bisection (void)
+{
+  GError *error = NULL;
+  SkkFileDict *merged, *file_dict;
+  gchar *contents, **lines;
+  gboolean okuri = FALSE;
+  gint i;
+
+  merged = skk_file_dict_new (LIBSKK_MERGED_DICT, "EUC-JP", &error);
+  g_assert_no_error (error);
+  file_dict = skk_file_dict_new (LIBSKK_FILE_DICT, "EUC-JP", &error);
+  g_assert_no_error (error);
+
+  g_file_get_contents (LIBSKK_MERGED_DICT, &contents, NULL, &error);
+  g_assert_no_error (error);
+  lines = g_strsplit (contents, "\n", -1);
+  for (i = 0; lines[i] != NULL; i++) {
+    gchar *space, *expected, *texts;
+
+    if (g_str_has_prefix (lines[i], ";; okuri-ari entries.")) {
+      okuri = TRUE;
+      continue;
+    }
+    if (g_str_has_prefix (lines[i], ";; okuri-nasi entries.")) {
+      okuri = FALSE;
+      continue;
+    }
+    space = strchr (lines[i], ' ');
+    if (lines[i][0] == ';' || space == NULL)
+      continue;
+
+    *space = '\0';
+    texts = join_candidates (SKK_DICT (merged), lines[i], okuri);
+    g_assert_cmpstr (texts, !=, "");
+    /* entries of file-dict.dat keep their candidates first */
+    expected = join_candidates (SKK_DICT (file_dict), lines[i], okuri);
+    g_assert (g_str_has_prefix (texts, expected) ||
+              g_strcmp0 (lines[i], "かんじ") == 0);
+    g_free (expected);
+    g_free (texts);
+  }
+  g_strfreev (lines);
+  g_free (contents);
+
+  g_object_unref (file_dict);
+  g_object_unref (merged);
+}
+
+int
+main (int argc, char **argv)
+{
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/merge-dict", merge_dict);
+  g_test_add_func ("/libskk/merge-dict/bisection", bisection);
+  return g_test_run ();
+}
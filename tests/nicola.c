@@ -0,0 +1,125 @@
+#include <libskk/libskk.h>
+#include "common.h"
+
+/* Steps are separated by ",": "+N" advances the clock by N
+   microseconds, anything else is a key event.  "(usleep 0)" lets the
+   filter dispatch pending events at the current time, as the timeout
+   source would.  */
+typedef struct _NicolaTiming NicolaTiming;
+struct _NicolaTiming {
+  const gchar *steps;
+  const gchar *output;
+};
+
+static const NicolaTiming timings[] =
+  {
+    /* single key - timeout */
+    { "a,+200000,(usleep 0)", "a" },
+    /* single key - release */
+    { "a,(release a)", "a" },
+    /* single key - overlap */
+    { "a,+50000,b", "a" },
+    { "a,+50000,b,+200000,(usleep 0)", "a b" },
+    /* wrap around the pending queue */
+    { "a,+60000,b,+60000,c,+60000,d,+60000,e,+200000,(usleep 0)",
+      "a b c d e" },
+    /* double key - shifted */
+    { "a,+10000,(lshift),+200000,(usleep 0)", "(lshift a)" },
+    /* double key - shifted reverse */
+    { "(lshift),+10000,a,+200000,(usleep 0)", "(lshift a)" },
+    { "(rshift),+10000,a,+200000,(usleep 0)", "(rshift a)" },
+    /* double key - shifted expired */
+    { "a,+60000,(lshift)", "a" },
+    /* double key - skk-nicola */
+    { "f,+30000,j", "[fj]" },
+    { "j,+30000,f", "[fj]" },
+    { "(lshift),+30000,(rshift)", "[LR]" },
+    /* double key - not a special double */
+    { "a,+30000,j", "a" },
+    /* triple key t1 <= t2 */
+    { "a,+10000,(lshift),+20000,b", "(lshift a)" },
+    /* triple key t1 > t2 */
+    { "a,+20000,(lshift),+10000,b", "a (lshift b)" },
+    { NULL, NULL }
+  };
+
+static gint64
+fake_get_time (gpointer user_data)
+{
+  return *(gint64 *) user_data;
+}
+
+static void
+append_key_event (GString *output, SkkKeyEvent *key)
+{
+  gchar *str = skk_key_event_to_string (key);
+  if (output->len > 0)
+    g_string_append_c (output, ' ');
+  g_string_append (output, str);
+  g_free (str);
+}
+
+static void
+forwarded_cb (SkkKeyEventFilter *filter,
+              SkkKeyEvent       *key,
+              gpointer           user_data)
+{
+  append_key_event (user_data, key);
+}
+
+static void
+timing (void)
+{
+  gint i;
+
+  for (i = 0; timings[i].steps != NULL; i++) {
+    SkkNicolaKeyEventFilter *filter;
+    GString *output = g_string_new ("");
+    gint64 clock = 1000000;
+    gchar **steps;
+    gint j;
+
+    filter = g_object_new (SKK_TYPE_NICOLA_KEY_EVENT_FILTER, NULL);
+    filter->get_time_func = fake_get_time;
+    filter->get_time_func_target = &clock;
+    g_signal_connect (filter, "forwarded",
+                      G_CALLBACK (forwarded_cb), output);
+
+    steps = g_strsplit (timings[i].steps, ",", -1);
+    for (j = 0; steps[j] != NULL; j++) {
+      SkkKeyEvent *key, *result;
+      GError *error = NULL;
+
+      if (steps[j][0] == '+') {
+        clock += g_ascii_strtoll (steps[j] + 1, NULL, 10);
+        continue;
+      }
+
+      key = skk_key_event_new_from_string (steps[j], &error);
+      g_assert_no_error (error);
+      result = skk_key_event_filter_filter_key_event (
+        SKK_KEY_EVENT_FILTER (filter), key);
+      if (result != NULL) {
+        append_key_event (output, result);
+        g_object_unref (result);
+      }
+      g_object_unref (key);
+    }
+    g_strfreev (steps);
+
+    g_assert_cmpstr (output->str, ==, timings[i].output);
+
+    g_signal_handlers_disconnect_by_func (filter, forwarded_cb, output);
+    skk_key_event_filter_reset (SKK_KEY_EVENT_FILTER (filter));
+    g_object_unref (filter);
+    g_string_free (output, TRUE);
+  }
+}
+
+int
+main (int argc, char **argv) {
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/nicola/timing", timing);
+  return g_test_run ();
+}
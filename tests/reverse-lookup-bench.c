@@ -0,0 +1,140 @@
+#include <libskk/libskk.h>
+#include <glib/gstdio.h>
+#include "common.h"
+
+#define N_ENTRIES 50000
+#define N_LOOKUPS 20000
+#define N_HIRAGANA 80
+
+/* Write N_ENTRIES okuri-nasi entries; the midasi are three hiragana
+   counting up, so the file is sorted.  Each "漢字N" is in one entry,
+   each "幹事N" in about N_ENTRIES / 101.  */
+static gchar *
+create_dict (void)
+{
+  GString *contents;
+  GError *error = NULL;
+  gchar *path;
+  gint fd, i;
+
+  contents = g_string_new (";; -*- coding: utf-8 -*-\n"
+                           ";; okuri-ari entries.\n"
+                           ";; okuri-nasi entries.\n");
+  for (i = 0; i < N_ENTRIES; i++)
+    {
+      g_string_append_unichar (contents, 0x3041 + i / (N_HIRAGANA * N_HIRAGANA));
+      g_string_append_unichar (contents, 0x3041 + i / N_HIRAGANA % N_HIRAGANA);
+      g_string_append_unichar (contents, 0x3041 + i % N_HIRAGANA);
+      g_string_append_printf (contents, " /漢字%d/感じ%d;注釈%d/幹事%d/\n",
+                              i, i % 97, i % 13, i % 101);
+    }
+
+  fd = g_file_open_tmp ("reverse-lookup-bench-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+  g_close (fd, NULL);
+  g_file_set_contents (path, contents->str, contents->len, &error);
+  g_assert_no_error (error);
+  g_string_free (contents, TRUE);
+  return path;
+}
+
+static void
+free_candidates (SkkCandidate **candidates, gint n_candidates)
+{
+  gint i;
+
+  for (i = 0; i < n_candidates; i++)
+    g_object_unref (candidates[i]);
+  g_free (candidates);
+}
+
+/* Time the first reverse lookup of a fresh dictionary, which either
+   builds the index or maps the cached one.  */
+static gdouble
+first_lookup (const gchar *path)
+{
+  SkkFileDict *dict;
+  SkkCandidate **candidates;
+  GError *error = NULL;
+  GTimer *timer;
+  gint n_candidates;
+  gdouble elapsed;
+
+  dict = skk_file_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+
+  timer = g_timer_new ();
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "漢字0",
+                                        &n_candidates);
+  g_timer_stop (timer);
+  g_assert_cmpint (n_candidates, ==, 1);
+  free_candidates (candidates, n_candidates);
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  g_object_unref (dict);
+  return elapsed;
+}
+
+static void
+reverse_lookup (void)
+{
+  SkkFileDict *dict;
+  GError *error = NULL;
+  GTimer *timer;
+  gchar *path;
+  gchar **texts;
+  gdouble cold, cached;
+  gint i;
+
+  if (!g_test_perf ())
+    return;
+
+  path = create_dict ();
+
+  cold = first_lookup (path);
+  g_test_minimized_result (cold, "first lookup, building the index: %.6f s",
+                           cold);
+  cached = first_lookup (path);
+  g_test_minimized_result (cached, "first lookup, cached index: %.6f s",
+                           cached);
+
+  dict = skk_file_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+
+  texts = g_new0 (gchar *, N_LOOKUPS + 1);
+  for (i = 0; i < N_LOOKUPS; i++)
+    texts[i] = g_strdup_printf (i % 2 == 0 ? "漢字%d" : "幹事%d",
+                                (gint) (((gint64) i * 7919) % N_ENTRIES)
+                                % (i % 2 == 0 ? N_ENTRIES : 101));
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_LOOKUPS; i++)
+    {
+      SkkCandidate **candidates;
+      gint n_candidates;
+
+      candidates = skk_dict_reverse_lookup (SKK_DICT (dict), texts[i],
+                                            &n_candidates);
+      g_assert_cmpint (n_candidates, >, 0);
+      free_candidates (candidates, n_candidates);
+    }
+  g_timer_stop (timer);
+  g_test_minimized_result (g_timer_elapsed (timer, NULL) / N_LOOKUPS,
+                           "lookup: %.6f s",
+                           g_timer_elapsed (timer, NULL) / N_LOOKUPS);
+  g_timer_destroy (timer);
+
+  g_strfreev (texts);
+  g_object_unref (dict);
+  g_unlink (path);
+  g_free (path);
+}
+
+int
+main (int argc, char **argv) {
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/reverse-lookup-bench/file-dict", reverse_lookup);
+  return g_test_run ();
+}
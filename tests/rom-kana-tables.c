@@ -0,0 +1,73 @@
+/* The internal header declares the public API as well, so this test
+   does not include libskk.h nor common.h.  */
+#include <libskk/libskk-internals.h>
+
+static void
+assert_nodes_equal (SkkRomKanaNode *compiled, SkkRomKanaNode *parsed)
+{
+  guint i;
+
+  g_assert ((compiled->entry == NULL) == (parsed->entry == NULL));
+  if (compiled->entry != NULL) {
+    g_assert_cmpstr (compiled->entry->rom, ==, parsed->entry->rom);
+    g_assert_cmpstr (compiled->entry->carryover, ==,
+                     parsed->entry->carryover);
+    g_assert_cmpstr (compiled->entry->hiragana, ==,
+                     parsed->entry->hiragana);
+    g_assert_cmpstr (compiled->entry->katakana, ==,
+                     parsed->entry->katakana);
+    g_assert_cmpstr (compiled->entry->hankaku_katakana, ==,
+                     parsed->entry->hankaku_katakana);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (compiled->children); i++) {
+    g_assert ((compiled->children[i] == NULL) ==
+              (parsed->children[i] == NULL));
+    if (compiled->children[i] != NULL)
+      assert_nodes_equal (compiled->children[i], parsed->children[i]);
+  }
+}
+
+/* Every bundled rule is loaded from the compiled tables, which match
+   what parsing the rule files gives.  */
+static void
+compiled (void)
+{
+  SkkRuleMetadata *rules;
+  gint len;
+  gint n_compiled = 0;
+
+  rules = skk_rule_list (&len);
+  while (--len >= 0) {
+    SkkRomKanaNode *node;
+    SkkRomKanaMapFile *map_file;
+    GError *error;
+
+    /* rules in the tests directory are always parsed */
+    if (g_str_has_prefix (rules[len].base_dir,
+                          LIBSKK_RULES_DIR G_DIR_SEPARATOR_S)) {
+      node = skk_build_builtin_rom_kana (&rules[len]);
+      g_assert_nonnull (node);
+
+      error = NULL;
+      map_file = skk_rom_kana_map_file_new_parsed (&rules[len], &error);
+      g_assert_no_error (error);
+
+      assert_nodes_equal (node, map_file->root_node);
+      g_object_unref (map_file);
+      g_object_unref (node);
+      n_compiled++;
+    }
+    skk_rule_metadata_destroy (&rules[len]);
+  }
+  g_free (rules);
+  g_assert_cmpint (n_compiled, >, 0);
+}
+
+int
+main (int argc, char **argv) {
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/rom-kana-tables/compiled", compiled);
+  return g_test_run ();
+}
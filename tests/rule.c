@@ -125,6 +125,40 @@ nicola (void)
   destroy_context (context);
 }
 
+/* Bundled rules are loaded from the tables compiled in, other rules
+   are parsed; test-sticky includes the default rom-kana rule.  */
+static void
+compiled (void)
+{
+  const gchar *names[] = { "default", "test-sticky" };
+  SkkTransition transitions[] = {
+    { SKK_INPUT_MODE_HIRAGANA, "k y a", "", "きゃ", SKK_INPUT_MODE_HIRAGANA },
+    { SKK_INPUT_MODE_KATAKANA, "v u", "", "ヴ", SKK_INPUT_MODE_KATAKANA },
+    { SKK_INPUT_MODE_HANKAKU_KATAKANA, "v u", "", "ｳﾞ", SKK_INPUT_MODE_HANKAKU_KATAKANA },
+    { SKK_INPUT_MODE_HANKAKU_KATAKANA, "g a", "", "ｶﾞ", SKK_INPUT_MODE_HANKAKU_KATAKANA },
+    { SKK_INPUT_MODE_KATAKANA, "x k a", "", "ヵ", SKK_INPUT_MODE_KATAKANA },
+    { SKK_INPUT_MODE_HANKAKU_KATAKANA, "x w a", "", "ﾜ", SKK_INPUT_MODE_HANKAKU_KATAKANA },
+    { SKK_INPUT_MODE_KATAKANA, "z .", "", "…", SKK_INPUT_MODE_KATAKANA },
+    { 0, NULL }
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (names); i++) {
+    SkkContext *context;
+    GError *error;
+    SkkRule *rule;
+
+    context = create_context (FALSE, FALSE);
+    error = NULL;
+    rule = skk_rule_new (names[i], &error);
+    g_assert_no_error (error);
+    skk_context_set_typing_rule (context, rule);
+    g_object_unref (rule);
+    check_transitions (context, transitions);
+    destroy_context (context);
+  }
+}
+
 int
 main (int argc, char **argv) {
   skk_init ();
@@ -133,5 +167,6 @@ main (int argc, char **argv) {
   g_test_add_func ("/libskk/azik", azik);
   g_test_add_func ("/libskk/kzik", kzik);
   g_test_add_func ("/libskk/nicola", nicola);
+  g_test_add_func ("/libskk/compiled", compiled);
   return g_test_run ();
 }
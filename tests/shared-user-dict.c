@@ -0,0 +1,301 @@
+#include <libskk/libskk.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define N_PROCESSES 4
+#define N_SELECTIONS 200
+#define SAVE_INTERVAL 50
+
+static void
+remove_dict (const gchar *path)
+{
+  gchar *journal = g_strconcat (path, ".journal", NULL);
+  gchar *snapshot = g_strconcat (path, ".snapshot", NULL);
+
+  g_remove (path);
+  g_remove (journal);
+  g_remove (snapshot);
+  g_free (journal);
+  g_free (snapshot);
+}
+
+static gchar *
+first_candidate (SkkDict *dict, const gchar *midasi, gboolean okuri)
+{
+  SkkCandidate **candidates;
+  gchar *text = NULL;
+  gint n_candidates, i;
+
+  candidates = skk_dict_lookup (dict, midasi, okuri, &n_candidates);
+  if (n_candidates > 0)
+    text = g_strdup (skk_candidate_get_text (candidates[0]));
+  for (i = 0; i < n_candidates; i++)
+    g_object_unref (candidates[i]);
+  g_free (candidates);
+  return text;
+}
+
+static void
+select_candidate (SkkDict *dict, const gchar *midasi, const gchar *text)
+{
+  SkkCandidate *candidate = skk_candidate_new (midasi, FALSE, text,
+                                               NULL, NULL);
+  skk_dict_select_candidate (dict, candidate);
+  g_object_unref (candidate);
+}
+
+static void
+visibility (void)
+{
+  const gchar *path = "shared-user-dict.dat";
+  SkkSharedUserDict *dict0, *dict1;
+  SkkCandidate *candidate;
+  GError *error = NULL;
+  gchar *text;
+
+  remove_dict (path);
+  dict0 = skk_shared_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  dict1 = skk_shared_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+
+  /* a selection is visible to the other without reload */
+  select_candidate (SKK_DICT (dict0), "かんじ", "漢字");
+  text = first_candidate (SKK_DICT (dict1), "かんじ", FALSE);
+  g_assert_cmpstr (text, ==, "漢字");
+  g_free (text);
+
+  /* saving keeps the changes of both */
+  select_candidate (SKK_DICT (dict1), "かんじ", "感じ");
+  select_candidate (SKK_DICT (dict1), "あい", "愛");
+  skk_dict_save (SKK_DICT (dict0), &error);
+  g_assert_no_error (error);
+
+  text = first_candidate (SKK_DICT (dict1), "かんじ", FALSE);
+  g_assert_cmpstr (text, ==, "感じ");
+  g_free (text);
+  text = first_candidate (SKK_DICT (dict0), "あい", FALSE);
+  g_assert_cmpstr (text, ==, "愛");
+  g_free (text);
+
+  /* and so does a purge after the journal is merged */
+  candidate = skk_candidate_new ("あい", FALSE, "愛", NULL, NULL);
+  g_assert (skk_dict_purge_candidate (SKK_DICT (dict1), candidate));
+  g_object_unref (candidate);
+  text = first_candidate (SKK_DICT (dict0), "あい", FALSE);
+  g_assert (text == NULL);
+
+  g_object_unref (dict0);
+  g_object_unref (dict1);
+
+  /* a new process reads the file and the rest of the journal */
+  dict0 = skk_shared_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  text = first_candidate (SKK_DICT (dict0), "かんじ", FALSE);
+  g_assert_cmpstr (text, ==, "感じ");
+  g_free (text);
+  text = first_candidate (SKK_DICT (dict0), "あい", FALSE);
+  g_assert (text == NULL);
+  g_object_unref (dict0);
+
+  remove_dict (path);
+}
+
+static void
+torn_record (void)
+{
+  const gchar *path = "shared-user-dict-torn.dat";
+  SkkSharedUserDict *dict;
+  GError *error = NULL;
+  gchar *journal, *contents, *text;
+  gsize length;
+
+  remove_dict (path);
+  dict = skk_shared_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  select_candidate (SKK_DICT (dict), "かんじ", "漢字");
+  g_object_unref (dict);
+
+  /* simulate a crash in the middle of appending a record */
+  journal = g_strconcat (path, ".journal", NULL);
+  g_file_get_contents (journal, &contents, &length, &error);
+  g_assert_no_error (error);
+  contents = g_realloc (contents, length + 6);
+  memcpy (contents + length, "\x20\x00\x00\x00\x01\x02", 6);
+  g_file_set_contents (journal, contents, length + 6, &error);
+  g_assert_no_error (error);
+  g_free (contents);
+
+  dict = skk_shared_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  text = first_candidate (SKK_DICT (dict), "かんじ", FALSE);
+  g_assert_cmpstr (text, ==, "漢字");
+  g_free (text);
+
+  /* the next record replaces the incomplete one */
+  select_candidate (SKK_DICT (dict), "あい", "愛");
+  g_object_unref (dict);
+
+  dict = skk_shared_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  text = first_candidate (SKK_DICT (dict), "あい", FALSE);
+  g_assert_cmpstr (text, ==, "愛");
+  g_free (text);
+  g_object_unref (dict);
+
+  g_free (journal);
+  remove_dict (path);
+}
+
+static void
+max_entries (void)
+{
+  const gchar *path = "shared-user-dict-max-entries.dat";
+  SkkSharedUserDict *dict0, *dict1;
+  GError *error = NULL;
+  gchar *text;
+
+  remove_dict (path);
+  dict0 = skk_shared_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  dict1 = skk_shared_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  skk_shared_user_dict_set_max_entries (dict0, 2);
+
+  /* nothing is dropped until the journal is merged */
+  select_candidate (SKK_DICT (dict0), "a", "A");
+  select_candidate (SKK_DICT (dict0), "b", "B");
+  select_candidate (SKK_DICT (dict0), "c", "C");
+  text = first_candidate (SKK_DICT (dict0), "a", FALSE);
+  g_assert_cmpstr (text, ==, "A");
+  g_free (text);
+  text = first_candidate (SKK_DICT (dict1), "a", FALSE);
+  g_assert_cmpstr (text, ==, "A");
+  g_free (text);
+
+  /* then both drop the same entry, the first by midasi without a
+     learning store */
+  skk_dict_save (SKK_DICT (dict0), &error);
+  g_assert_no_error (error);
+  text = first_candidate (SKK_DICT (dict0), "a", FALSE);
+  g_assert (text == NULL);
+  text = first_candidate (SKK_DICT (dict1), "a", FALSE);
+  g_assert (text == NULL);
+  text = first_candidate (SKK_DICT (dict1), "c", FALSE);
+  g_assert_cmpstr (text, ==, "C");
+  g_free (text);
+
+  g_object_unref (dict0);
+  g_object_unref (dict1);
+  remove_dict (path);
+}
+
+/* Each process selects its own midasi and saves from time to time;
+   no selection may be lost.  */
+static void
+run_child (const gchar *path, gint index)
+{
+  SkkSharedUserDict *dict;
+  GError *error = NULL;
+  gint i;
+
+  dict = skk_shared_user_dict_new (path, "UTF-8", &error);
+  if (error != NULL)
+    _exit (1);
+
+  for (i = 0; i < N_SELECTIONS; i++)
+    {
+      gchar *midasi = g_strdup_printf ("p%d-%d", index, i);
+      gchar *text = g_strdup_printf ("P%d-%d", index, i);
+
+      select_candidate (SKK_DICT (dict), midasi, text);
+      g_free (midasi);
+      g_free (text);
+
+      if ((i + 1) % SAVE_INTERVAL == 0)
+        {
+          skk_dict_save (SKK_DICT (dict), &error);
+          if (error != NULL)
+            _exit (2);
+        }
+    }
+
+  g_object_unref (dict);
+  _exit (0);
+}
+
+static void
+stress (void)
+{
+  const gchar *path = "shared-user-dict-stress.dat";
+  SkkSharedUserDict *dict;
+  GError *error = NULL;
+  pid_t pids[N_PROCESSES];
+  gint i, j;
+
+  remove_dict (path);
+  /* create the journal before forking */
+  dict = skk_shared_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  g_object_unref (dict);
+
+  for (i = 0; i < N_PROCESSES; i++)
+    {
+      pids[i] = fork ();
+      g_assert_cmpint (pids[i], >=, 0);
+      if (pids[i] == 0)
+        run_child (path, i);
+    }
+
+  for (i = 0; i < N_PROCESSES; i++)
+    {
+      gint status;
+
+      g_assert_cmpint (waitpid (pids[i], &status, 0), ==, pids[i]);
+      g_assert (WIFEXITED (status));
+      g_assert_cmpint (WEXITSTATUS (status), ==, 0);
+    }
+
+  dict = skk_shared_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  skk_dict_save (SKK_DICT (dict), &error);
+  g_assert_no_error (error);
+  g_object_unref (dict);
+
+  /* a plain user dictionary sees all the selections */
+  {
+    SkkUserDict *user_dict = skk_user_dict_new (path, "UTF-8", &error);
+    g_assert_no_error (error);
+    for (i = 0; i < N_PROCESSES; i++)
+      for (j = 0; j < N_SELECTIONS; j++)
+        {
+          gchar *midasi = g_strdup_printf ("p%d-%d", i, j);
+          gchar *expected = g_strdup_printf ("P%d-%d", i, j);
+          gchar *text = first_candidate (SKK_DICT (user_dict), midasi,
+                                         FALSE);
+
+          g_assert_cmpstr (text, ==, expected);
+          g_free (text);
+          g_free (expected);
+          g_free (midasi);
+        }
+    g_object_unref (user_dict);
+  }
+
+  remove_dict (path);
+}
+
+int
+main (int argc, char **argv)
+{
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/shared-user-dict/visibility", visibility);
+  g_test_add_func ("/libskk/shared-user-dict/torn-record", torn_record);
+  g_test_add_func ("/libskk/shared-user-dict/max-entries", max_entries);
+  g_test_add_func ("/libskk/shared-user-dict/stress", stress);
+  return g_test_run ();
+}
@@ -0,0 +1,91 @@
+#include <libskk/libskk.h>
+#include <glib/gstdio.h>
+#include <sysprof-capture.h>
+#include <string.h>
+#include "common.h"
+
+#define TRACE_FILE "tracing.syscap"
+
+/* Look for a mark in the capture.  */
+static gboolean
+has_mark (const gchar *name, const gchar *message)
+{
+  SysprofCaptureReader *reader;
+  SysprofCaptureFrameType type;
+  gboolean found = FALSE;
+
+  reader = sysprof_capture_reader_new (TRACE_FILE);
+  g_assert (reader != NULL);
+  while (!found && sysprof_capture_reader_peek_type (reader, &type))
+    {
+      const SysprofCaptureMark *mark;
+
+      if (type != SYSPROF_CAPTURE_FRAME_MARK)
+        {
+          if (!sysprof_capture_reader_skip (reader))
+            break;
+          continue;
+        }
+
+      mark = sysprof_capture_reader_read_mark (reader);
+      g_assert (mark != NULL);
+      g_assert_cmpstr (mark->group, ==, "libskk");
+      g_assert_cmpint (mark->duration, >=, 0);
+      found = strcmp (mark->name, name) == 0 &&
+        strstr (mark->message, message) != NULL;
+    }
+  sysprof_capture_reader_unref (reader);
+  return found;
+}
+
+static void
+capture (void)
+{
+  SkkContext *context;
+  SkkRule *rule;
+  GError *error = NULL;
+
+  /* the capture is flushed at exit */
+  if (!g_test_subprocess ())
+    {
+      g_test_trap_subprocess (NULL, 0, 0);
+      g_test_trap_assert_passed ();
+      g_assert (has_mark ("Dict.reload", "SkkFileDict"));
+      g_assert (has_mark ("Context.process_key_event", "handled=1"));
+      g_assert (has_mark ("State.lookup", "midasi=3 okuri=0"));
+      g_assert (has_mark ("Dict.lookup",
+                          "SkkFileDict midasi=3 okuri=0 candidates=2"));
+      g_assert (has_mark ("Dict.save", "SkkUserDict"));
+      g_assert (has_mark ("Rule", "name=azik"));
+      return;
+    }
+
+  context = create_context (TRUE, TRUE);
+  skk_context_process_key_events (context, "K a n j i SPC");
+  skk_context_save_dictionaries (context, &error);
+  g_assert_no_error (error);
+  destroy_context (context);
+
+  rule = skk_rule_new ("azik", &error);
+  g_assert_no_error (error);
+  g_object_unref (rule);
+}
+
+int
+main (int argc, char **argv)
+{
+  int status;
+
+  g_setenv ("LIBSKK_TRACE_FILE", TRACE_FILE, TRUE);
+
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  /* written by the subprocess, and read back here */
+  if (!g_test_subprocess ())
+    g_remove (TRACE_FILE);
+  g_test_add_func ("/libskk/tracing/capture", capture);
+  status = g_test_run ();
+  if (!g_test_subprocess ())
+    g_remove (TRACE_FILE);
+  return status;
+}
@@ -0,0 +1,93 @@
+#include <libskk/libskk.h>
+#include <glib/gstdio.h>
+#include "common.h"
+
+#define N_ENTRIES 20000
+#define N_HIRAGANA 80
+#define N_LOADS 10
+
+static gdouble
+measure_load (const gchar *path)
+{
+  GTimer *timer;
+  gint i;
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_LOADS; i++)
+    {
+      SkkUserDict *dict;
+      GError *error = NULL;
+
+      dict = skk_user_dict_new (path, "UTF-8", &error);
+      g_assert_no_error (error);
+      g_object_unref (dict);
+    }
+  g_timer_stop (timer);
+  return g_timer_elapsed (timer, NULL) / N_LOADS;
+}
+
+/* Load a user dictionary from the text file, and from the snapshot
+   written by save.  */
+static void
+load (void)
+{
+  const gchar *path = "user-dict-bench.dat";
+  gchar *snapshot_path;
+  SkkUserDict *dict;
+  GError *error = NULL;
+  gdouble text, snapshot;
+  gint i;
+
+  if (!g_test_perf ())
+    return;
+
+  snapshot_path = g_strconcat (path, ".snapshot", NULL);
+  g_remove (path);
+  g_remove (snapshot_path);
+
+  dict = skk_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  for (i = 0; i < N_ENTRIES; i++)
+    {
+      SkkCandidate *candidate;
+      GString *midasi = g_string_new ("");
+      gchar *text;
+
+      g_string_append_unichar (midasi, 0x3041 + i / (N_HIRAGANA * N_HIRAGANA));
+      g_string_append_unichar (midasi, 0x3041 + i / N_HIRAGANA % N_HIRAGANA);
+      g_string_append_unichar (midasi, 0x3041 + i % N_HIRAGANA);
+      text = g_strdup_printf ("漢字%d", i);
+      candidate = skk_candidate_new (midasi->str, FALSE, text, NULL, NULL);
+      skk_dict_select_candidate (SKK_DICT (dict), candidate);
+      g_object_unref (candidate);
+      candidate = skk_candidate_new (midasi->str, FALSE, "感じ", "feeling",
+                                     NULL);
+      skk_dict_select_candidate (SKK_DICT (dict), candidate);
+      g_object_unref (candidate);
+      g_free (text);
+      g_string_free (midasi, TRUE);
+    }
+  skk_dict_save (SKK_DICT (dict), &error);
+  g_assert_no_error (error);
+  g_object_unref (dict);
+
+  snapshot = measure_load (path);
+  g_test_minimized_result (snapshot, "load %d entries from snapshot: %.6f s",
+                           N_ENTRIES, snapshot);
+
+  g_remove (snapshot_path);
+  text = measure_load (path);
+  g_test_minimized_result (text, "load %d entries from text: %.6f s",
+                           N_ENTRIES, text);
+
+  g_remove (path);
+  g_free (snapshot_path);
+}
+
+int
+main (int argc, char **argv) {
+  skk_init ();
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/libskk/user-dict-bench/load", load);
+  return g_test_run ();
+}
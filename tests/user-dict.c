@@ -1,4 +1,6 @@
 #include <libskk/libskk.h>
+#include <glib/gstdio.h>
+#include <string.h>
 #include "common.h"
 
 static void
@@ -80,6 +82,523 @@ completion (void)
   destroy_context (context0);
 }
 
+static void
+merge (void)
+{
+  SkkUserDict *dict0, *dict1;
+  SkkCandidate *candidate;
+  SkkCandidate **candidates;
+  gint n_candidates;
+  GError *error = NULL;
+
+  g_remove ("user-dict-merge.dat");
+
+  dict0 = skk_user_dict_new ("user-dict-merge.dat", "UTF-8", &error);
+  g_assert_no_error (error);
+  dict1 = skk_user_dict_new ("user-dict-merge.dat", "UTF-8", &error);
+  g_assert_no_error (error);
+
+  candidate = skk_candidate_new ("a", FALSE, "A", NULL, NULL);
+  skk_dict_select_candidate (SKK_DICT (dict0), candidate);
+  g_object_unref (candidate);
+  skk_dict_save (SKK_DICT (dict0), &error);
+  g_assert_no_error (error);
+
+  /* the file has changed behind dict1; its own entry must survive */
+  g_usleep (G_USEC_PER_SEC);
+  candidate = skk_candidate_new ("b", FALSE, "B", NULL, NULL);
+  skk_dict_select_candidate (SKK_DICT (dict1), candidate);
+  g_object_unref (candidate);
+  skk_dict_save (SKK_DICT (dict1), &error);
+  g_assert_no_error (error);
+
+  candidates = skk_dict_lookup (SKK_DICT (dict1), "a", FALSE, &n_candidates);
+  g_assert_cmpint (n_candidates, ==, 1);
+  while (--n_candidates >= 0)
+    g_object_unref (candidates[n_candidates]);
+  g_free (candidates);
+
+  candidates = skk_dict_lookup (SKK_DICT (dict1), "b", FALSE, &n_candidates);
+  g_assert_cmpint (n_candidates, ==, 1);
+  while (--n_candidates >= 0)
+    g_object_unref (candidates[n_candidates]);
+  g_free (candidates);
+
+  /* candidates added to the same midasi by both are kept, the local
+     selection first */
+  candidate = skk_candidate_new ("c", FALSE, "C0", NULL, NULL);
+  skk_dict_select_candidate (SKK_DICT (dict0), candidate);
+  g_object_unref (candidate);
+  skk_dict_save (SKK_DICT (dict0), &error);
+  g_assert_no_error (error);
+
+  g_usleep (G_USEC_PER_SEC);
+  candidate = skk_candidate_new ("c", FALSE, "C1", NULL, NULL);
+  skk_dict_select_candidate (SKK_DICT (dict1), candidate);
+  g_object_unref (candidate);
+  skk_dict_save (SKK_DICT (dict1), &error);
+  g_assert_no_error (error);
+
+  candidates = skk_dict_lookup (SKK_DICT (dict1), "c", FALSE, &n_candidates);
+  g_assert_cmpint (n_candidates, ==, 2);
+  g_assert_cmpstr (skk_candidate_get_text (candidates[0]), ==, "C1");
+  g_assert_cmpstr (skk_candidate_get_text (candidates[1]), ==, "C0");
+  while (--n_candidates >= 0)
+    g_object_unref (candidates[n_candidates]);
+  g_free (candidates);
+
+  g_object_unref (dict0);
+  g_object_unref (dict1);
+}
+
+static void
+reverse_lookup (void)
+{
+  SkkUserDict *dict;
+  SkkCandidate *candidate;
+  SkkCandidate **candidates;
+  gint n_candidates;
+  GError *error = NULL;
+
+  g_remove ("user-dict-reverse.dat");
+  dict = skk_user_dict_new ("user-dict-reverse.dat", "UTF-8", &error);
+  g_assert_no_error (error);
+
+  candidate = skk_candidate_new ("かんじ", FALSE, "漢字", NULL, NULL);
+  skk_dict_select_candidate (SKK_DICT (dict), candidate);
+  g_object_unref (candidate);
+
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "漢字",
+                                        &n_candidates);
+  g_assert_cmpint (n_candidates, ==, 1);
+  g_assert_cmpstr (skk_candidate_get_midasi (candidates[0]), ==, "かんじ");
+  while (--n_candidates >= 0)
+    g_object_unref (candidates[n_candidates]);
+  g_free (candidates);
+
+  /* the index follows selections and purges after it is built */
+  candidate = skk_candidate_new ("かk", TRUE, "漢字", NULL, NULL);
+  skk_dict_select_candidate (SKK_DICT (dict), candidate);
+  g_object_unref (candidate);
+
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "漢字",
+                                        &n_candidates);
+  g_assert_cmpint (n_candidates, ==, 2);
+  g_assert (skk_candidate_get_okuri (candidates[0]));
+  while (--n_candidates >= 0)
+    g_object_unref (candidates[n_candidates]);
+  g_free (candidates);
+
+  candidate = skk_candidate_new ("かんじ", FALSE, "漢字", NULL, NULL);
+  skk_dict_purge_candidate (SKK_DICT (dict), candidate);
+  g_object_unref (candidate);
+
+  candidates = skk_dict_reverse_lookup (SKK_DICT (dict), "漢字",
+                                        &n_candidates);
+  g_assert_cmpint (n_candidates, ==, 1);
+  g_assert_cmpstr (skk_candidate_get_midasi (candidates[0]), ==, "かk");
+  while (--n_candidates >= 0)
+    g_object_unref (candidates[n_candidates]);
+  g_free (candidates);
+
+  g_object_unref (dict);
+}
+
+static void
+complete_prefix (void)
+{
+  static const gchar *midasi[] = { "かk", "かえs", "かえr", "かu" };
+  SkkUserDict *dict;
+  gchar **completion;
+  gint len, i;
+  GError *error = NULL;
+
+  g_remove ("user-dict-complete.dat");
+  dict = skk_user_dict_new ("user-dict-complete.dat", "UTF-8", &error);
+  g_assert_no_error (error);
+
+  for (i = 0; i < G_N_ELEMENTS (midasi); i++)
+    {
+      SkkCandidate *candidate = skk_candidate_new (midasi[i], TRUE, "X",
+                                                   NULL, NULL);
+      skk_dict_select_candidate (SKK_DICT (dict), candidate);
+      g_object_unref (candidate);
+    }
+
+  /* okuri-ari entries are in descending order, as in the file */
+  completion = skk_dict_complete_prefix (SKK_DICT (dict), "かえ", TRUE, -1,
+                                         &len);
+  g_assert_cmpint (len, ==, 2);
+  g_assert_cmpstr (completion[0], ==, "かえs");
+  g_assert_cmpstr (completion[1], ==, "かえr");
+  g_strfreev (completion);
+
+  completion = skk_dict_complete_prefix (SKK_DICT (dict), "か", TRUE, 3,
+                                         &len);
+  g_assert_cmpint (len, ==, 3);
+  g_assert_cmpstr (completion[0], ==, "かえs");
+  g_assert_cmpstr (completion[2], ==, "かu");
+  g_strfreev (completion);
+
+  completion = skk_dict_complete_prefix (SKK_DICT (dict), "か", FALSE, -1,
+                                         &len);
+  g_assert_cmpint (len, ==, 0);
+  g_strfreev (completion);
+
+  g_object_unref (dict);
+}
+
+static gint
+count_candidates (SkkDict *dict, const gchar *midasi, gboolean okuri)
+{
+  SkkCandidate **candidates;
+  gint n_candidates, i;
+
+  candidates = skk_dict_lookup (dict, midasi, okuri, &n_candidates);
+  for (i = 0; i < n_candidates; i++)
+    g_object_unref (candidates[i]);
+  g_free (candidates);
+  return n_candidates;
+}
+
+static void
+snapshot (void)
+{
+  const gchar *path = "user-dict-snapshot.dat";
+  SkkUserDict *dict;
+  SkkCandidate *candidate;
+  SkkCandidate **candidates;
+  gint n_candidates;
+  GError *error = NULL;
+
+  g_remove (path);
+  g_remove ("user-dict-snapshot.dat.snapshot");
+
+  dict = skk_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  candidate = skk_candidate_new ("かんじ", FALSE, "漢字", "kanji", NULL);
+  skk_dict_select_candidate (SKK_DICT (dict), candidate);
+  g_object_unref (candidate);
+  candidate = skk_candidate_new ("かk", TRUE, "書", NULL, NULL);
+  skk_dict_select_candidate (SKK_DICT (dict), candidate);
+  g_object_unref (candidate);
+  skk_dict_save (SKK_DICT (dict), &error);
+  g_assert_no_error (error);
+  g_object_unref (dict);
+
+  g_assert (g_file_test ("user-dict-snapshot.dat.snapshot",
+                         G_FILE_TEST_EXISTS));
+
+  /* loaded from the snapshot */
+  dict = skk_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  candidates = skk_dict_lookup (SKK_DICT (dict), "かんじ", FALSE,
+                                &n_candidates);
+  g_assert_cmpint (n_candidates, ==, 1);
+  g_assert_cmpstr (skk_candidate_get_text (candidates[0]), ==, "漢字");
+  g_assert_cmpstr (skk_candidate_get_annotation (candidates[0]), ==, "kanji");
+  g_object_unref (candidates[0]);
+  g_free (candidates);
+  g_assert_cmpint (count_candidates (SKK_DICT (dict), "かk", TRUE), ==, 1);
+  g_object_unref (dict);
+
+  /* the text file is modified by another program; the stale
+     snapshot must be ignored */
+  g_usleep (G_USEC_PER_SEC);
+  g_file_set_contents (path,
+                       ";; okuri-ari entries.\n"
+                       ";; okuri-nasi entries.\n"
+                       "あい /愛/\n",
+                       -1, &error);
+  g_assert_no_error (error);
+
+  dict = skk_user_dict_new (path, "UTF-8", &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (count_candidates (SKK_DICT (dict), "かんじ", FALSE), ==, 0);
+  g_assert_cmpint (count_candidates (SKK_DICT (dict), "あい", FALSE), ==, 1);
+  g_object_unref (dict);
+
+  g_remove (path);
+  g_remove ("user-dict-snapshot.dat.snapshot");
+}
+
+static void
+top_completions (void)
+{
+  static const gchar *words[] = { "あいて", "あか", "あいさつ", "あいだ" };
+  SkkUserDict *dict;
+  SkkCompletionService *service;
+  gchar **completions;
+  gint n_completions;
+  GError *error = NULL;
+  gint i;
+
+  dict = skk_user_dict_new ("user-dict-completion.dat", "UTF-8", &error);
+  g_assert_no_error (error);
+  for (i = 0; i < G_N_ELEMENTS (words); i++) {
+    SkkCandidate *candidate = skk_candidate_new (words[i], FALSE, "X",
+                                                 NULL, NULL);
+    skk_dict_select_candidate (SKK_DICT (dict), candidate);
+    g_object_unref (candidate);
+  }
+
+  service = skk_completion_service_new ();
+  skk_completion_service_add_source (service, G_OBJECT (dict), 20);
+
+  completions = skk_completion_service_get_top_completions (service, "あ", -1,
+                                                            &n_completions);
+  g_assert_cmpint (n_completions, ==, 4);
+  g_strfreev (completions);
+
+  /* narrowed from the previous results */
+  completions = skk_completion_service_get_top_completions (service, "あい", 2,
+                                                            &n_completions);
+  g_assert_cmpint (n_completions, ==, 2);
+  g_assert_cmpstr (completions[0], ==, "あいさつ");
+  g_assert_cmpstr (completions[1], ==, "あいだ");
+  g_strfreev (completions);
+
+  completions = skk_completion_service_get_top_completions (service, "あいて", -1,
+                                                            &n_completions);
+  g_assert_cmpint (n_completions, ==, 0);
+  g_strfreev (completions);
+
+  skk_completion_service_unref (service);
+  g_object_unref (dict);
+}
+
+/* A remote source answering from an idle callback.  */
+typedef struct _TestRemoteSource TestRemoteSource;
+typedef struct _TestRemoteSourceClass TestRemoteSourceClass;
+
+struct _TestRemoteSource {
+  SkkCompletionSource parent;
+  gint n_queries;
+};
+
+struct _TestRemoteSourceClass {
+  SkkCompletionSourceClass parent_class;
+};
+
+GType test_remote_source_get_type (void);
+
+G_DEFINE_TYPE (TestRemoteSource, test_remote_source,
+               SKK_TYPE_COMPLETION_SOURCE)
+
+static const gchar *remote_words[] = { "あいこ", "あいさつ", "あお" };
+
+static gchar **
+test_remote_source_get_completions (SkkCompletionSource *source,
+                                    const gchar *midasi,
+                                    gint *result_length)
+{
+  GPtrArray *completions = g_ptr_array_new ();
+  gint i;
+
+  ((TestRemoteSource *) source)->n_queries++;
+  for (i = 0; i < G_N_ELEMENTS (remote_words); i++)
+    if (g_str_has_prefix (remote_words[i], midasi))
+      g_ptr_array_add (completions, g_strdup (remote_words[i]));
+  *result_length = completions->len;
+  g_ptr_array_add (completions, NULL);
+  return (gchar **) g_ptr_array_free (completions, FALSE);
+}
+
+static gboolean
+test_remote_source_answer (gpointer user_data)
+{
+  GTask *task = user_data;
+  SkkCompletionSource *source = g_task_get_source_object (task);
+  gchar **completions;
+  gint length;
+
+  if (g_task_return_error_if_cancelled (task))
+    return G_SOURCE_REMOVE;
+  completions = test_remote_source_get_completions (source,
+                                                    g_task_get_task_data (task),
+                                                    &length);
+  g_task_return_pointer (task, completions, (GDestroyNotify) g_strfreev);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+test_remote_source_get_completions_async (SkkCompletionSource *source,
+                                          const gchar *midasi,
+                                          GCancellable *cancellable,
+                                          GAsyncReadyCallback callback,
+                                          gpointer user_data)
+{
+  GTask *task = g_task_new (source, cancellable, callback, user_data);
+
+  g_task_set_task_data (task, g_strdup (midasi), g_free);
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, test_remote_source_answer,
+                   task, g_object_unref);
+}
+
+static gchar **
+test_remote_source_get_completions_finish (SkkCompletionSource *source,
+                                           GAsyncResult *result,
+                                           gint *result_length,
+                                           GError **error)
+{
+  gchar **completions = g_task_propagate_pointer (G_TASK (result), error);
+
+  if (result_length)
+    *result_length = completions ? g_strv_length (completions) : 0;
+  return completions;
+}
+
+static gboolean
+test_remote_source_get_true (SkkCompletionSource *source)
+{
+  return TRUE;
+}
+
+static void
+test_remote_source_class_init (TestRemoteSourceClass *klass)
+{
+  SkkCompletionSourceClass *source_class = SKK_COMPLETION_SOURCE_CLASS (klass);
+
+  source_class->get_completions = test_remote_source_get_completions;
+  source_class->get_completions_async =
+    test_remote_source_get_completions_async;
+  source_class->get_completions_finish =
+    test_remote_source_get_completions_finish;
+  source_class->get_is_remote = test_remote_source_get_true;
+  source_class->get_narrowable = test_remote_source_get_true;
+}
+
+static void
+test_remote_source_init (TestRemoteSource *source)
+{
+}
+
+typedef struct {
+  gint n_updates;
+  gchar **last_update;
+  gchar **result;
+  GError *error;
+  gboolean finished;
+} AsyncCompletion;
+
+static void
+async_completion_updated (gchar **completions, gint length,
+                          gpointer user_data)
+{
+  AsyncCompletion *data = user_data;
+
+  data->n_updates++;
+  g_strfreev (data->last_update);
+  data->last_update = g_strdupv (completions);
+}
+
+static void
+async_completion_ready (GObject *object, GAsyncResult *result,
+                        gpointer user_data)
+{
+  AsyncCompletion *data = user_data;
+  gint length;
+
+  data->result = skk_completion_service_get_completions_finish (
+    (SkkCompletionService *) object, result, &length, &data->error);
+  data->finished = TRUE;
+}
+
+static void
+run_async_completion (SkkCompletionService *service, const gchar *midasi,
+                      GCancellable *cancellable, gboolean cancel,
+                      AsyncCompletion *data)
+{
+  memset (data, 0, sizeof (*data));
+  skk_completion_service_get_completions_async (service, midasi, -1,
+                                                cancellable,
+                                                async_completion_updated,
+                                                data,
+                                                async_completion_ready,
+                                                data);
+  if (cancel)
+    g_cancellable_cancel (cancellable);
+  while (!data->finished)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+clear_async_completion (AsyncCompletion *data)
+{
+  g_strfreev (data->last_update);
+  g_strfreev (data->result);
+  g_clear_error (&data->error);
+}
+
+static void
+async_completions (void)
+{
+  static const gchar *words[] = { "あいて", "あいだ" };
+  SkkUserDict *dict;
+  TestRemoteSource *remote;
+  SkkCompletionService *service;
+  GCancellable *cancellable;
+  AsyncCompletion data;
+  GError *error = NULL;
+  gint i;
+
+  g_remove ("user-dict-async.dat");
+  dict = skk_user_dict_new ("user-dict-async.dat", "UTF-8", &error);
+  g_assert_no_error (error);
+  for (i = 0; i < G_N_ELEMENTS (words); i++) {
+    SkkCandidate *candidate = skk_candidate_new (words[i], FALSE, "X",
+                                                 NULL, NULL);
+    skk_dict_select_candidate (SKK_DICT (dict), candidate);
+    g_object_unref (candidate);
+  }
+  remote = g_object_new (test_remote_source_get_type (), NULL);
+
+  service = skk_completion_service_new ();
+  skk_completion_service_add_source (service, G_OBJECT (dict), 20);
+  skk_completion_service_add_source (service, G_OBJECT (remote), 10);
+  g_assert (skk_completion_service_get_has_remote_sources (service));
+
+  /* local results first, then merged with the remote ones */
+  run_async_completion (service, "あ", NULL, FALSE, &data);
+  g_assert_no_error (data.error);
+  g_assert_cmpint (data.n_updates, ==, 2);
+  g_assert_cmpint (g_strv_length (data.result), ==, 5);
+  g_assert_cmpstr (data.result[0], ==, "あいだ");
+  g_assert_cmpstr (data.result[1], ==, "あいて");
+  g_assert_cmpint (g_strv_length (data.last_update), ==, 5);
+  g_assert_cmpint (remote->n_queries, ==, 1);
+  clear_async_completion (&data);
+
+  /* narrowed without asking the sources, still reported */
+  run_async_completion (service, "あい", NULL, FALSE, &data);
+  g_assert_no_error (data.error);
+  g_assert_cmpint (data.n_updates, ==, 1);
+  g_assert_cmpint (g_strv_length (data.result), ==, 4);
+  g_assert_cmpint (g_strv_length (data.last_update), ==, 4);
+  g_assert_cmpint (remote->n_queries, ==, 1);
+  clear_async_completion (&data);
+
+  /* a cancelled query does not replace the cached results */
+  cancellable = g_cancellable_new ();
+  run_async_completion (service, "か", cancellable, TRUE, &data);
+  g_assert_error (data.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpint (remote->n_queries, ==, 1);
+  clear_async_completion (&data);
+  g_object_unref (cancellable);
+
+  run_async_completion (service, "あいさ", NULL, FALSE, &data);
+  g_assert_no_error (data.error);
+  g_assert_cmpint (g_strv_length (data.result), ==, 1);
+  g_assert_cmpstr (data.result[0], ==, "あいさつ");
+  g_assert_cmpint (remote->n_queries, ==, 1);
+  clear_async_completion (&data);
+
+  skk_completion_service_unref (service);
+  g_object_unref (remote);
+  g_object_unref (dict);
+  g_remove ("user-dict-async.dat");
+}
+
 int
 main (int argc, char **argv) {
   skk_init ();
@@ -87,5 +606,11 @@ main (int argc, char **argv) {
   g_test_add_func ("/libskk/user-dict", user_dict);
   g_test_add_func ("/libskk/save", save);
   g_test_add_func ("/libskk/completion", completion);
+  g_test_add_func ("/libskk/user-dict/merge", merge);
+  g_test_add_func ("/libskk/user-dict/reverse-lookup", reverse_lookup);
+  g_test_add_func ("/libskk/user-dict/complete-prefix", complete_prefix);
+  g_test_add_func ("/libskk/user-dict/snapshot", snapshot);
+  g_test_add_func ("/libskk/completion/top", top_completions);
+  g_test_add_func ("/libskk/completion/async", async_completions);
   return g_test_run ();
 }
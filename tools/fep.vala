@@ -25,6 +25,7 @@ enum PreeditStyle {
 
 static string opt_file_dict;
 static string opt_user_dict;
+static bool opt_shared_user_dict;
 static string opt_skkserv;
 static string opt_typing_rule;
 static bool opt_list_typing_rules;
@@ -35,6 +36,8 @@ static const OptionEntry[] options = {
       N_("Path to a file dictionary"), null },
     { "user-dict", 'u', 0, OptionArg.STRING, ref opt_user_dict,
       N_("Path to a user dictionary"), null },
+    { "shared-user-dict", 'S', 0, OptionArg.NONE, ref opt_shared_user_dict,
+      N_("Share the user dictionary with other processes"), null },
     { "skkserv", 's', 0, OptionArg.STRING, ref opt_skkserv,
       N_("Host and port running skkserv (HOST:PORT)"), null }, 
     { "rule", 'r', 0, OptionArg.STRING, ref opt_typing_rule,
@@ -78,7 +81,11 @@ static int main (string[] args) {
     ArrayList<Skk.Dict> dictionaries = new ArrayList<Skk.Dict> ();
     if (opt_user_dict != null) {
         try {
-            dictionaries.add (new Skk.UserDict (opt_user_dict));
+            if (opt_shared_user_dict) {
+                dictionaries.add (new Skk.SharedUserDict (opt_user_dict));
+            } else {
+                dictionaries.add (new Skk.UserDict (opt_user_dict));
+            }
         } catch (GLib.Error e) {
             stderr.printf ("can't open user dict %s: %s",
                            opt_user_dict, e.message);
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+ * Copyright (C) 2011-2026 Red Hat, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+static string opt_encoding;
+static int opt_block_size = 8192;
+
+static const OptionEntry[] options = {
+    { "encoding", 'e', 0, OptionArg.STRING, ref opt_encoding,
+      N_("Encoding of the input dictionary (default: \"EUC-JP\")"), null },
+    { "block-size", 'b', 0, OptionArg.INT, ref opt_block_size,
+      N_("Number of bytes in a block before compression"), null },
+    { null }
+};
+
+static int main (string[] args) {
+    Intl.setlocale (LocaleCategory.ALL, "");
+    Intl.bindtextdomain (Config.GETTEXT_PACKAGE, Config.LOCALEDIR);
+    Intl.bind_textdomain_codeset (Config.GETTEXT_PACKAGE, "UTF-8");
+    Intl.textdomain (Config.GETTEXT_PACKAGE);
+
+    var option_context = new OptionContext (
+        _("INPUT OUTPUT - convert a file dictionary to a compressed dictionary"));
+    option_context.add_main_entries (options, "libskk");
+    try {
+        option_context.parse (ref args);
+    } catch (OptionError e) {
+        stderr.printf ("%s\n", e.message);
+        return 1;
+    }
+
+    if (args.length != 3) {
+        stderr.printf ("%s", option_context.get_help (true, null));
+        return 1;
+    }
+
+    if (opt_block_size <= 0) {
+        stderr.printf ("block size must be positive\n");
+        return 1;
+    }
+
+    if (opt_encoding == null) {
+        opt_encoding = "EUC-JP";
+    }
+
+    Skk.init ();
+
+    try {
+        Skk.BlockDict.compress (args[1], args[2],
+                                opt_encoding, (uint) opt_block_size);
+    } catch (GLib.Error e) {
+        stderr.printf ("can't convert %s: %s\n", args[1], e.message);
+        return 1;
+    }
+    return 0;
+}
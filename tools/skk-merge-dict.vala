@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2011-2026 Daiki Ueno <ueno@gnu.org>
+ * Copyright (C) 2011-2026 Red Hat, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+using Gee;
+
+static string opt_output;
+static string opt_encoding;
+static int opt_run_size = 100000;
+static int opt_jobs = 0;
+
+static const OptionEntry[] options = {
+    { "output", 'o', 0, OptionArg.FILENAME, ref opt_output,
+      N_("Path to the merged dictionary"), null },
+    { "encoding", 'e', 0, OptionArg.STRING, ref opt_encoding,
+      N_("Encoding of the input dictionaries (default: \"EUC-JP\")"), null },
+    { "run-size", 'n', 0, OptionArg.INT, ref opt_run_size,
+      N_("Number of entries sorted in memory at once"), null },
+    { "jobs", 'j', 0, OptionArg.INT, ref opt_jobs,
+      N_("Number of sorting threads (default: number of processors)"), null },
+    { null }
+};
+
+// An entry of an input dictionary.  Inputs are numbered in priority
+// order, and entries are ordered by section, midasi and priority.
+class Record {
+    public bool okuri;
+    public string midasi;
+    public int priority;
+    public string candidates;
+
+    public static Record? parse (string line, bool okuri, int priority) {
+        var index = line.index_of_char (' ');
+        if (index < 1) {
+            return null;
+        }
+        var record = new Record ();
+        record.okuri = okuri;
+        record.midasi = line.substring (0, index);
+        record.priority = priority;
+        record.candidates = line.substring (index + 1).strip ();
+        return record;
+    }
+
+    // Okuri-ari entries are sorted in descending order, as FileDict
+    // expects.
+    public static int compare (Record a, Record b) {
+        if (a.okuri != b.okuri) {
+            return a.okuri ? -1 : 1;
+        }
+        var r = strcmp (a.midasi, b.midasi);
+        if (r != 0) {
+            return a.okuri ? -r : r;
+        }
+        return a.priority - b.priority;
+    }
+
+    // Runs are written as "PRIORITY MIDASI /.../" lines.
+    public string to_run_line () {
+        return "%d %s %s".printf (priority, midasi, candidates);
+    }
+
+    public static Record? parse_run_line (string line, bool okuri) {
+        var index = line.index_of_char (' ');
+        if (index < 1) {
+            return null;
+        }
+        return parse (line.substring (index + 1), okuri,
+                      int.parse (line.substring (0, index)));
+    }
+}
+
+// Merges the candidates of the records with the same midasi,
+// highest priority first.  A candidate which appears in several
+// inputs is kept once, at its first position, and takes the first
+// annotation found for it.
+class CandidateMerger {
+    ArrayList<string> texts = new ArrayList<string> ();
+    HashMap<string,string?> annotations = new HashMap<string,string?> ();
+
+    // Split "/a;x/[o/b/]/c/" into "a;x", "[o/b/]" and "c".
+    static ArrayList<string> split (string candidates) {
+        var items = new ArrayList<string> ();
+        var start = 1;
+        var depth = 0;
+        for (var i = 1; i < candidates.length; i++) {
+            var c = candidates[i];
+            if (c == '[' && i == start && i + 1 < candidates.length &&
+                candidates[i + 1] != '/') {
+                depth++;
+            } else if (c == ']' && depth > 0 && candidates[i - 1] == '/') {
+                depth--;
+            } else if (c == '/' && depth == 0) {
+                if (i > start) {
+                    items.add (candidates.substring (start, i - start));
+                }
+                start = i + 1;
+            }
+        }
+        return items;
+    }
+
+    public void add (string candidates) {
+        foreach (var item in split (candidates)) {
+            string text = item;
+            string? annotation = null;
+            if (!item.has_prefix ("[")) {
+                var index = item.index_of_char (';');
+                if (index >= 0) {
+                    text = item.substring (0, index);
+                    annotation = item.substring (index + 1);
+                }
+            }
+            if (!annotations.has_key (text)) {
+                texts.add (text);
+                annotations.set (text, annotation);
+            } else if (annotations.get (text) == null) {
+                annotations.set (text, annotation);
+            }
+        }
+    }
+
+    public string finish () {
+        var builder = new StringBuilder ("/");
+        foreach (var text in texts) {
+            builder.append (text);
+            var annotation = annotations.get (text);
+            if (annotation != null) {
+                builder.append_c (';');
+                builder.append (annotation);
+            }
+            builder.append_c ('/');
+        }
+        texts.clear ();
+        annotations.clear ();
+        return builder.str;
+    }
+}
+
+// Sorts chunks of records on worker threads and writes them as runs,
+// one file per section.  At most as many chunks as workers are kept
+// in memory.
+class RunWriter {
+    string tmpdir;
+    ThreadPool<ArrayList<Record>> pool;
+    Mutex mutex = Mutex ();
+    Cond cond = Cond ();
+    int pending = 0;
+    int max_pending;
+    int serial = 0;
+    GLib.Error? error = null;
+
+    public ArrayList<string> okuri_ari_runs = new ArrayList<string> ();
+    public ArrayList<string> okuri_nasi_runs = new ArrayList<string> ();
+
+    public RunWriter (string tmpdir, int jobs) throws ThreadError {
+        this.tmpdir = tmpdir;
+        this.max_pending = jobs;
+        pool = new ThreadPool<ArrayList<Record>>.with_owned_data (
+            (chunk) => {
+                sort_and_write (chunk);
+            },
+            jobs,
+            false);
+    }
+
+    void sort_and_write (ArrayList<Record> chunk) {
+        chunk.sort (Record.compare);
+        try {
+            var okuri_ari = write_section (chunk, true);
+            var okuri_nasi = write_section (chunk, false);
+            mutex.lock ();
+            if (okuri_ari != null) {
+                okuri_ari_runs.add (okuri_ari);
+            }
+            if (okuri_nasi != null) {
+                okuri_nasi_runs.add (okuri_nasi);
+            }
+        } catch (GLib.Error e) {
+            mutex.lock ();
+            if (error == null) {
+                error = e;
+            }
+        }
+        pending--;
+        cond.broadcast ();
+        mutex.unlock ();
+    }
+
+    string? write_section (ArrayList<Record> chunk, bool okuri)
+        throws GLib.Error
+    {
+        DataOutputStream? output = null;
+        string? path = null;
+        foreach (var record in chunk) {
+            if (record.okuri != okuri) {
+                continue;
+            }
+            if (output == null) {
+                mutex.lock ();
+                path = Path.build_filename (tmpdir,
+                                            "run-%d".printf (serial++));
+                mutex.unlock ();
+                output = new DataOutputStream (
+                    new BufferedOutputStream (
+                        File.new_for_path (path).create (
+                            FileCreateFlags.NONE)));
+            }
+            output.put_string (record.to_run_line ());
+            output.put_byte ('\n');
+        }
+        if (output != null) {
+            output.close ();
+        }
+        return path;
+    }
+
+    public void add (ArrayList<Record> chunk) throws GLib.Error {
+        mutex.lock ();
+        while (pending >= max_pending) {
+            cond.wait (mutex);
+        }
+        pending++;
+        mutex.unlock ();
+        pool.add (chunk);
+    }
+
+    public void finish () throws GLib.Error {
+        mutex.lock ();
+        while (pending > 0) {
+            cond.wait (mutex);
+        }
+        var _error = error;
+        mutex.unlock ();
+        if (_error != null) {
+            throw _error;
+        }
+    }
+}
+
+class RunReader {
+    DataInputStream input;
+    bool okuri;
+    public Record? current;
+
+    public RunReader (string path, bool okuri) throws GLib.Error {
+        input = new DataInputStream (File.new_for_path (path).read ());
+        this.okuri = okuri;
+    }
+
+    public bool next () throws GLib.Error {
+        string? line;
+        while ((line = input.read_line ()) != null) {
+            current = Record.parse_run_line (line, okuri);
+            if (current != null) {
+                return true;
+            }
+        }
+        current = null;
+        return false;
+    }
+}
+
+// Merge the sorted runs of a section into one file, joining the
+// records with the same midasi.
+static uint merge_runs (Gee.List<string> runs, bool okuri, string path)
+    throws GLib.Error
+{
+    var queue = new PriorityQueue<RunReader> (
+        (a, b) => Record.compare (a.current, b.current));
+    foreach (var run in runs) {
+        var reader = new RunReader (run, okuri);
+        if (reader.next ()) {
+            queue.offer (reader);
+        }
+    }
+
+    var output = new DataOutputStream (
+        new BufferedOutputStream (
+            File.new_for_path (path).replace (null,
+                                              false,
+                                              FileCreateFlags.NONE)));
+    var merger = new CandidateMerger ();
+    string? midasi = null;
+    uint count = 0;
+    while (!queue.is_empty) {
+        var reader = queue.poll ();
+        var record = reader.current;
+        if (record.midasi != midasi) {
+            if (midasi != null) {
+                output.put_string ("%s %s\n".printf (midasi,
+                                                     merger.finish ()));
+                count++;
+            }
+            midasi = record.midasi;
+        }
+        merger.add (record.candidates);
+        if (reader.next ()) {
+            queue.offer (reader);
+        }
+    }
+    if (midasi != null) {
+        output.put_string ("%s %s\n".printf (midasi, merger.finish ()));
+        count++;
+    }
+    output.close ();
+    return count;
+}
+
+// Return the encoding given by the coding cookie of the first line,
+// or null.
+static string? read_encoding (File file) throws GLib.Error {
+    var input = new DataInputStream (file.read ());
+    var line = input.read_line ();
+    if (line == null) {
+        return null;
+    }
+    return Skk.get_encoding_from_coding_cookie (line);
+}
+
+static void read_dict (string path,
+                       int priority,
+                       RunWriter writer) throws GLib.Error
+{
+    var file = File.new_for_path (path);
+    var encoding = read_encoding (file) ?? opt_encoding;
+    var input = new DataInputStream (
+        new ConverterInputStream (file.read (),
+                                  new CharsetConverter ("UTF-8", encoding)));
+    // entries before the first boundary are taken as okuri-nasi
+    var okuri = false;
+    var chunk = new ArrayList<Record> ();
+    string? line;
+    while ((line = input.read_line ()) != null) {
+        if (line.has_prefix (";")) {
+            if (line.has_prefix (";; okuri-ari entries.")) {
+                okuri = true;
+            } else if (line.has_prefix (";; okuri-nasi entries.")) {
+                okuri = false;
+            }
+            continue;
+        }
+        line = line.chomp ();
+        if (line == "") {
+            continue;
+        }
+        var record = Record.parse (line, okuri, priority);
+        if (record == null) {
+            stderr.printf ("%s: ignoring malformed entry: %s\n",
+                           path, line);
+            continue;
+        }
+        chunk.add (record);
+        if (chunk.size >= opt_run_size) {
+            writer.add (chunk);
+            chunk = new ArrayList<Record> ();
+        }
+    }
+    if (chunk.size > 0) {
+        writer.add (chunk);
+    }
+}
+
+static void append_file (OutputStream output, string path) throws GLib.Error {
+    var input = File.new_for_path (path).read ();
+    output.splice (input, OutputStreamSpliceFlags.CLOSE_SOURCE);
+}
+
+static void merge (string[] inputs, string tmpdir) throws GLib.Error {
+    var writer = new RunWriter (tmpdir, opt_jobs);
+    for (var i = 0; i < inputs.length; i++) {
+        read_dict (inputs[i], i, writer);
+    }
+    writer.finish ();
+
+    // the sections are merged in parallel
+    var okuri_ari_path = Path.build_filename (tmpdir, "okuri-ari");
+    var okuri_nasi_path = Path.build_filename (tmpdir, "okuri-nasi");
+    GLib.Error? okuri_ari_error = null;
+    uint okuri_ari_count = 0;
+    var thread = new Thread<bool> ("skk-merge-dict", () => {
+            try {
+                okuri_ari_count = merge_runs (writer.okuri_ari_runs,
+                                              true,
+                                              okuri_ari_path);
+            } catch (GLib.Error e) {
+                okuri_ari_error = e;
+            }
+            return true;
+        });
+    var okuri_nasi_count = merge_runs (writer.okuri_nasi_runs,
+                                       false,
+                                       okuri_nasi_path);
+    thread.join ();
+    if (okuri_ari_error != null) {
+        throw okuri_ari_error;
+    }
+
+    var output = new DataOutputStream (
+        File.new_for_path (opt_output).replace (null,
+                                                false,
+                                                FileCreateFlags.NONE));
+    output.put_string (";; -*- mode: fundamental; coding: utf-8 -*-\n");
+    output.put_string (";; Merged from: %s\n".printf (
+                           string.joinv (", ", inputs)));
+    output.put_string (";; Entries: %u okuri-ari, %u okuri-nasi.\n".printf (
+                           okuri_ari_count, okuri_nasi_count));
+    output.put_string (";; okuri-ari entries.\n");
+    append_file (output, okuri_ari_path);
+    output.put_string (";; okuri-nasi entries.\n");
+    append_file (output, okuri_nasi_path);
+    output.close ();
+}
+
+static void remove_directory (string path) {
+    try {
+        var dir = Dir.open (path);
+        string? name;
+        while ((name = dir.read_name ()) != null) {
+            FileUtils.unlink (Path.build_filename (path, name));
+        }
+    } catch (FileError e) {
+    }
+    DirUtils.remove (path);
+}
+
+static int main (string[] args) {
+    Intl.setlocale (LocaleCategory.ALL, "");
+    Intl.bindtextdomain (Config.GETTEXT_PACKAGE, Config.LOCALEDIR);
+    Intl.bind_textdomain_codeset (Config.GETTEXT_PACKAGE, "UTF-8");
+    Intl.textdomain (Config.GETTEXT_PACKAGE);
+
+    var option_context = new OptionContext (
+        _("INPUT... - merge dictionaries, the first ones taking precedence"));
+    option_context.add_main_entries (options, "libskk");
+    try {
+        option_context.parse (ref args);
+    } catch (OptionError e) {
+        stderr.printf ("%s\n", e.message);
+        return 1;
+    }
+
+    if (args.length < 2 || opt_output == null) {
+        stderr.printf ("%s", option_context.get_help (true, null));
+        return 1;
+    }
+
+    if (opt_run_size <= 0) {
+        stderr.printf ("run size must be positive\n");
+        return 1;
+    }
+
+    if (opt_jobs <= 0) {
+        opt_jobs = (int) get_num_processors ();
+    }
+
+    if (opt_encoding == null) {
+        opt_encoding = "EUC-JP";
+    }
+
+    string tmpdir;
+    try {
+        tmpdir = DirUtils.make_tmp ("skk-merge-dict-XXXXXX");
+    } catch (FileError e) {
+        stderr.printf ("can't create temporary directory: %s\n", e.message);
+        return 1;
+    }
+
+    var status = 0;
+    try {
+        merge (args[1:args.length], tmpdir);
+    } catch (GLib.Error e) {
+        stderr.printf ("can't merge dictionaries: %s\n", e.message);
+        status = 1;
+    }
+    remove_directory (tmpdir);
+    return status;
+}
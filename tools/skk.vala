@@ -22,6 +22,7 @@ static string opt_user_dict;
 static string opt_skkserv;
 static string opt_typing_rule;
 static bool opt_list_typing_rules;
+static bool opt_memory_usage;
 
 static const OptionEntry[] options = {
     { "file-dict", 'f', 0, OptionArg.STRING, ref opt_file_dict,
@@ -34,6 +35,8 @@ static const OptionEntry[] options = {
       N_("Typing rule (default: \"default\")"), null },
     { "list-rules", 'l', 0, OptionArg.NONE, ref opt_list_typing_rules,
       N_("List typing rules"), null },
+    { "memory-usage", 'm', 0, OptionArg.NONE, ref opt_memory_usage,
+      N_("Print memory usage on exit"), null },
     { null }
 };
 
@@ -90,6 +93,14 @@ static int main (string[] args) {
                            opt_file_dict, e.message);
             return 1;
         }
+    } else if (opt_file_dict.has_suffix (".skkz")) {
+        try {
+            dictionaries.add (new Skk.BlockDict (opt_file_dict));
+        } catch (GLib.Error e) {
+            stderr.printf ("can't open compressed dict %s: %s",
+                           opt_file_dict, e.message);
+            return 1;
+        }
     } else {
         try {
             dictionaries.add (new Skk.FileDict (opt_file_dict));
@@ -137,6 +148,8 @@ static int main (string[] args) {
     var repl = new Repl (context);
     if (!repl.run ())
         return 1;
+    if (opt_memory_usage)
+        stderr.printf ("%s", context.get_memory_usage_report ());
     return 0;
 }
 